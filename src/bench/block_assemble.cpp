@@ -2,9 +2,12 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <arith_uint256.h>
 #include <bench/bench.h>
+#include <chainparams.h>
 #include <consensus/validation.h>
 #include <crypto/sha256.h>
+#include <miner.h>
 #include <test/util/mining.h>
 #include <test/util/setup_common.h>
 #include <test/util/wallet.h>
@@ -51,4 +54,56 @@ static void AssembleBlock(benchmark::State& state)
     }
 }
 
+// A template for a mempool of 2000 transactions, in chains of up to ten, that
+// gains one more transaction before each template. Their coins are added to
+// the UTXO set directly, rather than mined.
+static void AssembleGrowingBlock(benchmark::State& state, bool extend)
+{
+    CTxMemPool& pool = *g_testing_setup->m_node.mempool;
+    LOCK2(cs_main, pool.cs);
+    ResetLastBlockSelection();
+
+    const CScript script_pub{CScript() << OP_TRUE};
+    uint64_t coins = 0;
+    CTransactionRef prev;
+    auto add_tx = [&](bool spend_prev) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        if (spend_prev) {
+            tx.vin[0].prevout = COutPoint(prev->GetHash(), 0);
+        } else {
+            tx.vin[0].prevout = COutPoint(ArithToUint256(++coins), 0);
+            ::ChainstateActive().CoinsTip().AddCoin(tx.vin[0].prevout, Coin(CTxOut(COIN, script_pub), 1, false), false);
+        }
+        const CAmount value = spend_prev ? prev->vout[0].nValue : COIN;
+        const CAmount fee = 1000 + coins % 1000;
+        tx.vout.emplace_back(value - fee, script_pub);
+        prev = MakeTransactionRef(tx);
+        LockPoints lp;
+        pool.addUnchecked(CTxMemPoolEntry(prev, fee, /* time */ 0, /* height */ 1, /* spendsCoinbase */ false, /* sigOpCost */ 4, lp));
+    };
+    for (int i = 0; i < 2000; ++i) {
+        add_tx(/* spend_prev */ i % 10 != 0);
+    }
+
+    while (state.KeepRunning()) {
+        add_tx(/* spend_prev */ false);
+        if (!extend) ResetLastBlockSelection();
+        BlockAssembler(pool, Params()).CreateNewBlock(script_pub);
+    }
+    pool.clear();
+}
+
+static void AssembleBlockExtended(benchmark::State& state)
+{
+    AssembleGrowingBlock(state, /* extend */ true);
+}
+
+static void AssembleBlockRebuilt(benchmark::State& state)
+{
+    AssembleGrowingBlock(state, /* extend */ false);
+}
+
 BENCHMARK(AssembleBlock, 700);
+BENCHMARK(AssembleBlockExtended, 50);
+BENCHMARK(AssembleBlockRebuilt, 50);
@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <script/signingprovider.h>
 #include <test/util/transaction_utils.h>
 
@@ -49,4 +50,35 @@ static void CCoinsCaching(benchmark::State& state)
     }
 }
 
+// Lookups in a large cache, half of them for coins that it does not hold.
+static void CCoinsCachingLookups(benchmark::State& state)
+{
+    static const int COINS = 200000;
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins(&coinsDummy);
+    FastRandomContext det_rand{true};
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(2 * COINS);
+    for (int i = 0; i < COINS; ++i) {
+        outpoints.emplace_back(det_rand.rand256(), 0);
+        Coin coin;
+        coin.out.nValue = COIN;
+        coin.out.scriptPubKey = CScript() << OP_TRUE;
+        coin.nHeight = 1;
+        coins.AddCoin(outpoints.back(), std::move(coin), false);
+    }
+    for (int i = 0; i < COINS; ++i) {
+        outpoints.emplace_back(det_rand.rand256(), 0);
+    }
+
+    while (state.KeepRunning()) {
+        int found = 0;
+        for (const COutPoint& outpoint : outpoints) {
+            found += coins.HaveCoinInCache(outpoint);
+        }
+        assert(found == COINS);
+    }
+}
+
 BENCHMARK(CCoinsCaching, 170 * 1000);
+BENCHMARK(CCoinsCachingLookups, 20);
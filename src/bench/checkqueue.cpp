@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 #include <util/system.h>
 #include <checkqueue.h>
+#include <crypto/sha256.h>
 #include <prevector.h>
 #include <vector>
 #include <boost/thread/thread.hpp>
@@ -59,3 +60,52 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.join_all();
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+
+// This Benchmark tests the CheckQueue with checks that take an uneven amount of
+// work, roughly like signature checks of different scripts, submitted one
+// transaction at a time, with a fixed number of worker threads.
+static void CCheckQueueHashJob(benchmark::State& state, int worker_threads)
+{
+    struct HashJob {
+        size_t rounds{0};
+        HashJob() {}
+        explicit HashJob(FastRandomContext& insecure_rand) : rounds(1 + insecure_rand.randrange(64)) {}
+        bool operator()()
+        {
+            unsigned char hash[CSHA256::OUTPUT_SIZE] = {};
+            for (size_t i = 0; i < rounds; ++i) {
+                CSHA256().Write(hash, sizeof(hash)).Finalize(hash);
+            }
+            return true;
+        }
+        void swap(HashJob& x) { std::swap(rounds, x.rounds); };
+    };
+    CCheckQueue<HashJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < worker_threads; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        FastRandomContext insecure_rand(true);
+        CCheckQueueControl<HashJob> control(&queue);
+        for (size_t tx = 0; tx < BATCHES * 10; ++tx) {
+            std::vector<HashJob> vChecks;
+            for (size_t x = insecure_rand.randrange(5); x < 5; ++x)
+                vChecks.emplace_back(insecure_rand);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueHashJob1Thread(benchmark::State& state) { CCheckQueueHashJob(state, 1); }
+static void CCheckQueueHashJob4Threads(benchmark::State& state) { CCheckQueueHashJob(state, 4); }
+static void CCheckQueueHashJob8Threads(benchmark::State& state) { CCheckQueueHashJob(state, 8); }
+static void CCheckQueueHashJob16Threads(benchmark::State& state) { CCheckQueueHashJob(state, 16); }
+
+BENCHMARK(CCheckQueueHashJob1Thread, 20);
+BENCHMARK(CCheckQueueHashJob4Threads, 20);
+BENCHMARK(CCheckQueueHashJob8Threads, 20);
+BENCHMARK(CCheckQueueHashJob16Threads, 20);
@@ -7,6 +7,7 @@
 #include <hash.h>
 #include <random.h>
 #include <uint256.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -91,6 +92,31 @@ static void FastRandom_1bit(benchmark::State& state)
     }
 }
 
+static void MuHash(benchmark::State& state)
+{
+    MuHash3072 acc;
+    unsigned char key[32] = {0};
+    int i = 0;
+    while (state.KeepRunning()) {
+        key[0] = ++i;
+        const Span<const unsigned char> in(key, sizeof(key));
+        acc.Insert(in);
+    }
+}
+
+static void MuHashFinalize(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    const std::vector<unsigned char> in = rng.randbytes(32), out_in = rng.randbytes(32);
+    MuHash3072 acc{MakeSpan(in)};
+    acc.Remove(MakeSpan(out_in));
+    uint256 out;
+    while (state.KeepRunning()) {
+        acc.Finalize(out);
+        acc.Remove(Span<const unsigned char>(out.begin(), out.size()));
+    }
+}
+
 BENCHMARK(RIPEMD160, 440);
 BENCHMARK(SHA1, 570);
 BENCHMARK(SHA256, 340);
@@ -101,3 +127,6 @@ BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
 BENCHMARK(SHA256D64_1024, 7400);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
+
+BENCHMARK(MuHash, 5000);
+BENCHMARK(MuHashFinalize, 200);
@@ -0,0 +1,73 @@
+// Copyright (c) 2020 The NIX Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <net.h>
+#include <policy/policy.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static const size_t STEM_TXS = 5000;
+// The embargoes are spread over this many seconds and checked once per second
+static const int64_t EMBARGO_SPREAD = 30;
+
+static void AddTx(const CTransactionRef& tx, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    int64_t nTime = 0;
+    unsigned int nHeight = 1;
+    bool spendsCoinbase = false;
+    unsigned int sigOpCost = 4;
+    LockPoints lp;
+    pool.addUnchecked(CTxMemPoolEntry(tx, 1000, nTime, nHeight, spendsCoinbase, sigOpCost, lp));
+}
+
+// Stem transactions enter the stempool under embargo. Every other one reaches
+// the mempool through the network before its embargo ends; the rest are
+// fluffed from the stempool when their embargo runs out.
+static void DandelionStemToFluff(benchmark::State& state)
+{
+    FastRandomContext det_rand{true};
+    std::vector<CTransactionRef> txs;
+    txs.reserve(STEM_TXS);
+    for (size_t i = 0; i < STEM_TXS; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(det_rand.rand256(), 0);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        txs.push_back(MakeTransactionRef(tx));
+    }
+
+    CConnman connman(0x1337, 0x1337);
+    CTxMemPool stem_pool;
+    CTxMemPool pool;
+    LOCK2(cs_main, stem_pool.cs);
+    LOCK(pool.cs);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < txs.size(); ++i) {
+            AddTx(txs[i], stem_pool);
+            connman.insertDandelionEmbargo(txs[i]->GetHash(), 1000000 * (1 + det_rand.randrange(EMBARGO_SPREAD)));
+        }
+        for (size_t i = 0; i < txs.size(); i += 2) {
+            AddTx(txs[i], pool);
+            connman.removeDandelionEmbargo(txs[i]->GetHash());
+        }
+        for (int64_t now = 1; now <= EMBARGO_SPREAD + 1; ++now) {
+            for (const uint256& hash : connman.popExpiredDandelionEmbargoes(1000000 * now)) {
+                if (pool.exists(hash)) continue;
+                CTransactionRef tx = stem_pool.get(hash);
+                assert(tx);
+                AddTx(tx, pool);
+            }
+        }
+        assert(pool.size() == STEM_TXS);
+        stem_pool.clear();
+        pool.clear();
+    }
+}
+
+BENCHMARK(DandelionStemToFluff, 20);
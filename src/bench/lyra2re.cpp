@@ -0,0 +1,248 @@
+// Copyright (c) 2020 The NIX Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <crypto/Lyra2RE/Lyra2.h>
+#include <crypto/Lyra2RE/Lyra2RE.h>
+#include <crypto/Lyra2RE/sph_blake.h>
+#include <crypto/Lyra2RE/sph_bmw.h>
+#include <crypto/Lyra2RE/sph_cubehash.h>
+#include <crypto/Lyra2RE/sph_keccak.h>
+#include <crypto/Lyra2RE/sph_skein.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <txdb.h>
+#include <util/memory.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <boost/thread/thread.hpp>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Benchmarks for the Lyra2REv2 proof of work: the full hash, each of its
+// stages on the input sizes lyra2re2_hash() uses, batched verification and
+// loading a block index.
+
+static const size_t POW_BATCH_SIZE = 1024;
+
+/** Headers that pass the regtest proof of work check. */
+static std::vector<CBlockHeader> CreatePoWHeaders(size_t count)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    std::vector<CBlockHeader> headers(count);
+    uint256 prev;
+    for (size_t i = 0; i < count; ++i) {
+        headers[i].nVersion = CBlockHeader::CURRENT_VERSION;
+        headers[i].hashPrevBlock = prev;
+        headers[i].nTime = 1500000000 + i;
+        headers[i].nBits = UintToArith256(consensus.powLimit).GetCompact();
+        while (!CheckProofOfWork(headers[i].GetPoWHash(), headers[i].nBits, consensus)) ++headers[i].nNonce;
+        prev = headers[i].GetHash();
+    }
+    return headers;
+}
+
+static void PoWHash_Header(benchmark::State& state)
+{
+    CBlockHeader header;
+    while (state.KeepRunning()) {
+        header.GetPoWHash();
+        ++header.nNonce;
+    }
+}
+
+static void PoWHash_1024Headers(benchmark::State& state)
+{
+    std::vector<CBlockHeader> headers(POW_BATCH_SIZE);
+    std::vector<uint256> hashes(POW_BATCH_SIZE);
+    while (state.KeepRunning()) {
+        GetPoWHashes(Span<const CBlockHeader>(headers.data(), headers.size()), hashes.data());
+    }
+}
+
+static void Lyra2RE_BLAKE256_80b(benchmark::State& state)
+{
+    unsigned char in[80] = {0}, out[32];
+    while (state.KeepRunning()) {
+        sph_blake256_context ctx;
+        sph_blake256_init(&ctx);
+        sph_blake256(&ctx, in, sizeof(in));
+        sph_blake256_close(&ctx, out);
+    }
+}
+
+static void Lyra2RE_KECCAK256_32b(benchmark::State& state)
+{
+    unsigned char buf[32] = {0};
+    while (state.KeepRunning()) {
+        sph_keccak256_context ctx;
+        sph_keccak256_init(&ctx);
+        sph_keccak256(&ctx, buf, sizeof(buf));
+        sph_keccak256_close(&ctx, buf);
+    }
+}
+
+static void Lyra2RE_CUBEHASH256_32b(benchmark::State& state)
+{
+    unsigned char buf[32] = {0};
+    while (state.KeepRunning()) {
+        sph_cubehash256_context ctx;
+        sph_cubehash256_init(&ctx);
+        sph_cubehash256(&ctx, buf, sizeof(buf));
+        sph_cubehash256_close(&ctx, buf);
+    }
+}
+
+static void Lyra2RE_SKEIN256_32b(benchmark::State& state)
+{
+    unsigned char buf[32] = {0};
+    while (state.KeepRunning()) {
+        sph_skein256_context ctx;
+        sph_skein256_init(&ctx);
+        sph_skein256(&ctx, buf, sizeof(buf));
+        sph_skein256_close(&ctx, buf);
+    }
+}
+
+static void Lyra2RE_BMW256_32b(benchmark::State& state)
+{
+    unsigned char buf[32] = {0};
+    while (state.KeepRunning()) {
+        sph_bmw256_context ctx;
+        sph_bmw256_init(&ctx);
+        sph_bmw256(&ctx, buf, sizeof(buf));
+        sph_bmw256_close(&ctx, buf);
+    }
+}
+
+static void Lyra2RE_LYRA2_4x4(benchmark::State& state)
+{
+    unsigned char in[32] = {0}, out[32];
+    while (state.KeepRunning()) {
+        LYRA2(out, sizeof(out), in, sizeof(in), in, sizeof(in), 1, 4, 4);
+        ++in[0];
+    }
+}
+
+static void RunVerifyPoWBatch(benchmark::State& state, int worker_threads)
+{
+    const std::vector<CBlockHeader> headers = CreatePoWHeaders(POW_BATCH_SIZE);
+    const Consensus::Params& consensus = Params().GetConsensus();
+
+    boost::thread_group threads;
+    for (int i = 0; i < worker_threads; ++i) {
+        threads.create_thread([i]() { ThreadPoWCheck(i); });
+    }
+    g_parallel_pow_checks = worker_threads > 0;
+    while (state.KeepRunning()) {
+        bool ok = VerifyPoWBatch(Span<const CBlockHeader>(headers.data(), headers.size()), consensus);
+        assert(ok);
+    }
+    g_parallel_pow_checks = false;
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+static void VerifyPoWBatch_1024Headers(benchmark::State& state)
+{
+    RunVerifyPoWBatch(state, 0);
+}
+
+static void VerifyPoWBatch_1024Headers_Parallel(benchmark::State& state)
+{
+    RunVerifyPoWBatch(state, std::max(2, GetNumCores()));
+}
+
+/** Write a chain of headers to an in-memory block tree database. */
+static void WriteBlockTree(CBlockTreeDB& db, const std::vector<CBlockHeader>& headers, uint32_t status)
+{
+    std::vector<uint256> hashes(headers.size());
+    std::vector<CBlockIndex> indexes;
+    std::vector<const CBlockIndex*> blockinfo;
+    indexes.reserve(headers.size());
+    for (size_t i = 0; i < headers.size(); ++i) {
+        hashes[i] = headers[i].GetHash();
+        indexes.emplace_back(headers[i]);
+        indexes[i].phashBlock = &hashes[i];
+        indexes[i].pprev = i > 0 ? &indexes[i - 1] : nullptr;
+        indexes[i].nHeight = i;
+        indexes[i].nStatus = status;
+        blockinfo.push_back(&indexes[i]);
+    }
+    bool ok = db.WriteBatchSync({}, 0, blockinfo);
+    assert(ok);
+}
+
+static void RunLoadBlockIndexGuts(benchmark::State& state, CBlockTreeDB& db, size_t count)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    while (state.KeepRunning()) {
+        std::unordered_map<uint256, std::unique_ptr<CBlockIndex>, BlockHasher> block_index;
+        block_index.reserve(count + 1);
+        bool ok = db.LoadBlockIndexGuts(consensus, [&block_index](const uint256& hash) {
+            if (hash.IsNull()) return static_cast<CBlockIndex*>(nullptr);
+            auto it = block_index.emplace(hash, nullptr).first;
+            if (!it->second) {
+                it->second = MakeUnique<CBlockIndex>();
+                it->second->phashBlock = &it->first;
+            }
+            return it->second.get();
+        });
+        assert(ok);
+        assert(block_index.size() == count);
+    }
+}
+
+// Loading an index whose headers were all verified when they were accepted:
+// the cost of reading and linking 500k entries, without any hashing.
+static void LoadBlockIndexGuts_500kVerifiedHeaders(benchmark::State& state)
+{
+    static const size_t HEADERS = 500000;
+    std::vector<CBlockHeader> headers(HEADERS);
+    uint256 prev;
+    for (size_t i = 0; i < HEADERS; ++i) {
+        headers[i].nVersion = CBlockHeader::CURRENT_VERSION;
+        headers[i].hashPrevBlock = prev;
+        headers[i].nTime = 1500000000 + i;
+        headers[i].nBits = 0x207fffff;
+        headers[i].nNonce = i;
+        prev = headers[i].GetHash();
+    }
+    CBlockTreeDB db(1 << 26, true);
+    WriteBlockTree(db, headers, BLOCK_VALID_TREE | BLOCK_POW_VERIFIED);
+
+    g_pow_load_check = PoWLoadCheck::NONE;
+    RunLoadBlockIndexGuts(state, db, HEADERS);
+    g_pow_load_check = PoWLoadCheck::SAMPLE;
+}
+
+// Loading an index that predates BLOCK_POW_VERIFIED, so every header goes
+// through VerifyPoWBatch().
+static void LoadBlockIndexGuts_10kUnverifiedHeaders(benchmark::State& state)
+{
+    static const size_t HEADERS = 10000;
+    CBlockTreeDB db(1 << 22, true);
+    WriteBlockTree(db, CreatePoWHeaders(HEADERS), BLOCK_VALID_TREE);
+
+    RunLoadBlockIndexGuts(state, db, HEADERS);
+}
+
+BENCHMARK(PoWHash_Header, 50 * 1000);
+BENCHMARK(PoWHash_1024Headers, 100);
+BENCHMARK(Lyra2RE_BLAKE256_80b, 2 * 1000 * 1000);
+BENCHMARK(Lyra2RE_KECCAK256_32b, 2 * 1000 * 1000);
+BENCHMARK(Lyra2RE_CUBEHASH256_32b, 200 * 1000);
+BENCHMARK(Lyra2RE_SKEIN256_32b, 2 * 1000 * 1000);
+BENCHMARK(Lyra2RE_BMW256_32b, 2 * 1000 * 1000);
+BENCHMARK(Lyra2RE_LYRA2_4x4, 200 * 1000);
+BENCHMARK(VerifyPoWBatch_1024Headers, 50);
+BENCHMARK(VerifyPoWBatch_1024Headers_Parallel, 200);
+BENCHMARK(LoadBlockIndexGuts_500kVerifiedHeaders, 1);
+BENCHMARK(LoadBlockIndexGuts_10kUnverifiedHeaders, 10);
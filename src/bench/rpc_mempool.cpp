@@ -37,4 +37,31 @@ static void RpcMempool(benchmark::State& state)
     }
 }
 
+static void MempoolSnapshot(benchmark::State& state)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+
+    // Chains of ten transactions, so that there are links to copy
+    CTransactionRef prev;
+    for (int i = 0; i < 1000; ++i) {
+        CMutableTransaction tx = CMutableTransaction();
+        tx.vin.resize(1);
+        if (i % 10) tx.vin[0].prevout = COutPoint(prev->GetHash(), 0);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = i;
+        prev = MakeTransactionRef(tx);
+        AddTx(prev, /* fee */ i, pool);
+    }
+
+    while (state.KeepRunning()) {
+        // Any change to the entries makes the next snapshot a fresh copy
+        pool.PrioritiseTransaction(prev->GetHash(), 1);
+        (void)pool.GetSnapshot();
+    }
+}
+
 BENCHMARK(RpcMempool, 40);
+BENCHMARK(MempoolSnapshot, 40);
@@ -136,6 +136,10 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    BLOCK_POW_VERIFIED      =   256, //!< header proof of work was checked when the header was first accepted
+
+    BLOCK_ASSUMED_VALID     =   512, //!< not validated by this node: at or below the base of a UTXO snapshot loaded with loadtxoutset
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -231,6 +231,8 @@ public:
             /* nTxCount */ 447242,
             /* dTxRate  */ 0.008720599831574105,
         };
+
+        m_assumeutxo_data = MapAssumeutxo{};
     }
 };
 
@@ -340,6 +342,8 @@ public:
             /* nTxCount */ 17082348,
             /* dTxRate  */ 0.09,
         };
+
+        m_assumeutxo_data = MapAssumeutxo{};
     }
 };
 
@@ -439,6 +443,8 @@ public:
             0
         };
 
+        m_assumeutxo_data = MapAssumeutxo{};
+
         base58Prefixes[PUBKEY_ADDRESS] = std::vector<unsigned char>(1,38);
         base58Prefixes[SCRIPT_ADDRESS] = std::vector<unsigned char>(1,53);
         base58Prefixes[SECRET_KEY] =     std::vector<unsigned char>(1,128);
@@ -472,6 +478,26 @@ void CRegTestParams::UpdateActivationParametersFromArgs(const ArgsManager& args)
         consensus.SegwitHeight = static_cast<int>(height);
     }
 
+    for (const std::string& strAssumeutxo : args.GetArgs("-assumeutxo")) {
+        std::vector<std::string> vParams;
+        boost::split(vParams, strAssumeutxo, boost::is_any_of(":"));
+        if (vParams.size() != 3) {
+            throw std::runtime_error("Assumeutxo parameters malformed, expecting height:hash:nchaintx");
+        }
+        int32_t nHeight, nChainTx;
+        if (!ParseInt32(vParams[0], &nHeight) || nHeight <= 0) {
+            throw std::runtime_error(strprintf("Invalid assumeutxo height (%s)", vParams[0]));
+        }
+        if (!IsHex(vParams[1]) || vParams[1].size() != 64) {
+            throw std::runtime_error(strprintf("Invalid assumeutxo hash (%s)", vParams[1]));
+        }
+        if (!ParseInt32(vParams[2], &nChainTx) || nChainTx <= 0) {
+            throw std::runtime_error(strprintf("Invalid assumeutxo nChainTx (%s)", vParams[2]));
+        }
+        m_assumeutxo_data[nHeight] = AssumeutxoData{uint256S(vParams[1]), static_cast<unsigned int>(nChainTx)};
+        LogPrintf("Setting assumeutxo data for height %d to hash=%s, nChainTx=%d\n", nHeight, vParams[1], nChainTx);
+    }
+
     if (!args.IsArgSet("-vbparams")) return;
 
     for (const std::string& strDeployment : args.GetArgs("-vbparams")) {
@@ -11,6 +11,7 @@
 #include <primitives/block.h>
 #include <protocol.h>
 
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -37,6 +38,20 @@ struct ChainTxData {
     double dTxRate;   //!< estimated number of transactions per second after that timestamp
 };
 
+/**
+ * The UTXO set at a block that a snapshot loaded with loadtxoutset may be
+ * based on. Only regtest has any, set with -assumeutxo, as loading a snapshot
+ * is for testing only.
+ *
+ * See also: CChainParams::Assumeutxo, CChainState::ActivateSnapshot.
+ */
+struct AssumeutxoData {
+    uint256 hash_serialized; //!< hash of the UTXO set as computed by GetUTXOStats()
+    unsigned int nChainTx;   //!< total number of transactions between genesis and that block
+};
+
+typedef std::map<int, AssumeutxoData> MapAssumeutxo;
+
 class CBlockIndex;
 
 /**
@@ -96,6 +111,8 @@ public:
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     const CCheckpointData& Checkpoints() const { return checkpointData; }
     const ChainTxData& TxData() const { return chainTxData; }
+    /** UTXO set hashes by height, that a snapshot must match to be loaded */
+    const MapAssumeutxo& Assumeutxo() const { return m_assumeutxo_data; }
 
     bool IsBech32Prefix(const std::vector<unsigned char> &vchPrefixIn) const;
     bool IsBech32Prefix(const std::vector<unsigned char> &vchPrefixIn, CChainParams::Base58Type &rtype) const;
@@ -127,6 +144,7 @@ protected:
     bool m_is_mockable_chain;
     CCheckpointData checkpointData;
     ChainTxData chainTxData;
+    MapAssumeutxo m_assumeutxo_data;
 
     /** ghostnode params*/
     long nMaxTipAge;
@@ -8,6 +8,9 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -16,6 +19,9 @@
 template <typename T>
 class CCheckQueueControl;
 
+//! Number of per-worker queues a CCheckQueue has; more workers than this share them
+static const unsigned int MAX_CHECKQUEUE_WORKERS = 32;
+
 /**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,100 +31,137 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has a queue of its own, guarded by its own mutex. Added
+  * verifications are dealt out over the worker queues in turn. A worker takes
+  * them from the front of its own queue, and when that is empty steals from the
+  * back of the others, as does the master. The shared mutex is only taken to
+  * sleep and to wake up. Once a verification fails the result is known, and
+  * the remaining ones are dropped without being run.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
-    boost::mutex mutex;
+    //! Verifications waiting to be picked up, mainly by one worker
+    struct WorkerQueue {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
 
-    //! Worker threads block on this when out of work
-    boost::condition_variable condWorker;
+    std::array<WorkerQueue, MAX_CHECKQUEUE_WORKERS> queues;
 
-    //! Master thread blocks on this when out of work
-    boost::condition_variable condMaster;
-
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The number of worker threads that have started (not counting the master).
+    std::atomic<unsigned int> nWorkers{0};
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The worker queue the next batch starts at.
+    std::atomic<unsigned int> nNextQueue{0};
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of verifications in the worker queues.
+    std::atomic<unsigned int> nQueued{0};
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! The number of workers that are (about to go) asleep.
+    std::atomic<unsigned int> nIdle{0};
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo{0};
+
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk{true};
+
+    //! Mutex to sleep and wake up on; the verifications are protected by their queue's mutex
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    unsigned int NumQueues() const
+    {
+        return std::max(1U, std::min(nWorkers.load(), MAX_CHECKQUEUE_WORKERS));
+    }
+
+    /**
+     * Move a batch of verifications to vChecks: from the front of the queue
+     * nOwn, or else from the back of the first other queue that has some.
+     * Returns false if all queues are empty.
+     */
+    bool Take(unsigned int nOwn, std::vector<T>& vChecks)
+    {
+        const unsigned int nQueues = NumQueues();
+        for (unsigned int i = 0; i < nQueues; ++i) {
+            WorkerQueue& q = queues[(nOwn + i) % nQueues];
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            if (q.checks.empty()) continue;
+            // Leave half of them, so that idle workers find something to steal
+            // and all workers finish approximately simultaneously.
+            const size_t nNow = std::max<size_t>(1, std::min<size_t>(nBatchSize, q.checks.size() / 2));
+            vChecks.resize(nNow);
+            for (T& check : vChecks) {
+                // We want the lock on the mutex to be as short as possible, so swap jobs from the
+                // queue to the local batch vector instead of copying.
+                if (i == 0) {
+                    check.swap(q.checks.front());
+                    q.checks.pop_front();
+                } else {
+                    check.swap(q.checks.back());
+                    q.checks.pop_back();
+                }
+            }
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(bool fMaster, unsigned int nOwn)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        fAllOk = true;
-                        // return the current status
-                        return fRet;
+            if (Take(nOwn, vChecks)) {
+                // execute work
+                for (T& check : vChecks) {
+                    if (fAllOk.load(std::memory_order_relaxed) && !check()) {
+                        fAllOk = false;
                     }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                const unsigned int nNow = vChecks.size();
+                vChecks.clear();
+                if ((nTodo -= nNow) == 0 && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster && nTodo == 0) {
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                fAllOk = true;
+                // return the current status
+                return fRet;
+            }
+            // Add() counts new work in nQueued before it looks at nIdle, and
+            // takes the mutex to wake workers up, so it cannot be missed here.
+            if (fMaster) {
+                if (nQueued == 0) condMaster.wait(lock);
+            } else {
+                nIdle++;
+                if (nQueued == 0) condWorker.wait(lock);
+                nIdle--;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
@@ -127,32 +170,44 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        Loop(false, nWorkers++ % MAX_CHECKQUEUE_WORKERS);
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(true, 0);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty()) return;
+
+        const unsigned int nQueues = NumQueues();
+        const unsigned int nFirst = nNextQueue++;
         nTodo += vChecks.size();
+        nQueued += vChecks.size();
+        for (unsigned int i = 0; i < std::min<size_t>(nQueues, vChecks.size()); ++i) {
+            WorkerQueue& q = queues[(nFirst + i) % nQueues];
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            for (size_t k = i; k < vChecks.size(); k += nQueues) {
+                q.checks.emplace_back();
+                q.checks.back().swap(vChecks[k]);
+            }
+        }
+
+        // Only take the mutex if there is a worker to wake up.
+        if (nIdle == 0) return;
+        boost::unique_lock<boost::mutex> lock(mutex);
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -24,6 +24,65 @@
 #include "Lyra2.h"
 #include "Sponge.h"
 
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+//Largest matrix served from the per-thread arena: 8 rows of 8 columns, the parameters of
+//Lyra2RE (Lyra2REv2 uses 4x4). Bigger matrices fall back to the heap.
+#define ARENA_ROWS 8
+#define ARENA_INT64 (ARENA_ROWS * 8 * BLOCK_LEN_INT64)
+
+static THREAD_LOCAL ALIGN uint64_t arenaMatrix[ARENA_INT64];
+static THREAD_LOCAL uint64_t *arenaRows[ARENA_ROWS];
+
+/**
+ * Returns storage for an nRows x (rowLenInt64 words) memory matrix and sets *memMatrix
+ * to an array of pointers to its rows. Matrices that fit in the calling thread's arena
+ * do not touch the heap, so the PoW hash can be computed without allocating.
+ *
+ * @return The whole matrix, or NULL if it could not be allocated
+ */
+static uint64_t *acquireMatrix(uint64_t nRows, int64_t rowLenInt64, uint64_t ***memMatrix) {
+    uint64_t *wholeMatrix;
+    uint64_t **rows;
+    uint64_t i;
+
+    if (nRows <= ARENA_ROWS && nRows * rowLenInt64 <= ARENA_INT64) {
+      wholeMatrix = arenaMatrix;
+      rows = arenaRows;
+    } else {
+      wholeMatrix = malloc(nRows * rowLenInt64 * sizeof (uint64_t));
+      if (wholeMatrix == NULL) {
+        return NULL;
+      }
+      rows = malloc(nRows * sizeof (uint64_t*));
+      if (rows == NULL) {
+        free(wholeMatrix);
+        return NULL;
+      }
+    }
+
+    //Places the pointers in the correct positions
+    for (i = 0; i < nRows; i++) {
+      rows[i] = wholeMatrix + i * rowLenInt64;
+    }
+    *memMatrix = rows;
+    return wholeMatrix;
+}
+
+/**
+ * Releases a matrix obtained from acquireMatrix().
+ */
+static void releaseMatrix(uint64_t *wholeMatrix, uint64_t **memMatrix) {
+    if (wholeMatrix != arenaMatrix) {
+      free(memMatrix);
+      free(wholeMatrix);
+    }
+}
+
 /**
  * Executes Lyra2 based on the G function from Blake2b. This version supports salts and passwords
  * whose combined length is smaller than the size of the memory matrix, (i.e., (nRows x nCols x b) bits,
@@ -64,23 +123,13 @@ int LYRA2(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const void *
     const int64_t ROW_LEN_BYTES = ROW_LEN_INT64 * 8;
 
     i = (int64_t) ((int64_t) nRows * (int64_t) ROW_LEN_BYTES);
-    uint64_t *wholeMatrix = malloc(i);
+    uint64_t **memMatrix;
+    uint64_t *wholeMatrix = acquireMatrix(nRows, ROW_LEN_INT64, &memMatrix);
     if (wholeMatrix == NULL) {
       return -1;
     }
 	memset(wholeMatrix, 0, i);
-
-    //Allocates pointers to each row of the matrix
-    uint64_t **memMatrix = malloc(nRows * sizeof (uint64_t*));
-    if (memMatrix == NULL) {
-      return -1;
-    }
-    //Places the pointers in the correct positions
-    uint64_t *ptrWord = wholeMatrix;
-    for (i = 0; i < nRows; i++) {
-      memMatrix[i] = ptrWord;
-      ptrWord += ROW_LEN_INT64;
-    }
+    uint64_t *ptrWord;
     //==========================================================================/
 
     //============= Getting the password + salt + basil padded with 10*1 ===============//
@@ -123,10 +172,7 @@ int LYRA2(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const void *
 
     //======================= Initializing the Sponge State ====================//
     //Sponge state: 16 uint64_t, BLOCK_LEN_INT64 words of them for the bitrate (b) and the remainder for the capacity (c)
-    uint64_t *state = malloc(16 * sizeof (uint64_t));
-    if (state == NULL) {
-      return -1;
-    }
+    ALIGN uint64_t state[16];
     initState(state);
     //==========================================================================/
 
@@ -201,12 +247,10 @@ int LYRA2(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const void *
     //==========================================================================/
 
     //========================= Freeing the memory =============================//
-    free(memMatrix);
-    free(wholeMatrix);
+    releaseMatrix(wholeMatrix, memMatrix);
 
-    //Wiping out the sponge's internal state before freeing it
+    //Wiping out the sponge's internal state
     memset(state, 0, 16 * sizeof (uint64_t));
-    free(state);
     //==========================================================================/
 
     return 0;
@@ -233,23 +277,13 @@ int LYRA2_old(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const vo
     const int64_t ROW_LEN_BYTES = ROW_LEN_INT64 * 8;
 
     i = (int64_t) ((int64_t) nRows * (int64_t) ROW_LEN_BYTES);
-    uint64_t *wholeMatrix = malloc(i);
+    uint64_t **memMatrix;
+    uint64_t *wholeMatrix = acquireMatrix(nRows, ROW_LEN_INT64, &memMatrix);
     if (wholeMatrix == NULL) {
       return -1;
     }
 	memset(wholeMatrix, 0, i);
-
-    //Allocates pointers to each row of the matrix
-    uint64_t **memMatrix = malloc(nRows * sizeof (uint64_t*));
-    if (memMatrix == NULL) {
-      return -1;
-    }
-    //Places the pointers in the correct positions
-    uint64_t *ptrWord = wholeMatrix;
-    for (i = 0; i < nRows; i++) {
-      memMatrix[i] = ptrWord;
-      ptrWord += ROW_LEN_INT64;
-    }
+    uint64_t *ptrWord;
     //==========================================================================/
 
     //============= Getting the password + salt + basil padded with 10*1 ===============//
@@ -292,10 +326,7 @@ int LYRA2_old(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const vo
 
     //======================= Initializing the Sponge State ====================//
     //Sponge state: 16 uint64_t, BLOCK_LEN_INT64 words of them for the bitrate (b) and the remainder for the capacity (c)
-    uint64_t *state = malloc(16 * sizeof (uint64_t));
-    if (state == NULL) {
-      return -1;
-    }
+    ALIGN uint64_t state[16];
     initState(state);
     //==========================================================================/
 
@@ -370,12 +401,10 @@ int LYRA2_old(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const vo
     //==========================================================================/
 
     //========================= Freeing the memory =============================//
-    free(memMatrix);
-    free(wholeMatrix);
+    releaseMatrix(wholeMatrix, memMatrix);
 
-    //Wiping out the sponge's internal state before freeing it
+    //Wiping out the sponge's internal state
     memset(state, 0, 16 * sizeof (uint64_t));
-    free(state);
     //==========================================================================/
 
     return 0;
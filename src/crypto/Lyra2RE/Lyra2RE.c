@@ -27,7 +27,12 @@
  * online backup system.
  */
 
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
 #include "Lyra2RE.h"
+#include <assert.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -39,6 +44,29 @@
 #include "sph_keccak.h"
 #include "sph_skein.h"
 #include "Lyra2.h"
+#include "Sponge.h"
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+#define LYRA2_USE_SSE41
+#endif
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+#define LYRA2_USE_AVX2
+#endif
+#endif
+
+#if defined(LYRA2_USE_SSE41) || defined(LYRA2_USE_AVX2)
+#include <cpuid.h>
+#endif
+
+#if defined(LYRA2_USE_SSE41)
+/** Lyra2REv2 of 4 consecutive 80-byte inputs (Lyra2RE_sse41.c). */
+void lyra2re2_hash_4way(const char* input, char* output);
+#endif
+#if defined(LYRA2_USE_AVX2)
+/** Lyra2REv2 of 8 consecutive 80-byte inputs (Lyra2RE_avx2.c). */
+void lyra2re2_hash_8way(const char* input, char* output);
+#endif
 
 void lyra2re_hash(const char* input, char* output)
 {
@@ -108,3 +136,94 @@ void lyra2re2_hash(const char* input, char* output)
     
    	memcpy(output, hashA, 32);
 }
+
+/* Multi-way implementations selected by Lyra2AutoDetect(), or NULL if unavailable. */
+static void (*lyra2re2_hash_4way_ptr)(const char* input, char* output) = NULL;
+static void (*lyra2re2_hash_8way_ptr)(const char* input, char* output) = NULL;
+
+void lyra2re2_hashes(const char* input, char* output, size_t n)
+{
+    if (lyra2re2_hash_8way_ptr) {
+        while (n >= 8) {
+            lyra2re2_hash_8way_ptr(input, output);
+            input += 8 * 80;
+            output += 8 * 32;
+            n -= 8;
+        }
+    }
+    if (lyra2re2_hash_4way_ptr) {
+        while (n >= 4) {
+            lyra2re2_hash_4way_ptr(input, output);
+            input += 4 * 80;
+            output += 4 * 32;
+            n -= 4;
+        }
+    }
+    while (n > 0) {
+        lyra2re2_hash(input, output);
+        input += 80;
+        output += 32;
+        n -= 1;
+    }
+}
+
+#if defined(LYRA2_USE_AVX2)
+/** Check whether the OS has enabled AVX registers. */
+static int AVXEnabled(void)
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+/** Check that a multi-way implementation agrees with lyra2re2_hash() on each lane. */
+static int SelfTestMultiWay(void (*hash)(const char* input, char* output), size_t ways)
+{
+    char in[8 * 80], out[8 * 32], expected[32];
+    size_t i;
+    for (i = 0; i < sizeof(in); i++) {
+        in[i] = (char)(i * 7 + i / 80);
+    }
+    hash(in, out);
+    for (i = 0; i < ways; i++) {
+        lyra2re2_hash(in + 80 * i, expected);
+        if (memcmp(out + 32 * i, expected, 32) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const char* Lyra2AutoDetect(void)
+{
+    const char* ret = "standard";
+#if defined(LYRA2_USE_SSE41) || defined(LYRA2_USE_AVX2)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+#if defined(LYRA2_USE_SSE41)
+        if ((ecx >> 19) & 1) {
+            lyra2re2_hash_4way_ptr = lyra2re2_hash_4way;
+            ret = "standard(1way),sse41(4way)";
+        }
+#endif
+#if defined(LYRA2_USE_AVX2)
+        const int have_xsave = (ecx >> 27) & 1;
+        const int have_avx = (ecx >> 28) & 1;
+        if (have_xsave && have_avx && AVXEnabled() && __get_cpuid_max(0, NULL) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            if ((ebx >> 5) & 1) {
+                spongeUseAVX2();
+                lyra2re2_hash_8way_ptr = lyra2re2_hash_8way;
+                ret = lyra2re2_hash_4way_ptr ? "avx2(1way),sse41(4way),avx2(8way)" : "avx2(1way),avx2(8way)";
+            }
+        }
+#endif
+    }
+#endif
+
+    assert(spongeSelfTest());
+    assert(!lyra2re2_hash_4way_ptr || SelfTestMultiWay(lyra2re2_hash_4way_ptr, 4));
+    assert(!lyra2re2_hash_8way_ptr || SelfTestMultiWay(lyra2re2_hash_8way_ptr, 8));
+    return ret;
+}
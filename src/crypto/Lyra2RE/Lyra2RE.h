@@ -1,6 +1,8 @@
 #ifndef LYRA2RE_H
 #define LYRA2RE_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -8,6 +10,14 @@ extern "C" {
 void lyra2re_hash(const char* input, char* output);
 void lyra2re2_hash(const char* input, char* output);
 
+/** Compute lyra2re2_hash() of n consecutive 80-byte inputs into n consecutive 32-byte outputs.
+ *  Uses the multi-way implementations picked by Lyra2AutoDetect() where possible. */
+void lyra2re2_hashes(const char* input, char* output, size_t n);
+
+/** Autodetect the best available LYRA2 sponge and multi-way Lyra2REv2 implementations.
+ *  Returns the name of the implementation. */
+const char* Lyra2AutoDetect(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,63 @@
+/**
+ * 8-way AVX2 implementation of lyra2re2_hash(), see Lyra2RE_nway.h.
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#define LYRA2RE_WAYS 8
+typedef __m256i vec;
+
+static inline vec Add32(vec x, vec y) { return _mm256_add_epi32(x, y); }
+static inline vec Sub32(vec x, vec y) { return _mm256_sub_epi32(x, y); }
+static inline vec Add64(vec x, vec y) { return _mm256_add_epi64(x, y); }
+static inline vec Xor(vec x, vec y) { return _mm256_xor_si256(x, y); }
+static inline vec Or(vec x, vec y) { return _mm256_or_si256(x, y); }
+static inline vec And(vec x, vec y) { return _mm256_and_si256(x, y); }
+static inline vec AndNot(vec x, vec y) { return _mm256_andnot_si256(x, y); }
+static inline vec ShL32(vec x, int n) { return _mm256_slli_epi32(x, n); }
+static inline vec ShR32(vec x, int n) { return _mm256_srli_epi32(x, n); }
+static inline vec ShL64(vec x, int n) { return _mm256_slli_epi64(x, n); }
+static inline vec ShR64(vec x, int n) { return _mm256_srli_epi64(x, n); }
+static inline vec CmpEq64(vec x, vec y) { return _mm256_cmpeq_epi64(x, y); }
+static inline vec Set1_32(uint32_t x) { return _mm256_set1_epi32(x); }
+static inline vec Set1_64(uint64_t x) { return _mm256_set1_epi64x(x); }
+static inline vec LoadWords(const void* p) { return _mm256_loadu_si256((const __m256i*)p); }
+static inline void StoreWords(void* p, vec x) { _mm256_storeu_si256((__m256i*)p, x); }
+
+#include "Lyra2RE_nway.h"
+
+void lyra2re2_hash_8way(const char* input, char* output)
+{
+    unsigned char hashA[LYRA2RE_WAYS * 32], hashB[LYRA2RE_WAYS * 32];
+    int i;
+
+    Blake256_80(hashA, (const unsigned char*)input);
+    for (i = 0; i < LYRA2RE_WAYS; i += LYRA2RE_HALF) {
+        Keccak256_32(hashB + 32 * i, hashA + 32 * i);
+    }
+    CubeHash256_32(hashA, hashB);
+    for (i = 0; i < LYRA2RE_WAYS; i += LYRA2RE_HALF) {
+        Lyra2_32(hashB + 32 * i, hashA + 32 * i);
+        Skein256_32(hashA + 32 * i, hashB + 32 * i);
+    }
+    CubeHash256_32(hashB, hashA);
+    Bmw256_32((unsigned char*)output, hashB);
+}
+
+#endif
@@ -0,0 +1,691 @@
+/**
+ * Building blocks of the multi-way Lyra2REv2 hash: BLAKE-256, Keccak-256,
+ * CubeHash-256, Lyra2, Skein-512-256 and BMW-256, restricted to the input
+ * lengths used by lyra2re2_hash() and computed for several independent
+ * inputs at once.
+ *
+ * This file is included by Lyra2RE_sse41.c and Lyra2RE_avx2.c, which first
+ * define LYRA2RE_WAYS, a vector type "vec" holding one 32-bit word of each
+ * of the LYRA2RE_WAYS inputs (or one 64-bit word of half of them), and the
+ * primitive operations listed below. The 32-bit functions process all
+ * LYRA2RE_WAYS inputs; the 64-bit ones (Keccak, Lyra2, Skein) process
+ * LYRA2RE_WAYS / 2 of them and are called twice.
+ *
+ * Inputs and outputs are the concatenated per-input messages and digests,
+ * in the same byte order as the scalar sph_* functions use.
+ *
+ * Required: Add32, Sub32, Add64, Xor, Or, And, AndNot (~x & y), ShL32, ShR32,
+ * ShL64, ShR64, CmpEq64, Set1_32, Set1_64, LoadWords and StoreWords.
+ */
+#ifndef LYRA2RE_NWAY_H_
+#define LYRA2RE_NWAY_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "Lyra2.h"
+#include "Sponge.h"
+#include "sph_types.h"
+
+#define LYRA2RE_HALF (LYRA2RE_WAYS / 2)
+
+static inline vec RotL32(vec x, int n) { return Or(ShL32(x, n), ShR32(x, 32 - n)); }
+static inline vec RotR32(vec x, int n) { return Or(ShR32(x, n), ShL32(x, 32 - n)); }
+static inline vec RotL64(vec x, int n) { return Or(ShL64(x, n), ShR64(x, 64 - n)); }
+static inline vec RotR64(vec x, int n) { return Or(ShR64(x, n), ShL64(x, 64 - n)); }
+
+/** Word at offset "in" of each of the LYRA2RE_WAYS inputs, which are "stride" bytes apart. */
+static inline vec Read32LE(const unsigned char* in, size_t stride)
+{
+    uint32_t w[LYRA2RE_WAYS];
+    int i;
+    for (i = 0; i < LYRA2RE_WAYS; i++) {
+        w[i] = sph_dec32le(in + i * stride);
+    }
+    return LoadWords(w);
+}
+
+static inline vec Read32BE(const unsigned char* in, size_t stride)
+{
+    uint32_t w[LYRA2RE_WAYS];
+    int i;
+    for (i = 0; i < LYRA2RE_WAYS; i++) {
+        w[i] = sph_dec32be(in + i * stride);
+    }
+    return LoadWords(w);
+}
+
+static inline vec Read64LE(const unsigned char* in, size_t stride)
+{
+    uint64_t w[LYRA2RE_HALF];
+    int i;
+    for (i = 0; i < LYRA2RE_HALF; i++) {
+        w[i] = sph_dec64le(in + i * stride);
+    }
+    return LoadWords(w);
+}
+
+static inline void Write32LE(unsigned char* out, size_t stride, vec v)
+{
+    uint32_t w[LYRA2RE_WAYS];
+    int i;
+    StoreWords(w, v);
+    for (i = 0; i < LYRA2RE_WAYS; i++) {
+        sph_enc32le(out + i * stride, w[i]);
+    }
+}
+
+static inline void Write32BE(unsigned char* out, size_t stride, vec v)
+{
+    uint32_t w[LYRA2RE_WAYS];
+    int i;
+    StoreWords(w, v);
+    for (i = 0; i < LYRA2RE_WAYS; i++) {
+        sph_enc32be(out + i * stride, w[i]);
+    }
+}
+
+static inline void Write64LE(unsigned char* out, size_t stride, vec v)
+{
+    uint64_t w[LYRA2RE_HALF];
+    int i;
+    StoreWords(w, v);
+    for (i = 0; i < LYRA2RE_HALF; i++) {
+        sph_enc64le(out + i * stride, w[i]);
+    }
+}
+
+//============================== BLAKE-256 ===================================//
+
+static const uint32_t blake256_IV[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+static const uint32_t blake256_CS[16] = {
+    0x243F6A88, 0x85A308D3, 0x13198A2E, 0x03707344,
+    0xA4093822, 0x299F31D0, 0x082EFA98, 0xEC4E6C89,
+    0x452821E6, 0x38D01377, 0xBE5466CF, 0x34E90C6C,
+    0xC0AC29B7, 0xC97C50DD, 0x3F84D5B5, 0xB5470917
+};
+
+static const unsigned char blake256_sigma[10][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 }
+};
+
+#define BLAKE256_G(a, b, c, d, i) do { \
+    a = Add32(Add32(a, b), Xor(m[s[i]], Set1_32(blake256_CS[s[(i) + 1]]))); \
+    d = RotR32(Xor(d, a), 16); \
+    c = Add32(c, d); \
+    b = RotR32(Xor(b, c), 12); \
+    a = Add32(Add32(a, b), Xor(m[s[(i) + 1]], Set1_32(blake256_CS[s[i]]))); \
+    d = RotR32(Xor(d, a), 8); \
+    c = Add32(c, d); \
+    b = RotR32(Xor(b, c), 7); \
+  } while (0)
+
+/** BLAKE-256 compression with a zero salt and a message bit counter below 2^32. */
+static void Blake256Compress(vec h[8], const vec m[16], uint32_t t0)
+{
+    vec v[16];
+    int r, i;
+
+    for (i = 0; i < 8; i++) {
+        v[i] = h[i];
+        v[i + 8] = Set1_32(blake256_CS[i]);
+    }
+    v[12] = Set1_32(t0 ^ blake256_CS[4]);
+    v[13] = Set1_32(t0 ^ blake256_CS[5]);
+
+    for (r = 0; r < 14; r++) {
+        const unsigned char* s = blake256_sigma[r % 10];
+        BLAKE256_G(v[0], v[4], v[ 8], v[12],  0);
+        BLAKE256_G(v[1], v[5], v[ 9], v[13],  2);
+        BLAKE256_G(v[2], v[6], v[10], v[14],  4);
+        BLAKE256_G(v[3], v[7], v[11], v[15],  6);
+        BLAKE256_G(v[0], v[5], v[10], v[15],  8);
+        BLAKE256_G(v[1], v[6], v[11], v[12], 10);
+        BLAKE256_G(v[2], v[7], v[ 8], v[13], 12);
+        BLAKE256_G(v[3], v[4], v[ 9], v[14], 14);
+    }
+
+    for (i = 0; i < 8; i++) {
+        h[i] = Xor(h[i], Xor(v[i], v[i + 8]));
+    }
+}
+
+/** BLAKE-256 of LYRA2RE_WAYS 80-byte inputs. */
+static void Blake256_80(unsigned char* out, const unsigned char* in)
+{
+    vec h[8], m[16];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        h[i] = Set1_32(blake256_IV[i]);
+    }
+    for (i = 0; i < 16; i++) {
+        m[i] = Read32BE(in + 4 * i, 80);
+    }
+    Blake256Compress(h, m, 512);
+
+    //Last 16 bytes, then padding with the final bit and the 640-bit length
+    for (i = 0; i < 4; i++) {
+        m[i] = Read32BE(in + 64 + 4 * i, 80);
+    }
+    m[4] = Set1_32(0x80000000);
+    for (i = 5; i < 16; i++) {
+        m[i] = Set1_32(0);
+    }
+    m[13] = Set1_32(1);
+    m[15] = Set1_32(640);
+    Blake256Compress(h, m, 640);
+
+    for (i = 0; i < 8; i++) {
+        Write32BE(out + 4 * i, 32, h[i]);
+    }
+}
+
+//============================== Keccak-256 ==================================//
+
+static const uint64_t keccak_RC[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808AULL, 0x8000000080008000ULL,
+    0x000000000000808BULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008AULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000AULL,
+    0x000000008000808BULL, 0x800000000000008BULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800AULL, 0x800000008000000AULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+//Rotation of lane x + 5y (rho), and where it ends up (pi)
+static const unsigned char keccak_rho[25] = {
+     0,  1, 62, 28, 27, 36, 44,  6, 55, 20,  3, 10, 43, 25, 39, 41, 45, 15, 21,  8, 18,  2, 61, 56, 14
+};
+static const unsigned char keccak_pi[25] = {
+     0, 10, 20,  5, 15, 16,  1, 11, 21,  6,  7, 17,  2, 12, 22, 23,  8, 18,  3, 13, 14, 24,  9, 19,  4
+};
+
+static void KeccakF1600(vec a[25])
+{
+    vec b[25], c[5], d;
+    int r, x, y, i;
+
+    for (r = 0; r < 24; r++) {
+        //Theta
+        for (x = 0; x < 5; x++) {
+            c[x] = Xor(Xor(Xor(a[x], a[x + 5]), Xor(a[x + 10], a[x + 15])), a[x + 20]);
+        }
+        for (x = 0; x < 5; x++) {
+            d = Xor(c[(x + 4) % 5], RotL64(c[(x + 1) % 5], 1));
+            for (y = 0; y < 25; y += 5) {
+                a[y + x] = Xor(a[y + x], d);
+            }
+        }
+        //Rho and pi
+        b[0] = a[0];
+        for (i = 1; i < 25; i++) {
+            b[keccak_pi[i]] = RotL64(a[i], keccak_rho[i]);
+        }
+        //Chi
+        for (y = 0; y < 25; y += 5) {
+            for (x = 0; x < 5; x++) {
+                a[y + x] = Xor(b[y + x], AndNot(b[y + (x + 1) % 5], b[y + (x + 2) % 5]));
+            }
+        }
+        //Iota
+        a[0] = Xor(a[0], Set1_64(keccak_RC[r]));
+    }
+}
+
+/** Keccak-256 (original padding) of LYRA2RE_HALF 32-byte inputs. */
+static void Keccak256_32(unsigned char* out, const unsigned char* in)
+{
+    vec a[25];
+    int i;
+
+    for (i = 0; i < 25; i++) {
+        a[i] = Set1_64(0);
+    }
+    for (i = 0; i < 4; i++) {
+        a[i] = Read64LE(in + 8 * i, 32);
+    }
+    a[4] = Set1_64(0x01);
+    a[16] = Set1_64(0x8000000000000000ULL);
+    KeccakF1600(a);
+
+    for (i = 0; i < 4; i++) {
+        Write64LE(out + 8 * i, 32, a[i]);
+    }
+}
+
+//============================= CubeHash-256 =================================//
+
+//State after absorbing the CubeHash16/32-256 parameters
+static const uint32_t cubehash256_IV[32] = {
+    0xEA2BD4B4, 0xCCD6F29F, 0x63117E71, 0x35481EAE, 0x22512D5B, 0xE5D94E63, 0x7E624131, 0xF4CC12BE,
+    0xC2D0B696, 0x42AF2070, 0xD0720C35, 0x3361DA8C, 0x28CCECA4, 0x8EF8AD83, 0x4680AC00, 0x40E5FBAB,
+    0xD89041C3, 0x6107FBD5, 0x6C859D41, 0xF0B26679, 0x09392549, 0x5FA25603, 0x65C892FD, 0x93CB6285,
+    0x2AF2B5AE, 0x9E4B4E60, 0x774ABFDD, 0x85254725, 0x15815AEB, 0x4AB6AAD6, 0x9CDAF8AF, 0xD6032C0A
+};
+
+#define CUBEHASH_SWAP(i, j) do { vec t = x[i]; x[i] = x[j]; x[j] = t; } while (0)
+
+static void CubeHashRounds(vec x[32], int rounds)
+{
+    int r, i;
+
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < 16; i++) {
+            x[i + 16] = Add32(x[i + 16], x[i]);
+            x[i] = RotL32(x[i], 7);
+        }
+        for (i = 0; i < 8; i++) {
+            CUBEHASH_SWAP(i, i + 8);
+        }
+        for (i = 0; i < 16; i++) {
+            x[i] = Xor(x[i], x[i + 16]);
+        }
+        for (i = 16; i < 32; i++) {
+            if (!(i & 2)) CUBEHASH_SWAP(i, i + 2);
+        }
+        for (i = 0; i < 16; i++) {
+            x[i + 16] = Add32(x[i + 16], x[i]);
+            x[i] = RotL32(x[i], 11);
+        }
+        for (i = 0; i < 16; i++) {
+            if (!(i & 4)) CUBEHASH_SWAP(i, i + 4);
+        }
+        for (i = 0; i < 16; i++) {
+            x[i] = Xor(x[i], x[i + 16]);
+        }
+        for (i = 16; i < 32; i += 2) {
+            CUBEHASH_SWAP(i, i + 1);
+        }
+    }
+}
+
+/** CubeHash16/32-256 of LYRA2RE_WAYS 32-byte inputs. */
+static void CubeHash256_32(unsigned char* out, const unsigned char* in)
+{
+    vec x[32];
+    int i;
+
+    for (i = 0; i < 32; i++) {
+        x[i] = Set1_32(cubehash256_IV[i]);
+    }
+    for (i = 0; i < 8; i++) {
+        x[i] = Xor(x[i], Read32LE(in + 4 * i, 32));
+    }
+    CubeHashRounds(x, 16);
+    x[0] = Xor(x[0], Set1_32(0x80));
+    CubeHashRounds(x, 16);
+    x[31] = Xor(x[31], Set1_32(1));
+    CubeHashRounds(x, 10 * 16);
+
+    for (i = 0; i < 8; i++) {
+        Write32LE(out + 4 * i, 32, x[i]);
+    }
+}
+
+//================================= Lyra2 ====================================//
+
+static void Blake2bLyraRounds(vec v[16], int rounds)
+{
+#define LYRA2_G(a, b, c, d) do { \
+    a = Add64(a, b); \
+    d = RotR64(Xor(d, a), 32); \
+    c = Add64(c, d); \
+    b = RotR64(Xor(b, c), 24); \
+    a = Add64(a, b); \
+    d = RotR64(Xor(d, a), 16); \
+    c = Add64(c, d); \
+    b = RotR64(Xor(b, c), 63); \
+  } while (0)
+
+    int r;
+    for (r = 0; r < rounds; r++) {
+        LYRA2_G(v[0], v[4], v[ 8], v[12]);
+        LYRA2_G(v[1], v[5], v[ 9], v[13]);
+        LYRA2_G(v[2], v[6], v[10], v[14]);
+        LYRA2_G(v[3], v[7], v[11], v[15]);
+        LYRA2_G(v[0], v[5], v[10], v[15]);
+        LYRA2_G(v[1], v[6], v[11], v[12]);
+        LYRA2_G(v[2], v[7], v[ 8], v[13]);
+        LYRA2_G(v[3], v[4], v[ 9], v[14]);
+    }
+#undef LYRA2_G
+}
+
+/** Word w of column col of row* in each lane, where row* is given by the per-lane masks. */
+static inline vec Lyra2SelectRow(vec M[4][4][BLOCK_LEN_INT64], const vec mask[4], int col, int w)
+{
+    return Or(Or(And(mask[0], M[0][col][w]), And(mask[1], M[1][col][w])),
+              Or(And(mask[2], M[2][col][w]), And(mask[3], M[3][col][w])));
+}
+
+/**
+ * LYRA2(K, 32, in, 32, in, 32, 1, 4, 4) of LYRA2RE_HALF 32-byte inputs, as used by
+ * Lyra2REv2. This follows LYRA2() with its loops unrolled for these parameters. The
+ * rows visited during the Wandering phase depend on each input, so M[row*] is
+ * accessed through per-lane masks instead of pointers.
+ */
+static void Lyra2_32(unsigned char* out, const unsigned char* in)
+{
+    vec M[4][4][BLOCK_LEN_INT64];
+    vec state[16], pwd[4], mask[4];
+    int prev, row, rowa, col, w, r;
+
+    //Sponge state: zeros followed by Blake2b's IV
+    for (w = 0; w < 8; w++) {
+        state[w] = Set1_64(0);
+        state[w + 8] = Set1_64(blake2b_IV[w]);
+    }
+
+    //Absorbing pwd || salt (both the input here) || basil, padded with 10*1
+    for (w = 0; w < 4; w++) {
+        pwd[w] = Read64LE(in + 8 * w, 32);
+        state[w] = Xor(state[w], pwd[w]);
+        state[w + 4] = Xor(state[w + 4], pwd[w]);
+    }
+    Blake2bLyraRounds(state, 12);
+    state[0] = Xor(state[0], Set1_64(32)); //kLen
+    state[1] = Xor(state[1], Set1_64(32)); //pwdlen
+    state[2] = Xor(state[2], Set1_64(32)); //saltlen
+    state[3] = Xor(state[3], Set1_64(1));  //timeCost
+    state[4] = Xor(state[4], Set1_64(4));  //nRows
+    state[5] = Xor(state[5], Set1_64(4));  //nCols
+    state[6] = Xor(state[6], Set1_64(0x80));
+    state[7] = Xor(state[7], Set1_64(0x0100000000000000ULL));
+    Blake2bLyraRounds(state, 12);
+
+    //M[0][C-1-col] = H.reduced_squeeze()
+    for (col = 3; col >= 0; col--) {
+        for (w = 0; w < BLOCK_LEN_INT64; w++) {
+            M[0][col][w] = state[w];
+        }
+        Blake2bLyraRounds(state, 1);
+    }
+
+    //M[1][C-1-col] = M[0][col] XOR rand
+    for (col = 0; col < 4; col++) {
+        for (w = 0; w < BLOCK_LEN_INT64; w++) {
+            state[w] = Xor(state[w], M[0][col][w]);
+        }
+        Blake2bLyraRounds(state, 1);
+        for (w = 0; w < BLOCK_LEN_INT64; w++) {
+            M[1][3 - col][w] = Xor(M[0][col][w], state[w]);
+        }
+    }
+
+    //Setup phase: rows 2 and 3, with row* = 0 and then 1
+    for (row = 2; row < 4; row++) {
+        prev = row - 1;
+        rowa = row - 2;
+        for (col = 0; col < 4; col++) {
+            for (w = 0; w < BLOCK_LEN_INT64; w++) {
+                state[w] = Xor(state[w], Add64(M[prev][col][w], M[rowa][col][w]));
+            }
+            Blake2bLyraRounds(state, 1);
+            for (w = 0; w < BLOCK_LEN_INT64; w++) {
+                M[row][3 - col][w] = Xor(M[prev][col][w], state[w]);
+            }
+            for (w = 0; w < BLOCK_LEN_INT64; w++) {
+                M[rowa][col][w] = Xor(M[rowa][col][w], state[(w + BLOCK_LEN_INT64 - 1) % BLOCK_LEN_INT64]);
+            }
+        }
+    }
+
+    //Wandering phase: a single pass over rows 0, 1, 2, 3
+    for (row = 0; row < 4; row++) {
+        prev = (row + 3) % 4;
+        //row* = state[0] % nRows, selected independently in each lane
+        for (r = 0; r < 4; r++) {
+            mask[r] = CmpEq64(And(state[0], Set1_64(3)), Set1_64(r));
+        }
+        for (col = 0; col < 4; col++) {
+            for (w = 0; w < BLOCK_LEN_INT64; w++) {
+                state[w] = Xor(state[w], Add64(M[prev][col][w], Lyra2SelectRow(M, mask, col, w)));
+            }
+            Blake2bLyraRounds(state, 1);
+            for (w = 0; w < BLOCK_LEN_INT64; w++) {
+                M[row][col][w] = Xor(M[row][col][w], state[w]);
+            }
+            //M[row*][col] ^= rotW(rand), after the update above if row* == row
+            for (r = 0; r < 4; r++) {
+                for (w = 0; w < BLOCK_LEN_INT64; w++) {
+                    M[r][col][w] = Xor(M[r][col][w], And(mask[r], state[(w + BLOCK_LEN_INT64 - 1) % BLOCK_LEN_INT64]));
+                }
+            }
+        }
+    }
+
+    //Wrap-up phase: absorb M[row*][0] and squeeze the key
+    for (w = 0; w < BLOCK_LEN_INT64; w++) {
+        state[w] = Xor(state[w], Lyra2SelectRow(M, mask, 0, w));
+    }
+    Blake2bLyraRounds(state, 12);
+
+    for (w = 0; w < 4; w++) {
+        Write64LE(out + 8 * w, 32, state[w]);
+    }
+}
+
+//============================= Skein-512-256 ================================//
+
+static const uint64_t skein512_256_IV[8] = {
+    0xCCD044A12FDB3E13ULL, 0xE83590301A79A9EBULL, 0x55AEA0614F816E6FULL, 0x2A2767A4AE9B94DBULL,
+    0xEC06025E74DD7683ULL, 0xE7A436CDC4746251ULL, 0xC36FBAF9393AD185ULL, 0x3EEDBA1833EDFC13ULL
+};
+
+#define SKEIN_MIX(a, b, rc) do { a = Add64(a, b); b = Xor(RotL64(b, rc), a); } while (0)
+
+#define SKEIN_MIX8(a0, b0, a1, b1, a2, b2, a3, b3, rc0, rc1, rc2, rc3) do { \
+    SKEIN_MIX(p[a0], p[b0], rc0); \
+    SKEIN_MIX(p[a1], p[b1], rc1); \
+    SKEIN_MIX(p[a2], p[b2], rc2); \
+    SKEIN_MIX(p[a3], p[b3], rc3); \
+  } while (0)
+
+/** One UBI block: h = m XOR Threefish-512(key h, tweak t0 || t1, m). */
+static void SkeinUbi512(vec h[8], const vec m[8], uint64_t t0, uint64_t t1)
+{
+    const uint64_t t[3] = { t0, t1, t0 ^ t1 };
+    vec k[9], p[8];
+    int s, i;
+
+    k[8] = Set1_64(0x1BD11BDAA9FC1A22ULL);
+    for (i = 0; i < 8; i++) {
+        k[i] = h[i];
+        k[8] = Xor(k[8], h[i]);
+        p[i] = m[i];
+    }
+
+    for (s = 0; s <= 18; s++) {
+        //Subkey injection
+        for (i = 0; i < 8; i++) {
+            p[i] = Add64(p[i], k[(s + i) % 9]);
+        }
+        p[5] = Add64(p[5], Set1_64(t[s % 3]));
+        p[6] = Add64(p[6], Set1_64(t[(s + 1) % 3]));
+        p[7] = Add64(p[7], Set1_64(s));
+        if (s == 18) break;
+
+        //Four rounds
+        if (s % 2 == 0) {
+            SKEIN_MIX8(0, 1, 2, 3, 4, 5, 6, 7, 46, 36, 19, 37);
+            SKEIN_MIX8(2, 1, 4, 7, 6, 5, 0, 3, 33, 27, 14, 42);
+            SKEIN_MIX8(4, 1, 6, 3, 0, 5, 2, 7, 17, 49, 36, 39);
+            SKEIN_MIX8(6, 1, 0, 7, 2, 5, 4, 3, 44,  9, 54, 56);
+        } else {
+            SKEIN_MIX8(0, 1, 2, 3, 4, 5, 6, 7, 39, 30, 34, 24);
+            SKEIN_MIX8(2, 1, 4, 7, 6, 5, 0, 3, 13, 50, 10, 17);
+            SKEIN_MIX8(4, 1, 6, 3, 0, 5, 2, 7, 25, 29, 39, 43);
+            SKEIN_MIX8(6, 1, 0, 7, 2, 5, 4, 3,  8, 35, 56, 22);
+        }
+    }
+
+    for (i = 0; i < 8; i++) {
+        h[i] = Xor(m[i], p[i]);
+    }
+}
+
+/** Skein-512-256 of LYRA2RE_HALF 32-byte inputs. */
+static void Skein256_32(unsigned char* out, const unsigned char* in)
+{
+    vec h[8], m[8];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        h[i] = Set1_64(skein512_256_IV[i]);
+        m[i] = Set1_64(0);
+    }
+    for (i = 0; i < 4; i++) {
+        m[i] = Read64LE(in + 8 * i, 32);
+    }
+    //Message block: first and final, 32 bytes
+    SkeinUbi512(h, m, 32, (uint64_t)(96 + 128 + 256) << 55);
+    //Output block: counter 0
+    for (i = 0; i < 4; i++) {
+        m[i] = Set1_64(0);
+    }
+    SkeinUbi512(h, m, 8, (uint64_t)510 << 55);
+
+    for (i = 0; i < 4; i++) {
+        Write64LE(out + 8 * i, 32, h[i]);
+    }
+}
+
+//================================ BMW-256 ===================================//
+
+static const uint32_t bmw256_IV[16] = {
+    0x40414243, 0x44454647, 0x48494A4B, 0x4C4D4E4F, 0x50515253, 0x54555657, 0x58595A5B, 0x5C5D5E5F,
+    0x60616263, 0x64656667, 0x68696A6B, 0x6C6D6E6F, 0x70717273, 0x74757677, 0x78797A7B, 0x7C7D7E7F
+};
+
+static const uint32_t bmw256_final[16] = {
+    0xaaaaaaa0, 0xaaaaaaa1, 0xaaaaaaa2, 0xaaaaaaa3, 0xaaaaaaa4, 0xaaaaaaa5, 0xaaaaaaa6, 0xaaaaaaa7,
+    0xaaaaaaa8, 0xaaaaaaa9, 0xaaaaaaaa, 0xaaaaaaab, 0xaaaaaaac, 0xaaaaaaad, 0xaaaaaaae, 0xaaaaaaaf
+};
+
+static inline vec BmwS(vec x, int i)
+{
+    switch (i) {
+    case 0: return Xor(Xor(ShR32(x, 1), ShL32(x, 3)), Xor(RotL32(x, 4), RotL32(x, 19)));
+    case 1: return Xor(Xor(ShR32(x, 1), ShL32(x, 2)), Xor(RotL32(x, 8), RotL32(x, 23)));
+    case 2: return Xor(Xor(ShR32(x, 2), ShL32(x, 1)), Xor(RotL32(x, 12), RotL32(x, 25)));
+    case 3: return Xor(Xor(ShR32(x, 2), ShL32(x, 2)), Xor(RotL32(x, 15), RotL32(x, 29)));
+    case 4: return Xor(ShR32(x, 1), x);
+    default: return Xor(ShR32(x, 2), x);
+    }
+}
+
+/** BMW-256 compression function: dh = f(m, h). */
+static void Bmw256Compress(vec dh[16], const vec m[16], const vec h[16])
+{
+    static const unsigned char rs[7] = { 3, 7, 13, 16, 19, 23, 27 };
+    vec t[16], q[32], xl, xh;
+    int i, j;
+
+    for (i = 0; i < 16; i++) {
+        t[i] = Xor(m[i], h[i]);
+    }
+
+    //f0
+    q[ 0] = Add32(Add32(Sub32(t[ 5], t[ 7]), Add32(t[10], t[13])), t[14]);
+    q[ 1] = Sub32(Add32(Sub32(t[ 6], t[ 8]), Add32(t[11], t[14])), t[15]);
+    q[ 2] = Add32(Sub32(Add32(t[ 0], t[ 7]), Sub32(t[12], t[ 9])), t[15]);
+    q[ 3] = Add32(Sub32(Sub32(t[ 0], t[ 1]), Sub32(t[10], t[ 8])), t[13]);
+    q[ 4] = Sub32(Sub32(Add32(t[ 1], t[ 2]), Sub32(t[11], t[ 9])), t[14]);
+    q[ 5] = Add32(Sub32(Sub32(t[ 3], t[ 2]), Sub32(t[12], t[10])), t[15]);
+    q[ 6] = Add32(Sub32(Sub32(t[ 4], t[ 0]), Add32(t[ 3], t[11])), t[13]);
+    q[ 7] = Sub32(Sub32(Sub32(t[ 1], t[ 4]), Add32(t[ 5], t[12])), t[14]);
+    q[ 8] = Sub32(Sub32(Sub32(t[ 2], t[ 5]), Sub32(t[ 6], t[13])), t[15]);
+    q[ 9] = Add32(Sub32(Sub32(t[ 0], t[ 3]), Sub32(t[ 7], t[ 6])), t[14]);
+    q[10] = Add32(Sub32(Sub32(t[ 8], t[ 1]), Add32(t[ 4], t[ 7])), t[15]);
+    q[11] = Add32(Sub32(Sub32(t[ 8], t[ 0]), Add32(t[ 2], t[ 5])), t[ 9]);
+    q[12] = Add32(Sub32(Add32(t[ 1], t[ 3]), Add32(t[ 6], t[ 9])), t[10]);
+    q[13] = Add32(Add32(Add32(t[ 2], t[ 4]), Add32(t[ 7], t[10])), t[11]);
+    q[14] = Sub32(Sub32(Sub32(t[ 3], t[ 5]), Sub32(t[11], t[ 8])), t[12]);
+    q[15] = Add32(Sub32(Sub32(t[12], t[ 4]), Add32(t[ 6], t[ 9])), t[13]);
+    for (i = 0; i < 16; i++) {
+        q[i] = Add32(BmwS(q[i], i % 5), h[(i + 1) % 16]);
+    }
+
+    //f1: two rounds of expand1, then expand2
+    for (i = 16; i < 32; i++) {
+        j = i - 16;
+        vec e = Xor(Add32(Sub32(Add32(RotL32(m[j], j + 1),
+                                      RotL32(m[(j + 3) % 16], (j + 3) % 16 + 1)),
+                                RotL32(m[(j + 10) % 16], (j + 10) % 16 + 1)),
+                          Set1_32((uint32_t)i * 0x05555555)),
+                    h[(j + 7) % 16]);
+        if (i < 18) {
+            for (j = 0; j < 16; j++) {
+                e = Add32(e, BmwS(q[i - 16 + j], (j + 1) % 4));
+            }
+        } else {
+            for (j = 0; j < 14; j++) {
+                e = Add32(e, j % 2 ? RotL32(q[i - 16 + j], rs[j / 2]) : q[i - 16 + j]);
+            }
+            e = Add32(e, Add32(BmwS(q[i - 2], 4), BmwS(q[i - 1], 5)));
+        }
+        q[i] = e;
+    }
+
+    //f2
+    xl = Xor(Xor(Xor(q[16], q[17]), Xor(q[18], q[19])), Xor(Xor(q[20], q[21]), Xor(q[22], q[23])));
+    xh = Xor(Xor(Xor(xl, q[24]), Xor(q[25], q[26])), Xor(Xor(q[27], q[28]), Xor(Xor(q[29], q[30]), q[31])));
+    dh[ 0] = Add32(Xor(Xor(ShL32(xh,  5), ShR32(q[16],  5)), m[ 0]), Xor(Xor(xl, q[24]), q[ 0]));
+    dh[ 1] = Add32(Xor(Xor(ShR32(xh,  7), ShL32(q[17],  8)), m[ 1]), Xor(Xor(xl, q[25]), q[ 1]));
+    dh[ 2] = Add32(Xor(Xor(ShR32(xh,  5), ShL32(q[18],  5)), m[ 2]), Xor(Xor(xl, q[26]), q[ 2]));
+    dh[ 3] = Add32(Xor(Xor(ShR32(xh,  1), ShL32(q[19],  5)), m[ 3]), Xor(Xor(xl, q[27]), q[ 3]));
+    dh[ 4] = Add32(Xor(Xor(ShR32(xh,  3), q[20]), m[ 4]), Xor(Xor(xl, q[28]), q[ 4]));
+    dh[ 5] = Add32(Xor(Xor(ShL32(xh,  6), ShR32(q[21],  6)), m[ 5]), Xor(Xor(xl, q[29]), q[ 5]));
+    dh[ 6] = Add32(Xor(Xor(ShR32(xh,  4), ShL32(q[22],  6)), m[ 6]), Xor(Xor(xl, q[30]), q[ 6]));
+    dh[ 7] = Add32(Xor(Xor(ShR32(xh, 11), ShL32(q[23],  2)), m[ 7]), Xor(Xor(xl, q[31]), q[ 7]));
+    dh[ 8] = Add32(Add32(RotL32(dh[4],  9), Xor(Xor(xh, q[24]), m[ 8])), Xor(Xor(ShL32(xl, 8), q[23]), q[ 8]));
+    dh[ 9] = Add32(Add32(RotL32(dh[5], 10), Xor(Xor(xh, q[25]), m[ 9])), Xor(Xor(ShR32(xl, 6), q[16]), q[ 9]));
+    dh[10] = Add32(Add32(RotL32(dh[6], 11), Xor(Xor(xh, q[26]), m[10])), Xor(Xor(ShL32(xl, 6), q[17]), q[10]));
+    dh[11] = Add32(Add32(RotL32(dh[7], 12), Xor(Xor(xh, q[27]), m[11])), Xor(Xor(ShL32(xl, 4), q[18]), q[11]));
+    dh[12] = Add32(Add32(RotL32(dh[0], 13), Xor(Xor(xh, q[28]), m[12])), Xor(Xor(ShR32(xl, 3), q[19]), q[12]));
+    dh[13] = Add32(Add32(RotL32(dh[1], 14), Xor(Xor(xh, q[29]), m[13])), Xor(Xor(ShR32(xl, 4), q[20]), q[13]));
+    dh[14] = Add32(Add32(RotL32(dh[2], 15), Xor(Xor(xh, q[30]), m[14])), Xor(Xor(ShR32(xl, 7), q[21]), q[14]));
+    dh[15] = Add32(Add32(RotL32(dh[3], 16), Xor(Xor(xh, q[31]), m[15])), Xor(Xor(ShR32(xl, 2), q[22]), q[15]));
+}
+
+/** BMW-256 of LYRA2RE_WAYS 32-byte inputs. */
+static void Bmw256_32(unsigned char* out, const unsigned char* in)
+{
+    vec h[16], m[16], h2[16], h1[16];
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        h[i] = Set1_32(bmw256_IV[i]);
+        m[i] = Set1_32(0);
+    }
+    for (i = 0; i < 8; i++) {
+        m[i] = Read32LE(in + 4 * i, 32);
+    }
+    m[8] = Set1_32(0x80);
+    m[14] = Set1_32(256);
+    Bmw256Compress(h2, m, h);
+
+    //Final compression, with the chaining value as message
+    for (i = 0; i < 16; i++) {
+        h[i] = Set1_32(bmw256_final[i]);
+    }
+    Bmw256Compress(h1, h2, h);
+
+    for (i = 0; i < 8; i++) {
+        Write32LE(out + 4 * i, 32, h1[i + 8]);
+    }
+}
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * 4-way SSE4.1 implementation of lyra2re2_hash(), see Lyra2RE_nway.h.
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifdef ENABLE_SSE41
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#define LYRA2RE_WAYS 4
+typedef __m128i vec;
+
+static inline vec Add32(vec x, vec y) { return _mm_add_epi32(x, y); }
+static inline vec Sub32(vec x, vec y) { return _mm_sub_epi32(x, y); }
+static inline vec Add64(vec x, vec y) { return _mm_add_epi64(x, y); }
+static inline vec Xor(vec x, vec y) { return _mm_xor_si128(x, y); }
+static inline vec Or(vec x, vec y) { return _mm_or_si128(x, y); }
+static inline vec And(vec x, vec y) { return _mm_and_si128(x, y); }
+static inline vec AndNot(vec x, vec y) { return _mm_andnot_si128(x, y); }
+static inline vec ShL32(vec x, int n) { return _mm_slli_epi32(x, n); }
+static inline vec ShR32(vec x, int n) { return _mm_srli_epi32(x, n); }
+static inline vec ShL64(vec x, int n) { return _mm_slli_epi64(x, n); }
+static inline vec ShR64(vec x, int n) { return _mm_srli_epi64(x, n); }
+static inline vec CmpEq64(vec x, vec y) { return _mm_cmpeq_epi64(x, y); }
+static inline vec Set1_32(uint32_t x) { return _mm_set1_epi32(x); }
+static inline vec Set1_64(uint64_t x) { return _mm_set1_epi64x(x); }
+static inline vec LoadWords(const void* p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void StoreWords(void* p, vec x) { _mm_storeu_si128((__m128i*)p, x); }
+
+#include "Lyra2RE_nway.h"
+
+void lyra2re2_hash_4way(const char* input, char* output)
+{
+    unsigned char hashA[LYRA2RE_WAYS * 32], hashB[LYRA2RE_WAYS * 32];
+    int i;
+
+    Blake256_80(hashA, (const unsigned char*)input);
+    for (i = 0; i < LYRA2RE_WAYS; i += LYRA2RE_HALF) {
+        Keccak256_32(hashB + 32 * i, hashA + 32 * i);
+    }
+    CubeHash256_32(hashA, hashB);
+    for (i = 0; i < LYRA2RE_WAYS; i += LYRA2RE_HALF) {
+        Lyra2_32(hashB + 32 * i, hashA + 32 * i);
+        Skein256_32(hashA + 32 * i, hashB + 32 * i);
+    }
+    CubeHash256_32(hashB, hashA);
+    Bmw256_32((unsigned char*)output, hashB);
+}
+
+#endif
@@ -18,6 +18,10 @@
  * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
@@ -56,7 +60,7 @@ inline void initState(uint64_t state[/*16*/]) {
  *
  * @param v     A 1024-bit (16 uint64_t) array to be processed by Blake2b's G function
  */
-inline static void blake2bLyra(uint64_t *v) {
+static void blake2bLyra_generic(uint64_t *v) {
     ROUND_LYRA(0);
     ROUND_LYRA(1);
     ROUND_LYRA(2);
@@ -75,10 +79,17 @@ inline static void blake2bLyra(uint64_t *v) {
  * Executes a reduced version of Blake2b's G function with only one round
  * @param v     A 1024-bit (16 uint64_t) array to be processed by Blake2b's G function
  */
-inline static void reducedBlake2bLyra(uint64_t *v) {
+static void reducedBlake2bLyra_generic(uint64_t *v) {
     ROUND_LYRA(0);
 }
 
+/*
+ * Permutations used by the sponge. Lyra2AutoDetect() may switch these to an
+ * implementation that needs runtime CPU support, through spongeUseAVX2().
+ */
+static void (*blake2bLyra)(uint64_t *v) = blake2bLyra_generic;
+static void (*reducedBlake2bLyra)(uint64_t *v) = reducedBlake2bLyra_generic;
+
 /**
  * Performs a squeeze operation, using Blake2b's G function as the
  * internal permutation
@@ -730,6 +741,42 @@ inline void reducedDuplexRowd(uint64_t *state, uint64_t *rowIn, uint64_t *rowInO
 }
 */
 
+/** LYRA2(K, 32, in, 32, in, 32, 1, 4, 4) with in = {0, 1, ..., 31}, as used by Lyra2REv2. */
+static const unsigned char selftest_lyra2[32] = {
+    0x6e, 0x30, 0x06, 0x2c, 0xec, 0xbe, 0x4c, 0x53, 0x61, 0x2d, 0xa9, 0x30, 0x5a, 0x36, 0xd7, 0xe8,
+    0x9c, 0xa9, 0x98, 0x3e, 0xfc, 0xf8, 0x64, 0x98, 0x59, 0x6d, 0x17, 0x51, 0xe7, 0x18, 0xaa, 0x73
+};
+
+/** LYRA2_old(K, 32, in, 32, in, 32, 1, 8, 8) with the same input, as used by Lyra2RE. */
+static const unsigned char selftest_lyra2_old[32] = {
+    0xfd, 0xdf, 0x73, 0x9a, 0x77, 0x1a, 0x50, 0x7e, 0xa5, 0xdf, 0x07, 0xee, 0xc9, 0xb5, 0xe0, 0x2e,
+    0x69, 0x4f, 0x02, 0x74, 0x17, 0xda, 0x29, 0x8d, 0x19, 0x95, 0x78, 0x7e, 0xb6, 0xd1, 0x43, 0xa3
+};
+
+/** Check the selected permutations against known answers computed with the generic code. */
+int spongeSelfTest(void) {
+    unsigned char in[32], out[32];
+    int i;
+    for (i = 0; i < 32; i++) {
+        in[i] = i;
+    }
+    if (LYRA2(out, 32, in, 32, in, 32, 1, 4, 4) != 0 || memcmp(out, selftest_lyra2, 32) != 0) {
+        return 0;
+    }
+    if (LYRA2_old(out, 32, in, 32, in, 32, 1, 8, 8) != 0 || memcmp(out, selftest_lyra2_old, 32) != 0) {
+        return 0;
+    }
+    return 1;
+}
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+/** Switch the sponge to the AVX2 permutations. The caller checks for CPU support. */
+void spongeUseAVX2(void) {
+    blake2bLyra = blake2bLyra_avx2;
+    reducedBlake2bLyra = reducedBlake2bLyra_avx2;
+}
+#endif
+
 /**
  Prints an array of unsigned chars
  */
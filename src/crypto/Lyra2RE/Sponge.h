@@ -73,6 +73,14 @@ static inline uint64_t rotr64( const uint64_t w, const unsigned c ){
     G(r,7,v[ 3],v[ 4],v[ 9],v[14]);
 
 
+//---- Permutations (Sponge_avx2.c, only built when the compiler supports AVX2)
+void blake2bLyra_avx2(uint64_t *v);
+void reducedBlake2bLyra_avx2(uint64_t *v);
+
+//---- Implementation selection (see Lyra2AutoDetect)
+void spongeUseAVX2(void);
+int spongeSelfTest(void);
+
 //---- Housekeeping
 void initState(uint64_t state[/*16*/]);
 
@@ -0,0 +1,97 @@
+/**
+ * AVX2 implementation of the Blake2b-based permutation used by the Lyra2 sponge.
+ * Each 256-bit register holds one row of the 4x4 state, so the four G functions
+ * of a column (or diagonal) step run in parallel.
+ *
+ * This software is hereby placed in the public domain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+#include "Sponge.h"
+
+#define ROTR32_AVX2(x) _mm256_shuffle_epi32((x), _MM_SHUFFLE(2, 3, 0, 1))
+#define ROTR24_AVX2(x) _mm256_shuffle_epi8((x), r24)
+#define ROTR16_AVX2(x) _mm256_shuffle_epi8((x), r16)
+#define ROTR63_AVX2(x) _mm256_or_si256(_mm256_srli_epi64((x), 63), _mm256_add_epi64((x), (x)))
+
+/*Blake2b's G function, applied to the four columns (or diagonals) at once*/
+#define G_AVX2(a, b, c, d) \
+  do { \
+    a = _mm256_add_epi64(a, b); \
+    d = ROTR32_AVX2(_mm256_xor_si256(d, a)); \
+    c = _mm256_add_epi64(c, d); \
+    b = ROTR24_AVX2(_mm256_xor_si256(b, c)); \
+    a = _mm256_add_epi64(a, b); \
+    d = ROTR16_AVX2(_mm256_xor_si256(d, a)); \
+    c = _mm256_add_epi64(c, d); \
+    b = ROTR63_AVX2(_mm256_xor_si256(b, c)); \
+  } while(0)
+
+/*One Round of the Blake2b's compression function*/
+#define ROUND_LYRA_AVX2(a, b, c, d) \
+  do { \
+    G_AVX2(a, b, c, d); \
+    b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(0, 3, 2, 1)); \
+    c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2)); \
+    d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(2, 1, 0, 3)); \
+    G_AVX2(a, b, c, d); \
+    b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(2, 1, 0, 3)); \
+    c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(1, 0, 3, 2)); \
+    d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(0, 3, 2, 1)); \
+  } while(0)
+
+#define LOAD_STATE_AVX2(v) \
+    const __m256i r24 = _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10, \
+                                         3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10); \
+    const __m256i r16 = _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9, \
+                                         2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9); \
+    __m256i a = _mm256_loadu_si256((const __m256i*)&(v)[0]); \
+    __m256i b = _mm256_loadu_si256((const __m256i*)&(v)[4]); \
+    __m256i c = _mm256_loadu_si256((const __m256i*)&(v)[8]); \
+    __m256i d = _mm256_loadu_si256((const __m256i*)&(v)[12])
+
+#define STORE_STATE_AVX2(v) \
+    _mm256_storeu_si256((__m256i*)&(v)[0], a); \
+    _mm256_storeu_si256((__m256i*)&(v)[4], b); \
+    _mm256_storeu_si256((__m256i*)&(v)[8], c); \
+    _mm256_storeu_si256((__m256i*)&(v)[12], d)
+
+/**
+ * Execute Blake2b's G function, with all 12 rounds.
+ *
+ * @param v     A 1024-bit (16 uint64_t) array to be processed by Blake2b's G function
+ */
+void blake2bLyra_avx2(uint64_t *v) {
+    int i;
+    LOAD_STATE_AVX2(v);
+    for (i = 0; i < 12; i++) {
+        ROUND_LYRA_AVX2(a, b, c, d);
+    }
+    STORE_STATE_AVX2(v);
+}
+
+/**
+ * Executes a reduced version of Blake2b's G function with only one round
+ * @param v     A 1024-bit (16 uint64_t) array to be processed by Blake2b's G function
+ */
+void reducedBlake2bLyra_avx2(uint64_t *v) {
+    LOAD_STATE_AVX2(v);
+    ROUND_LYRA_AVX2(a, b, c, d);
+    STORE_STATE_AVX2(v);
+}
+
+#endif
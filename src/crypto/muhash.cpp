@@ -0,0 +1,241 @@
+// Copyright (c) 2020 The NIX Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/sha256.h>
+
+#include <assert.h>
+
+#include <limits>
+
+namespace {
+
+/** 2^3072 - MAX_PRIME_DIFF is the largest prime below 2^3072. */
+constexpr uint32_t MAX_PRIME_DIFF = 1103717;
+
+} // namespace
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t limb = 0;
+        for (int j = LIMB_SIZE / 8 - 1; j >= 0; --j) {
+            limb = (limb << 8) | data[i * (LIMB_SIZE / 8) + j];
+        }
+        limbs[i] = limb;
+    }
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t limb = limbs[i];
+        for (int j = 0; j < LIMB_SIZE / 8; ++j) {
+            out[i * (LIMB_SIZE / 8) + j] = limb & 0xff;
+            limb >>= 8;
+        }
+    }
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) limbs[i] = 0;
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= std::numeric_limits<limb_t>::max() - MAX_PRIME_DIFF) return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != std::numeric_limits<limb_t>::max()) return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the prime is adding MAX_PRIME_DIFF and dropping 2^3072.
+    double_limb_t c = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS && c != 0; ++i) {
+        c += limbs[i];
+        limbs[i] = (limb_t)c;
+        c >>= LIMB_SIZE;
+    }
+}
+
+void Num3072::Reduce(const limb_t (&product)[2 * LIMBS])
+{
+    // 2^3072 is MAX_PRIME_DIFF modulo the prime, so the high half is folded
+    // into the low one, and so is what overflows from that.
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t t = (double_limb_t)product[LIMBS + i] * MAX_PRIME_DIFF + product[i] + carry;
+        limbs[i] = (limb_t)t;
+        carry = t >> LIMB_SIZE;
+    }
+    while (carry != 0) {
+        double_limb_t t = (double_limb_t)carry * MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && t != 0; ++i) {
+            t += limbs[i];
+            limbs[i] = (limb_t)t;
+            t >>= LIMB_SIZE;
+        }
+        carry = (limb_t)t;
+    }
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    limb_t product[2 * LIMBS] = {0};
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            double_limb_t t = (double_limb_t)limbs[i] * a.limbs[j] + product[i + j] + carry;
+            product[i + j] = (limb_t)t;
+            carry = t >> LIMB_SIZE;
+        }
+        product[i + LIMBS] = carry;
+    }
+    Reduce(product);
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Binary extended Euclidean algorithm. The numbers it is used on are
+    // public, so it does not need to run in constant time.
+    Num3072 prime;
+    prime.limbs[0] = std::numeric_limits<limb_t>::max() - MAX_PRIME_DIFF + 1;
+    for (int i = 1; i < LIMBS; ++i) prime.limbs[i] = std::numeric_limits<limb_t>::max();
+
+    const auto is_one = [](const Num3072& n) {
+        if (n.limbs[0] != 1) return false;
+        for (int i = 1; i < LIMBS; ++i) {
+            if (n.limbs[i] != 0) return false;
+        }
+        return true;
+    };
+    const auto less = [](const Num3072& a, const Num3072& b) {
+        for (int i = LIMBS - 1; i >= 0; --i) {
+            if (a.limbs[i] != b.limbs[i]) return a.limbs[i] < b.limbs[i];
+        }
+        return false;
+    };
+    // a -= b, returning the borrow
+    const auto sub = [](Num3072& a, const Num3072& b) {
+        limb_t borrow = 0;
+        for (int i = 0; i < LIMBS; ++i) {
+            const limb_t d = a.limbs[i] - b.limbs[i] - borrow;
+            borrow = (a.limbs[i] < b.limbs[i]) || (a.limbs[i] == b.limbs[i] && borrow);
+            a.limbs[i] = d;
+        }
+        return borrow;
+    };
+    // a += b, returning the carry
+    const auto add = [](Num3072& a, const Num3072& b) {
+        limb_t carry = 0;
+        for (int i = 0; i < LIMBS; ++i) {
+            const double_limb_t t = (double_limb_t)a.limbs[i] + b.limbs[i] + carry;
+            a.limbs[i] = (limb_t)t;
+            carry = t >> LIMB_SIZE;
+        }
+        return carry;
+    };
+    const auto shift_right = [](Num3072& a, limb_t top) {
+        for (int i = 0; i < LIMBS - 1; ++i) {
+            a.limbs[i] = (a.limbs[i] >> 1) | (a.limbs[i + 1] << (LIMB_SIZE - 1));
+        }
+        a.limbs[LIMBS - 1] = (a.limbs[LIMBS - 1] >> 1) | (top << (LIMB_SIZE - 1));
+    };
+    // a / 2 modulo the prime
+    const auto halve = [&](Num3072& a) {
+        const limb_t top = (a.limbs[0] & 1) ? add(a, prime) : 0;
+        shift_right(a, top);
+    };
+    // a - b modulo the prime
+    const auto sub_mod = [&](Num3072& a, const Num3072& b) {
+        if (sub(a, b)) add(a, prime);
+    };
+
+    // Invariants: u == x1 * this and v == x2 * this, modulo the prime.
+    Num3072 u = *this, v = prime, x1, x2;
+    for (int i = 0; i < LIMBS; ++i) x2.limbs[i] = 0;
+    assert(less(x2, u)); // Zero has no inverse
+    while (!is_one(u) && !is_one(v)) {
+        while (!(u.limbs[0] & 1)) {
+            shift_right(u, 0);
+            halve(x1);
+        }
+        while (!(v.limbs[0] & 1)) {
+            shift_right(v, 0);
+            halve(x2);
+        }
+        if (less(u, v)) {
+            sub(v, u);
+            sub_mod(x2, x1);
+        } else {
+            sub(u, v);
+            sub_mod(x1, x2);
+        }
+    }
+    return is_one(u) ? x1 : x2;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+Num3072 MuHash3072::ToNum3072(Span<const unsigned char> in)
+{
+    unsigned char hashed_in[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(in.data(), in.size()).Finalize(hashed_in);
+    unsigned char data[Num3072::BYTE_SIZE];
+    ChaCha20(hashed_in, sizeof(hashed_in)).Keystream(data, sizeof(data));
+    return Num3072(data);
+}
+
+MuHash3072::MuHash3072(Span<const unsigned char> in)
+{
+    m_numerator = ToNum3072(in);
+}
+
+MuHash3072& MuHash3072::Insert(Span<const unsigned char> in)
+{
+    m_numerator.Multiply(ToNum3072(in));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(Span<const unsigned char> in)
+{
+    m_denominator.Multiply(ToNum3072(in));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    m_numerator.Multiply(mul.m_numerator);
+    m_denominator.Multiply(mul.m_denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    m_numerator.Multiply(div.m_denominator);
+    m_denominator.Multiply(div.m_numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(uint256& out)
+{
+    m_numerator.Divide(m_denominator);
+    m_denominator.SetToOne();
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    m_numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out.begin());
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2020 The NIX Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <serialize.h>
+#include <span.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+/** A number modulo the prime 2^3072 - 1103717, which is kept fully reduced. */
+class Num3072
+{
+private:
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 double_limb_t;
+    typedef uint64_t limb_t;
+    static constexpr int LIMBS = 48;
+    static constexpr int LIMB_SIZE = 64;
+#else
+    typedef uint64_t double_limb_t;
+    typedef uint32_t limb_t;
+    static constexpr int LIMBS = 96;
+    static constexpr int LIMB_SIZE = 32;
+#endif
+    limb_t limbs[LIMBS];
+
+    //! Reduce a product of two numbers into this one.
+    void Reduce(const limb_t (&product)[2 * LIMBS]);
+    bool IsOverflow() const;
+    void FullReduce();
+
+public:
+    static constexpr size_t BYTE_SIZE = 384;
+
+    Num3072() { SetToOne(); }
+    //! Construct from little-endian bytes, reduced modulo the prime.
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void SetToOne();
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    //! Multiplicative inverse. Must not be called on zero.
+    Num3072 GetInverse() const;
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        unsigned char data[BYTE_SIZE];
+        ToBytes(data);
+        s.write((const char*)data, BYTE_SIZE);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char data[BYTE_SIZE];
+        s.read((char*)data, BYTE_SIZE);
+        *this = Num3072(data);
+    }
+};
+
+/** A rolling hash of a set of byte strings, which does not depend on the
+ * order the elements were added in.
+ *
+ * Each element is hashed with SHA256, expanded with ChaCha20 to a number
+ * modulo 2^3072 - 1103717, and multiplied into the set. Removing an element
+ * multiplies its number into a separate denominator, so that no inverse is
+ * needed until Finalize(). Sets can be combined with *= and /=.
+ *
+ * The hash of the empty set is the SHA256 of the number one.
+ */
+class MuHash3072
+{
+private:
+    Num3072 m_numerator;
+    Num3072 m_denominator;
+
+    static Num3072 ToNum3072(Span<const unsigned char> in);
+
+public:
+    //! Hash of the empty set.
+    MuHash3072() {}
+    //! Hash of the set that contains in.
+    explicit MuHash3072(Span<const unsigned char> in);
+
+    MuHash3072& Insert(Span<const unsigned char> in);
+    MuHash3072& Remove(Span<const unsigned char> in);
+
+    MuHash3072& operator*=(const MuHash3072& mul);
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    //! Compute the 256-bit hash of the set. Leaves the set itself unchanged.
+    void Finalize(uint256& out);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(m_numerator);
+        READWRITE(m_denominator);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -477,6 +477,20 @@ public:
             }
         return false;
     }
+
+    /** for_each calls `fn` on every element that is not marked for erasure,
+     * e.g. to save the contents of the cache. Not threadsafe with any
+     * concurrent insert or erase.
+     *
+     * @param fn the function to call with each element
+     */
+    template <typename Fn>
+    void for_each(Fn fn) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                fn(table[i]);
+    }
 };
 } // namespace CuckooCache
 
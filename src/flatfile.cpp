@@ -10,6 +10,13 @@
 #include <tinyformat.h>
 #include <util/system.h>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 FlatFileSeq::FlatFileSeq(fs::path dir, const char* prefix, size_t chunk_size) :
     m_dir(std::move(dir)),
     m_prefix(prefix),
@@ -96,3 +103,66 @@ bool FlatFileSeq::Flush(const FlatFilePos& pos, bool finalize)
     fclose(file);
     return true;
 }
+
+MappedFlatFile::~MappedFlatFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+}
+
+std::shared_ptr<const MappedFlatFile> MappedFlatFileSeq::Map(const FlatFileSeq& seq, const FlatFilePos& pos, size_t size)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    if (m_max_files == 0 || pos.IsNull()) {
+        return nullptr;
+    }
+    const size_t end = size_t{pos.nPos} + size;
+    fs::path path = seq.FileName(pos);
+
+    LOCK(m_mutex);
+    for (auto it = m_files.begin(); it != m_files.end(); ++it) {
+        if (it->first != path) continue;
+        if (end <= size_t(it->second->Data().size())) {
+            m_files.splice(m_files.begin(), m_files, it);
+            return m_files.front().second;
+        }
+        // The file grew since it was mapped.
+        m_files.erase(it);
+        break;
+    }
+
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        LogPrintf("Unable to open file %s\n", path.string());
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || end > size_t(st.st_size)) {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LogPrintf("Unable to map file %s\n", path.string());
+        return nullptr;
+    }
+
+    auto file = std::make_shared<const MappedFlatFile>(static_cast<const unsigned char*>(data), st.st_size);
+    m_files.emplace_front(std::move(path), file);
+    if (m_files.size() > m_max_files) {
+        m_files.pop_back();
+    }
+    return file;
+#endif
+}
+
+void MappedFlatFileSeq::Unmap(const FlatFileSeq& seq, const FlatFilePos& pos)
+{
+    const fs::path path = seq.FileName(pos);
+    LOCK(m_mutex);
+    m_files.remove_if([&](const std::pair<fs::path, std::shared_ptr<const MappedFlatFile>>& entry) { return entry.first == path; });
+}
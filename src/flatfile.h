@@ -6,10 +6,14 @@
 #ifndef BITCOIN_FLATFILE_H
 #define BITCOIN_FLATFILE_H
 
+#include <list>
+#include <memory>
 #include <string>
 
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
+#include <sync.h>
 
 struct FlatFilePos
 {
@@ -93,4 +97,53 @@ public:
     bool Flush(const FlatFilePos& pos, bool finalize = false);
 };
 
+/** A file of a FlatFileSeq mapped read-only into memory. It is unmapped on destruction. */
+class MappedFlatFile
+{
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+
+public:
+    MappedFlatFile(const unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+    ~MappedFlatFile();
+
+    MappedFlatFile(const MappedFlatFile&) = delete;
+    MappedFlatFile& operator=(const MappedFlatFile&) = delete;
+
+    /** The whole file, as large as it was when it got mapped. */
+    Span<const unsigned char> Data() const { return Span<const unsigned char>(m_data, m_size); }
+};
+
+/**
+ * MappedFlatFileSeq keeps a bounded pool of files of a FlatFileSeq mapped in memory, so that data
+ * that was already written to them can be read without a system call or a copy per read. When the
+ * pool is full, the least recently used mapping is dropped. Mappings that are still referenced by
+ * a reader stay valid until the reader releases them.
+ */
+class MappedFlatFileSeq
+{
+private:
+    Mutex m_mutex;
+    const size_t m_max_files;
+    //! Most recently used first
+    std::list<std::pair<fs::path, std::shared_ptr<const MappedFlatFile>>> m_files GUARDED_BY(m_mutex);
+
+public:
+    /** @param max_files The number of files to keep mapped. Zero disables mapping. */
+    explicit MappedFlatFileSeq(size_t max_files) : m_max_files(max_files) {}
+
+    /**
+     * Get a mapping of the file at the given position that covers at least size bytes from it.
+     * The file is remapped if it grew past an existing mapping.
+     *
+     * @return The mapping, or nullptr if the range is not in the file or mapping is not possible
+     *         on this platform, in which case the caller should fall back to reading the file.
+     */
+    std::shared_ptr<const MappedFlatFile> Map(const FlatFileSeq& seq, const FlatFilePos& pos, size_t size);
+
+    /** Drop the mapping of the file at the given position, e.g. before the file is deleted. */
+    void Unmap(const FlatFileSeq& seq, const FlatFilePos& pos);
+};
+
 #endif // BITCOIN_FLATFILE_H
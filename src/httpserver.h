@@ -58,6 +58,7 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool replyStarted{false};
 
 public:
     explicit HTTPRequest(struct evhttp_request* req, bool replySent = false);
@@ -113,6 +114,18 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a reply whose body is sent in chunks, as it is produced, rather
+     * than built in memory first: WriteReplyChunk() sends each one, and
+     * EndReply() ends the reply.
+     *
+     * @note Use instead of WriteReply. As with that, do not call any other
+     * HTTPRequest methods after calling EndReply.
+     */
+    void StartReply(int nStatus);
+    void WriteReplyChunk(const std::string& strChunk);
+    void EndReply();
 };
 
 /** Event handler closure.
@@ -17,10 +17,12 @@
 #include <chainparams.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
+#include <crypto/Lyra2RE/Lyra2RE.h>
 #include <fs.h>
 #include <httprpc.h>
 #include <httpserver.h>
 #include <index/blockfilterindex.h>
+#include <index/coinstatsindex.h>
 #include <index/txindex.h>
 #include <interfaces/chain.h>
 #include <key.h>
@@ -29,11 +31,13 @@
 #include <net_permissions.h>
 #include <net_processing.h>
 #include <netbase.h>
+#include <node/blockcache.h>
 #include <node/context.h>
 #include <policy/feerate.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/settings.h>
+#include <pow.h>
 #include <rpc/blockchain.h>
 #include <rpc/register.h>
 #include <rpc/server.h>
@@ -167,6 +171,9 @@ void Interrupt(NodeContext& node)
     if (g_txindex) {
         g_txindex->Interrupt();
     }
+    if (g_coin_stats_index) {
+        g_coin_stats_index->Interrupt();
+    }
     ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Interrupt(); });
 }
 
@@ -231,6 +238,10 @@ void Shutdown(NodeContext& node)
         DumpMempool(::mempool);
     }
 
+    if (gArgs.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        DumpSignatureCache();
+    }
+
     if (fFeeEstimatesInitialized)
     {
         ::feeEstimator.FlushUnconfirmed();
@@ -263,6 +274,10 @@ void Shutdown(NodeContext& node)
         g_txindex->Stop();
         g_txindex.reset();
     }
+    if (g_coin_stats_index) {
+        g_coin_stats_index->Stop();
+        g_coin_stats_index.reset();
+    }
     ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Stop(); });
     DestroyAllBlockFilterIndexes();
 
@@ -392,7 +407,9 @@ void SetupServerArgs()
     gArgs.AddArg("-conf=<file>", strprintf("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)", BITCOIN_CONF_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockcachesize=<n>", strprintf("Maximum size of the cache of recently read blocks served to peers, RPC and REST, in MiB (0 to disable, default: %d)", DEFAULT_BLOCK_CACHE_SIZE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbcache=<n>", strprintf("Maximum database cache size <n> MiB (%d to %d, default: %d). In addition, unused mempool memory is shared for this cache (see -maxmempool).", nMinDbCache, nMaxDbCache, nDefaultDbCache), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbflushthread", strprintf("Write the coins database from a background thread (default: %u)", DEFAULT_DB_FLUSH_THREAD), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -403,7 +420,12 @@ void SetupServerArgs()
     gArgs.AddArg("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-parpow=<n>", strprintf("Set the number of header proof of work verification threads (0 to %d, default: %d)", MAX_SCRIPTCHECK_THREADS, DEFAULT_POWCHECK_THREADS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-parprefetch=<n>", strprintf("Set the number of threads prefetching the coins a block spends (0 to %d, default: %d)", MAX_SCRIPTCHECK_THREADS, DEFAULT_COINS_PREFETCH_THREADS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-parreadahead=<n>", strprintf("Set the number of threads reading blocks ahead of connecting them (0 to %d, default: %d)", MAX_SCRIPTCHECK_THREADS, DEFAULT_BLOCK_READ_AHEAD_THREADS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-partxprecheck=<n>", strprintf("Set the number of threads prechecking transactions received from peers (0 to %d, default: %d)", MAX_SCRIPTCHECK_THREADS, DEFAULT_TX_PRECHECK_THREADS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-persistsigcache", strprintf("Whether to save the signature cache on shutdown and load it on restart (default: %u)", DEFAULT_PERSIST_SIGCACHE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", BITCOIN_PID_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
@@ -416,6 +438,7 @@ void SetupServerArgs()
     hidden_args.emplace_back("-sysperms");
 #endif
     gArgs.AddArg("-txindex", strprintf("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)", DEFAULT_TXINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinstatsindex", strprintf("Maintain the statistics of the UTXO set as of every block, used by the gettxoutsetinfo rpc call (default: %u)", DEFAULT_COINSTATSINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blockfilterindex=<type>",
                  strprintf("Maintain an index of compact filters by block (default: %s, values: %s).", DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()) +
                  " If <type> is not supplied or if <type> = 1, indexes for all known types are enabled.",
@@ -427,6 +450,7 @@ void SetupServerArgs()
     gArgs.AddArg("-bantime=<n>", strprintf("Number of seconds to keep misbehaving peers from reconnecting (default: %u)", DEFAULT_MISBEHAVING_BANTIME), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-bind=<addr>", "Bind to given address and always listen on it. Use [host]:port notation for IPv6", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-connect=<ip>", "Connect only to the specified node; -noconnect disables automatic connections (the rules for this peer are the same as for -addnode). This option can be specified multiple times to connect to multiple nodes.", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-dandelioninventoryknown=<n>", strprintf("Number of recent Dandelion transactions remembered as known to each peer (default: %u)", DEFAULT_DANDELION_INVENTORY_KNOWN), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-discover", "Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-dns", strprintf("Allow DNS lookups for -addnode, -seednode and -connect (default: %u)", DEFAULT_NAME_LOOKUP), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-dnsseed", "Query for peer addresses via DNS lookup, if low on addresses (default: 1 unless -connect used)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
@@ -494,6 +518,7 @@ void SetupServerArgs()
     hidden_args.emplace_back("-zmqpubrawtxhwm=<n>");
 #endif
 
+    gArgs.AddArg("-checkpowonload=<mode>", strprintf("How much header proof of work to re-check when loading the block index at startup: full re-hashes every header, sample re-hashes unverified headers and 1 in %u verified ones, none only re-hashes unverified headers (default: %s)", POW_ON_LOAD_SAMPLE_RATE, DEFAULT_CHECKPOWONLOAD), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checklevel=<n>", strprintf("How thorough the block verification of -checkblocks is: "
         "level 0 reads the blocks from disk, "
@@ -975,10 +1000,16 @@ bool AppInitParameterInteraction()
         }
     }
 
+    if (!PoWLoadCheckFromString(gArgs.GetArg("-checkpowonload", DEFAULT_CHECKPOWONLOAD), g_pow_load_check)) {
+        return InitError(strprintf(_("Unknown -checkpowonload value %s.").translated, gArgs.GetArg("-checkpowonload", "")));
+    }
+
     // if using block pruning, then disallow txindex
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex.").translated);
+        if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX))
+            return InitError(_("Prune mode is incompatible with -coinstatsindex.").translated);
         if (!g_enabled_filter_types.empty()) {
             return InitError(_("Prune mode is incompatible with -blockfilterindex.").translated);
         }
@@ -1187,6 +1218,8 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string lyra2_algo = Lyra2AutoDetect();
+    LogPrintf("Using the '%s' Lyra2 implementation\n", lyra2_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1266,6 +1299,9 @@ bool AppInitMain(NodeContext& node)
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    if (gArgs.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        LoadSignatureCache();
+    }
 
     int script_threads = gArgs.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (script_threads <= 0) {
@@ -1288,6 +1324,34 @@ bool AppInitMain(NodeContext& node)
         }
     }
 
+    // The other worker pools are sized on their own rather than after -par,
+    // so that the number of threads does not grow with every pool added.
+    const auto pool_threads = [](const std::string& arg, int default_threads) {
+        return (int)std::max<int64_t>(0, std::min<int64_t>(gArgs.GetArg(arg, default_threads), MAX_SCRIPTCHECK_THREADS));
+    };
+    const int pow_threads = pool_threads("-parpow", DEFAULT_POWCHECK_THREADS);
+    const int prefetch_threads = pool_threads("-parprefetch", DEFAULT_COINS_PREFETCH_THREADS);
+    const int read_ahead_threads = pool_threads("-parreadahead", DEFAULT_BLOCK_READ_AHEAD_THREADS);
+    const int tx_precheck_threads = pool_threads("-partxprecheck", DEFAULT_TX_PRECHECK_THREADS);
+    LogPrintf("Header proof of work verification uses %d, coin prefetching %d, block read-ahead %d and transaction prechecks %d additional threads\n",
+        pow_threads, prefetch_threads, read_ahead_threads, tx_precheck_threads);
+    g_parallel_pow_checks = pow_threads >= 1;
+    for (int i = 0; i < pow_threads; ++i) {
+        threadGroup.create_thread([i]() { return ThreadPoWCheck(i); });
+    }
+    g_parallel_coins_prefetch = prefetch_threads >= 1;
+    for (int i = 0; i < prefetch_threads; ++i) {
+        threadGroup.create_thread([i]() { return ThreadCoinsPrefetch(i); });
+    }
+    g_parallel_block_read_ahead = read_ahead_threads >= 1;
+    for (int i = 0; i < read_ahead_threads; ++i) {
+        threadGroup.create_thread([i]() { return ThreadBlockReadAhead(i); });
+    }
+    g_parallel_tx_prechecks = tx_precheck_threads >= 1;
+    for (int i = 0; i < tx_precheck_threads; ++i) {
+        threadGroup.create_thread([i]() { return ThreadTxPrecheck(i); });
+    }
+
     assert(!node.scheduler);
     node.scheduler = MakeUnique<CScheduler>();
 
@@ -1434,6 +1498,7 @@ bool AppInitMain(NodeContext& node)
     fListen = gArgs.GetBoolArg("-listen", DEFAULT_LISTEN);
     fDiscover = gArgs.GetBoolArg("-discover", true);
     g_relay_txes = !gArgs.GetBoolArg("-blocksonly", DEFAULT_BLOCKSONLY);
+    g_dandelion_inventory_known = std::max<int64_t>(1, gArgs.GetArg("-dandelioninventoryknown", DEFAULT_DANDELION_INVENTORY_KNOWN));
 
     for (const std::string& strAddr : gArgs.GetArgs("-externalip")) {
         CService addrLocal;
@@ -1518,6 +1583,9 @@ bool AppInitMain(NodeContext& node)
     }
     LogPrintf("* Using %.1f MiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1f MiB for in-memory UTXO set (plus up to %.1f MiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    const int64_t block_cache_size = std::max<int64_t>(0, gArgs.GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE)) << 20;
+    g_block_cache.SetMaxUsage(block_cache_size);
+    LogPrintf("* Using %.1f MiB for recently read blocks\n", block_cache_size * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
@@ -1596,6 +1664,17 @@ bool AppInitMain(NodeContext& node)
                         "", CClientUIInterface::MSG_ERROR);
                 });
 
+                // A UTXO snapshot that was not fully loaded leaves the coin
+                // database matching no block.
+                bool loading_snapshot = false;
+                pblocktree->ReadFlag("loadingsnapshot", loading_snapshot);
+                if (loading_snapshot && (fReset || fReindexChainState)) {
+                    pblocktree->WriteFlag("loadingsnapshot", false);
+                } else if (loading_snapshot) {
+                    strLoadError = _("A UTXO snapshot was not fully loaded. You need to rebuild the database using -reindex-chainstate.").translated;
+                    break;
+                }
+
                 // If necessary, upgrade from older database format.
                 // This is a no-op if we cleared the coinsviewdb with -reindex or -reindex-chainstate
                 if (!::ChainstateActive().CoinsDB().Upgrade()) {
@@ -1710,11 +1789,28 @@ bool AppInitMain(NodeContext& node)
     fFeeEstimatesInitialized = true;
 
     // ********************************************************* Step 8: start indexers
+    // A chain loaded from a UTXO snapshot lacks the blocks below its base,
+    // which the indexes would need.
+    const bool assumed_valid_blocks = WITH_LOCK(cs_main, return ::ChainstateActive().HasAssumedValidBlocks());
+    if (assumed_valid_blocks) {
+        if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
+            return InitError(_("A chain loaded from a UTXO snapshot is incompatible with -txindex. You need to rebuild the database using -reindex.").translated);
+        if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX))
+            return InitError(_("A chain loaded from a UTXO snapshot is incompatible with -coinstatsindex. You need to rebuild the database using -reindex.").translated);
+        if (!g_enabled_filter_types.empty())
+            return InitError(_("A chain loaded from a UTXO snapshot is incompatible with -blockfilterindex. You need to rebuild the database using -reindex.").translated);
+    }
+
     if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
         g_txindex = MakeUnique<TxIndex>(nTxIndexCache, false, fReindex);
         g_txindex->Start();
     }
 
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        g_coin_stats_index = MakeUnique<CoinStatsIndex>(/* cache size */ 0, false, fReindex);
+        g_coin_stats_index->Start();
+    }
+
     for (const auto& filter_type : g_enabled_filter_types) {
         InitBlockFilterIndex(filter_type, filter_index_cache, false, fReindex);
         GetBlockFilterIndex(filter_type)->Start();
@@ -1740,6 +1836,13 @@ bool AppInitMain(NodeContext& node)
         }
     }
 
+    // Nothing validates the blocks below a UTXO snapshot base, or downloads
+    // them, so they can never be served.
+    if (assumed_valid_blocks) {
+        LogPrintf("Unsetting NODE_NETWORK on a chain loaded from a UTXO snapshot\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+    }
+
     if (chainparams.GetConsensus().SegwitHeight != std::numeric_limits<int>::max()) {
         // Advertise witness capabilities.
         // The option to not set NODE_WITNESS is only used in the tests and should be removed.
@@ -6,6 +6,7 @@
 #define BITCOIN_MEMUSAGE_H
 
 #include <indirectmap.h>
+#include <pooledmap.h>
 #include <prevector.h>
 
 #include <stdlib.h>
@@ -133,6 +134,14 @@ static inline size_t IncrementalDynamicUsage(const indirectmap<X, Y>& m)
     return MallocUsage(sizeof(stl_tree_node<std::pair<const X*, Y> >));
 }
 
+// pooledmap keeps the slots of erased entries until compact() or clear(), so count the whole pool
+
+template<typename K, typename T, typename H>
+static inline size_t DynamicUsage(const pooledmap<K, T, H>& m)
+{
+    return MallocUsage(pooledmap<K, T, H>::BUCKET_BYTES * m.bucket_count()) + MallocUsage(sizeof(void*) * m.chunk_count()) + MallocUsage(pooledmap<K, T, H>::ENTRY_BYTES * m.capacity());
+}
+
 template<typename X>
 static inline size_t DynamicUsage(const std::unique_ptr<X>& p)
 {
@@ -17,11 +17,15 @@
 #include <policy/policy.h>
 #include <pow.h>
 #include <primitives/transaction.h>
+#include <shutdown.h>
 #include <timedata.h>
 #include <util/moneystr.h>
 #include <util/system.h>
 
 #include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
 #include <utility>
 
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
@@ -83,11 +87,230 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+
+    vBlockEntries.clear();
+    vPackages.clear();
+    fPackageSkipped = false;
+    packageBelowMinFee = nullopt;
 }
 
 Optional<int64_t> BlockAssembler::m_last_block_num_txs{nullopt};
 Optional<int64_t> BlockAssembler::m_last_block_weight{nullopt};
 
+/**
+ * The packages picked for the last block template, and what they were picked
+ * from. As long as nothing left the mempool and no fee or ancestor state
+ * changed since (see CTxMemPool::GetRemovalSequence()), a full rebuild picks
+ * the same packages in the same order again, with those of the entries that
+ * entered the mempool since in between. That is only worth relying on if the
+ * block had room for every package worth including.
+ */
+struct LastBlockSelection {
+    const CTxMemPool* mempool{nullptr};
+    uint256 hashPrevBlock;
+    int nHeight{0};
+    unsigned int nBlockMaxWeight{0};
+    CFeeRate blockMinFeeRate;
+    int64_t nLockTimeCutoff{0};
+    uint64_t nRemovalSequence{0};
+    unsigned int nTransactionsUpdated{0};
+    // The size of the mempool, to tell the entries added since apart
+    size_t nMempoolSize{0};
+    uint64_t nBlockWeight{0};
+    CAmount nFees{0};
+
+    // Only kept if no package was left out for not fitting
+    bool fExtendable{false};
+    std::vector<CTxMemPool::txiter> vBlockEntries;
+    std::vector<SelectedPackage> vPackages;
+    Optional<SelectedPackage> packageBelowMinFee;
+    CTxMemPool::setEntries inBlock;
+};
+static LastBlockSelection g_last_selection GUARDED_BY(cs_main);
+
+void ResetLastBlockSelection()
+{
+    LOCK(cs_main);
+    g_last_selection = LastBlockSelection();
+}
+
+bool GetLastBlockSelection(const CTxMemPool& mempool, const uint256& hashPrevBlock, CAmount& nFees, uint64_t& nWeight, unsigned int& nTransactionsUpdated)
+{
+    AssertLockHeld(cs_main);
+    const LastBlockSelection& last = g_last_selection;
+    if (last.mempool != &mempool || last.hashPrevBlock != hashPrevBlock) return false;
+    nFees = last.nFees;
+    nWeight = last.nBlockWeight;
+    nTransactionsUpdated = last.nTransactionsUpdated;
+    return true;
+}
+
+bool BlockAssembler::ExtendLastSelection(const CBlockIndex* pindexPrev, int& nPackagesSelected, int& nDescendantsUpdated)
+{
+    LastBlockSelection& last = g_last_selection;
+    if (!last.fExtendable || last.mempool != &m_mempool || last.hashPrevBlock != pindexPrev->GetBlockHash() ||
+        last.nHeight != nHeight || last.nBlockMaxWeight != nBlockMaxWeight || last.blockMinFeeRate != blockMinFeeRate ||
+        last.nLockTimeCutoff != nLockTimeCutoff || last.nRemovalSequence != m_mempool.GetRemovalSequence()) {
+        return false;
+    }
+
+    // Take the selection over rather than copying it. SaveSelection() puts
+    // the one picked now in its place, whether it extends this one or not.
+    const std::vector<CTxMemPool::txiter> vOldEntries = std::move(last.vBlockEntries);
+    const std::vector<SelectedPackage> vOldPackages = std::move(last.vPackages);
+    const Optional<SelectedPackage> oldBelowMinFee = last.packageBelowMinFee;
+    const std::vector<CTxMemPool::txiter> vNewEntries = m_mempool.GetEntriesAddedSince(last.nMempoolSize);
+    // inBlock holds the old entries that are not added yet as well. No new
+    // package is picked while it has ancestors among those, so this does not
+    // change which ancestors of it onlyUnconfirmed() leaves out.
+    inBlock = std::move(last.inBlock);
+    last = LastBlockSelection();
+
+    // New entries are never ancestors of old ones, so the old entries keep the
+    // scores they were picked by. The new ones start out with their mempool
+    // ancestor state, and are updated for each ancestor added from then on,
+    // as addPackageTxs() would. Those with old ancestors have to wait for
+    // them: a package taking old entries along is out of the order they were
+    // picked in, which only a full rebuild can sort out.
+    const CTxMemPool::setEntries setNew(vNewEntries.begin(), vNewEntries.end());
+    indexed_modified_transaction_set mapModifiedTx;
+    std::map<CTxMemPool::txiter, size_t, CompareCTxMemPoolIter> mapOldAncestorsLeft;
+    std::map<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>, CompareCTxMemPoolIter> mapWaiting;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    for (CTxMemPool::txiter it : vNewEntries) {
+        mapModifiedTx.insert(CTxMemPoolModifiedEntry(it));
+        CTxMemPool::setEntries ancestors;
+        m_mempool.CalculateMemPoolAncestors(*it, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        for (CTxMemPool::txiter ancestor : ancestors) {
+            if (setNew.count(ancestor)) continue;
+            // One that was not picked before keeps waiting
+            ++mapOldAncestorsLeft[it];
+            if (inBlock.count(ancestor)) mapWaiting[ancestor].push_back(it);
+        }
+    }
+
+    size_t nextPackage = 0;
+    size_t nextEntry = 0;
+    while (true) {
+        modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
+        const bool fNewLeft = modit != mapModifiedTx.get<ancestor_score>().end();
+        SelectedPackage package;
+        if (fNewLeft) {
+            CompareTxMemPoolEntryByAncestorFee().GetModFeeAndSize(*modit, package.mod_fee, package.size);
+            package.hash = modit->iter->GetTx().GetHash();
+        }
+
+        if (nextPackage < vOldPackages.size()) {
+            if (!fNewLeft || !package.IsBetterThan(vOldPackages[nextPackage])) {
+                // The next old package comes first, as it did last time.
+                const SelectedPackage& oldPackage = vOldPackages[nextPackage++];
+                if (!TestPackage(oldPackage.nPackageSize, oldPackage.nPackageSigOpsCost)) {
+                    return false;
+                }
+                for (size_t i = 0; i < oldPackage.nTx; ++i) {
+                    const CTxMemPool::txiter it = vOldEntries[nextEntry++];
+                    AppendToBlock(it);
+                    auto waiting = mapWaiting.find(it);
+                    if (waiting == mapWaiting.end()) continue;
+                    for (CTxMemPool::txiter desc : waiting->second) {
+                        --mapOldAncestorsLeft[desc];
+                        modtxiter mit = mapModifiedTx.find(desc);
+                        if (mit != mapModifiedTx.end()) {
+                            ++nDescendantsUpdated;
+                            mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
+                        }
+                    }
+                }
+                vPackages.push_back(oldPackage);
+                continue;
+            }
+        } else if (!fNewLeft || (oldBelowMinFee && oldBelowMinFee->IsBetterThan(package))) {
+            // The package that ended the last selection ends this one too.
+            packageBelowMinFee = oldBelowMinFee;
+            return true;
+        }
+
+        // The best new package comes next.
+        if (modit->nModFeesWithAncestors < blockMinFeeRate.GetFee(modit->nSizeWithAncestors)) {
+            // addPackageTxs() would leave the old packages after it out as well.
+            if (nextPackage < vOldPackages.size()) return false;
+            packageBelowMinFee = package;
+            return true;
+        }
+        auto left = mapOldAncestorsLeft.find(modit->iter);
+        if (left != mapOldAncestorsLeft.end() && left->second > 0) return false;
+        if (!TestPackage(modit->nSizeWithAncestors, modit->nSigOpCostWithAncestors)) return false;
+
+        const CTxMemPool::txiter iter = modit->iter;
+        CTxMemPool::setEntries ancestors;
+        m_mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        onlyUnconfirmed(ancestors);
+        ancestors.insert(iter);
+        if (!TestPackageTransactions(ancestors)) {
+            mapModifiedTx.get<ancestor_score>().erase(modit);
+            continue;
+        }
+
+        std::vector<CTxMemPool::txiter> sortedEntries;
+        SortForBlock(ancestors, sortedEntries);
+        package.nTx = sortedEntries.size();
+        package.nPackageSize = modit->nSizeWithAncestors;
+        package.nPackageSigOpsCost = modit->nSigOpCostWithAncestors;
+        vPackages.push_back(package);
+        for (CTxMemPool::txiter entry : sortedEntries) {
+            AddToBlock(entry);
+            mapModifiedTx.erase(entry);
+        }
+        ++nPackagesSelected;
+
+        // Only new entries descend from new ones. Those that are not in
+        // mapModifiedTx are in the block already, or failed.
+        for (CTxMemPool::txiter entry : ancestors) {
+            CTxMemPool::setEntries descendants;
+            m_mempool.CalculateDescendants(entry, descendants);
+            for (CTxMemPool::txiter desc : descendants) {
+                if (ancestors.count(desc)) continue;
+                modtxiter mit = mapModifiedTx.find(desc);
+                if (mit == mapModifiedTx.end()) continue;
+                ++nDescendantsUpdated;
+                mapModifiedTx.modify(mit, update_for_parent_inclusion(entry));
+            }
+        }
+    }
+}
+
+void BlockAssembler::SaveSelection(const CBlockIndex* pindexPrev)
+{
+    LastBlockSelection& last = g_last_selection;
+    last.mempool = &m_mempool;
+    last.hashPrevBlock = pindexPrev->GetBlockHash();
+    last.nHeight = nHeight;
+    last.nBlockMaxWeight = nBlockMaxWeight;
+    last.blockMinFeeRate = blockMinFeeRate;
+    last.nLockTimeCutoff = nLockTimeCutoff;
+    last.nRemovalSequence = m_mempool.GetRemovalSequence();
+    last.nTransactionsUpdated = m_mempool.GetTransactionsUpdated();
+    last.nMempoolSize = m_mempool.size();
+    last.nBlockWeight = nBlockWeight;
+    last.nFees = nFees;
+
+    // If a package did not fit, a fuller mempool may call for a different
+    // choice altogether.
+    last.fExtendable = !fPackageSkipped;
+    if (last.fExtendable) {
+        last.vBlockEntries = std::move(vBlockEntries);
+        last.vPackages = std::move(vPackages);
+        last.packageBelowMinFee = packageBelowMinFee;
+        last.inBlock = std::move(inBlock);
+    } else {
+        last.vBlockEntries.clear();
+        last.vPackages.clear();
+        last.packageBelowMinFee = nullopt;
+        last.inBlock.clear();
+    }
+}
+
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
 {
     int64_t nTimeStart = GetTimeMicros();
@@ -136,7 +359,19 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    const bool fExtended = ExtendLastSelection(pindexPrev, nPackagesSelected, nDescendantsUpdated);
+    if (!fExtended) {
+        // Pick from scratch, over whatever the extension got to.
+        const bool fWitness = fIncludeWitness;
+        resetBlock();
+        fIncludeWitness = fWitness;
+        pblock->vtx.resize(1);
+        pblocktemplate->vTxFees.resize(1);
+        pblocktemplate->vTxSigOpsCost.resize(1);
+        nPackagesSelected = 0;
+        nDescendantsUpdated = 0;
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -168,9 +403,10 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, state.ToString()));
     }
+    SaveSelection(pindexPrev);
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants%s), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, fExtended ? ", extending the last template" : "", 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -214,6 +450,12 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
 }
 
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
+{
+    inBlock.insert(iter);
+    AppendToBlock(iter);
+}
+
+void BlockAssembler::AppendToBlock(CTxMemPool::txiter iter)
 {
     pblock->vtx.emplace_back(iter->GetSharedTx());
     pblocktemplate->vTxFees.push_back(iter->GetFee());
@@ -222,7 +464,7 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     ++nBlockTx;
     nBlockSigOpsCost += iter->GetSigOpCost();
     nFees += iter->GetFee();
-    inBlock.insert(iter);
+    vBlockEntries.push_back(iter);
 
     bool fPrintPriority = gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
     if (fPrintPriority) {
@@ -365,10 +607,19 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
 
         if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
             // Everything else we might consider has a lower fee rate
+            SelectedPackage package;
+            if (fUsingModified) {
+                CompareTxMemPoolEntryByAncestorFee().GetModFeeAndSize(*modit, package.mod_fee, package.size);
+            } else {
+                CompareTxMemPoolEntryByAncestorFee().GetModFeeAndSize(*iter, package.mod_fee, package.size);
+            }
+            package.hash = iter->GetTx().GetHash();
+            packageBelowMinFee = package;
             return;
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            fPackageSkipped = true;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -411,6 +662,18 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         std::vector<CTxMemPool::txiter> sortedEntries;
         SortForBlock(ancestors, sortedEntries);
 
+        SelectedPackage package;
+        if (fUsingModified) {
+            CompareTxMemPoolEntryByAncestorFee().GetModFeeAndSize(*modit, package.mod_fee, package.size);
+        } else {
+            CompareTxMemPoolEntryByAncestorFee().GetModFeeAndSize(*iter, package.mod_fee, package.size);
+        }
+        package.hash = iter->GetTx().GetHash();
+        package.nTx = sortedEntries.size();
+        package.nPackageSize = packageSize;
+        package.nPackageSigOpsCost = packageSigOpsCost;
+        vPackages.push_back(package);
+
         for (size_t i=0; i<sortedEntries.size(); ++i) {
             AddToBlock(sortedEntries[i]);
             // Erase from the modified set, if present
@@ -442,3 +705,69 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+/** Nonces a grinding thread claims at a time; a multiple of the multi-way PoW hash width. */
+static const uint64_t GRIND_CHUNK_SIZE = 64;
+
+bool GrindBlockNonce(CBlockHeader* pblock, const Consensus::Params& consensusParams, int nThreads, uint64_t& nMaxTries)
+{
+    const uint64_t nStart = pblock->nNonce;
+    const uint64_t nEnd = std::min<uint64_t>(nStart + std::min<uint64_t>(nMaxTries, std::numeric_limits<uint32_t>::max()),
+                                             uint64_t{std::numeric_limits<uint32_t>::max()} + 1);
+    // Chunks are handed out in increasing order and a chunk is only skipped
+    // once a lower nonce has been found, so nFound ends up as the lowest
+    // valid nonce no matter how the threads interleave.
+    std::atomic<uint64_t> nNext{nStart};
+    std::atomic<uint64_t> nFound{nEnd};
+    const CBlockHeader header = *pblock;
+
+    // Returns false once there is nothing left to grind.
+    auto grind_chunk = [&]() {
+        CBlockHeader headers[MAX_POW_CHECK_HEADERS];
+        uint256 hashes[MAX_POW_CHECK_HEADERS];
+        const uint64_t nChunk = nNext.fetch_add(GRIND_CHUNK_SIZE);
+        const uint64_t nChunkEnd = std::min(nChunk + GRIND_CHUNK_SIZE, nFound.load());
+        if (nChunk >= nChunkEnd || ShutdownRequested()) return false;
+        for (uint64_t nBatch = nChunk; nBatch < nChunkEnd; nBatch += MAX_POW_CHECK_HEADERS) {
+            const std::ptrdiff_t nCount = std::min<uint64_t>(MAX_POW_CHECK_HEADERS, nChunkEnd - nBatch);
+            for (std::ptrdiff_t i = 0; i < nCount; ++i) {
+                headers[i] = header;
+                headers[i].nNonce = nBatch + i;
+            }
+            GetPoWHashes(Span<const CBlockHeader>(headers, nCount), hashes);
+            for (std::ptrdiff_t i = 0; i < nCount; ++i) {
+                if (CheckProofOfWork(hashes[i], header.nBits, consensusParams)) {
+                    uint64_t nPrev = nFound.load();
+                    while (nBatch + i < nPrev && !nFound.compare_exchange_weak(nPrev, nBatch + i)) {}
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+    auto grind = [&]() { while (grind_chunk()) {} };
+
+    // Regtest blocks are usually found within the first chunk, so only start
+    // the other threads when that is not enough.
+    if (grind_chunk()) {
+        std::vector<std::thread> threads;
+        for (int i = 1; i < nThreads; ++i) {
+            threads.emplace_back(grind);
+        }
+        grind();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    if (ShutdownRequested()) return false;
+    const uint64_t nResult = nFound.load();
+    if (nResult < nEnd) {
+        nMaxTries -= nResult - nStart;
+        pblock->nNonce = nResult;
+        return true;
+    }
+    nMaxTries -= nEnd - nStart;
+    pblock->nNonce = nEnd - 1;
+    return false;
+}
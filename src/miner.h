@@ -114,7 +114,7 @@ struct update_for_parent_inclusion
 
     void operator() (CTxMemPoolModifiedEntry &e)
     {
-        e.nModFeesWithAncestors -= iter->GetFee();
+        e.nModFeesWithAncestors -= iter->GetModifiedFee();
         e.nSizeWithAncestors -= iter->GetTxSize();
         e.nSigOpCostWithAncestors -= iter->GetSigOpCost();
     }
@@ -122,6 +122,30 @@ struct update_for_parent_inclusion
     CTxMemPool::txiter iter;
 };
 
+/** A package added to a block: the score it was picked by, as
+ *  CompareTxMemPoolEntryByAncestorFee sees it, its number of transactions,
+ *  and the size and sigops it was tested by. */
+struct SelectedPackage
+{
+    double mod_fee;
+    double size;
+    uint256 hash;
+    size_t nTx;
+    uint64_t nPackageSize;
+    int64_t nPackageSigOpsCost;
+
+    /** Whether addPackageTxs() would pick this package before other */
+    bool IsBetterThan(const SelectedPackage& other) const
+    {
+        double f1 = mod_fee * other.size;
+        double f2 = size * other.mod_fee;
+        if (f1 == f2) {
+            return hash < other.hash;
+        }
+        return f1 > f2;
+    }
+};
+
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler
 {
@@ -142,6 +166,14 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    // The entries of inBlock, in the order they are in the block
+    std::vector<CTxMemPool::txiter> vBlockEntries;
+    // The packages in the block, in the order they were added
+    std::vector<SelectedPackage> vPackages;
+    // Whether a package was left out because it did not fit
+    bool fPackageSkipped;
+    // The package that ended the selection by paying less than blockMinFeeRate
+    Optional<SelectedPackage> packageBelowMinFee;
 
     // Chain context for the block
     int nHeight;
@@ -169,8 +201,18 @@ private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
+    /** Pick the packages of the last block template again, along with those
+      * of the entries that entered the mempool since, in the order
+      * addPackageTxs() would pick them all in. Only looks at the new entries
+      * and the packages picked before. Returns false, leaving the block in an
+      * unknown state, if only addPackageTxs() can tell what to pick. */
+    bool ExtendLastSelection(const CBlockIndex* pindexPrev, int& nPackagesSelected, int& nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool.cs);
+    /** Remember the transactions picked for this block for the next template */
+    void SaveSelection(const CBlockIndex* pindexPrev) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool.cs);
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
+    /** Add a tx that is in inBlock already to the block */
+    void AppendToBlock(CTxMemPool::txiter iter);
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
@@ -199,8 +241,31 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set& mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 };
 
+/** Make the next block template pick its transactions from scratch (for testing) */
+void ResetLastBlockSelection();
+
+/**
+ * Get the fees and weight of the transactions the last block template on top
+ * of hashPrevBlock picked from mempool, and the mempool's
+ * GetTransactionsUpdated() they were picked at. Returns false if the last
+ * template was for another block or mempool.
+ */
+bool GetLastBlockSelection(const CTxMemPool& mempool, const uint256& hashPrevBlock, CAmount& nFees, uint64_t& nWeight, unsigned int& nTransactionsUpdated) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
+
+/**
+ * Search the nonces from pblock->nNonce upwards for one whose GetPoWHash()
+ * meets pblock->nBits, trying at most nMaxTries of them on up to nThreads
+ * threads. nMaxTries is decreased by the number of nonces used up.
+ *
+ * On success pblock->nNonce is set to the lowest valid nonce in the range, so
+ * the result does not depend on the number of threads. Returns false if the
+ * tries or the 32-bit nonce space ran out (the caller should move on to a new
+ * extranonce) or shutdown was requested.
+ */
+bool GrindBlockNonce(CBlockHeader* pblock, const Consensus::Params& consensusParams, int nThreads, uint64_t& nMaxTries);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
 #endif // BITCOIN_MINER_H
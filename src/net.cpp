@@ -85,6 +85,7 @@ static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL; // S
 bool fDiscover = true;
 bool fListen = true;
 bool g_relay_txes = !DEFAULT_BLOCKSONLY;
+unsigned int g_dandelion_inventory_known = DEFAULT_DANDELION_INVENTORY_KNOWN;
 RecursiveMutex cs_mapLocalHost;
 std::map<CNetAddr, LocalServiceInfo> mapLocalHost GUARDED_BY(cs_mapLocalHost);
 static bool vfLimited[NET_MAX] GUARDED_BY(cs_mapLocalHost) = {};
@@ -542,6 +543,12 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
     } else {
         stats.minFeeFilter = 0;
     }
+    if (m_tx_relay != nullptr) {
+        LOCK(m_tx_relay->cs_tx_inventory);
+        stats.m_dandelion_inventory_known_bytes = m_tx_relay->filterDandelionInventoryKnown.DynamicMemoryUsage();
+    } else {
+        stats.m_dandelion_inventory_known_bytes = 0;
+    }
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer.
@@ -1105,9 +1112,12 @@ void CConnman::DisconnectNodes()
                     }
                 }
                 if (fDelete) {
-                    // Dandelion: close connection
-                    CloseDandelionConnections(pnode);
-                    LogPrint(BCLog::DANDELION, "Removed Dandelion connection:\n%s", GetDandelionRoutingDataDebugString());
+                    {
+                        // Dandelion: close connection
+                        LOCK(cs_vNodes);
+                        CloseDandelionConnections(pnode);
+                        LogPrint(BCLog::DANDELION, "Removed Dandelion connection:\n%s", GetDandelionRoutingDataDebugString());
+                    }
                     vNodesDisconnected.remove(pnode);
                     DeleteNode(pnode);
                 }
@@ -1472,6 +1482,7 @@ void CConnman::WakeMessageHandler()
 
 bool CConnman::isDandelionInbound(const CNode* const pnode) const
 {
+    LOCK(cs_vNodes);
     return (std::find(vDandelionInbound.begin(), vDandelionInbound.end(), pnode) != vDandelionInbound.end());
 }
 
@@ -1490,6 +1501,7 @@ bool CConnman::setLocalDandelionDestination()
 }
 
 CNode* CConnman::getDandelionDestination(CNode* pfrom) {
+    LOCK(cs_vNodes);
     for (auto const& e : mDandelionRoutes) {
         if (pfrom==e.first) {
             return e.second;
@@ -1504,6 +1516,7 @@ CNode* CConnman::getDandelionDestination(CNode* pfrom) {
 }
 
 bool CConnman::localDandelionDestinationPushInventory(const CInv& inv) {
+    LOCK(cs_vNodes);
     if(isLocalDandelionDestinationSet()) {
         localDandelionDestination->PushInventory(inv);
         return true;
@@ -1515,31 +1528,102 @@ bool CConnman::localDandelionDestinationPushInventory(const CInv& inv) {
     }
 }
 
+/** Add the time an embargo lasted (in microseconds) to a latency histogram */
+static void RecordDandelionLatency(std::array<uint64_t, DANDELION_LATENCY_BUCKETS>& histogram, int64_t nLatency)
+{
+    size_t bucket = 0;
+    while (bucket < DANDELION_LATENCY_BUCKETS - 1 && nLatency >= DANDELION_LATENCY_BOUNDS[bucket] * 1000000) {
+        bucket++;
+    }
+    histogram[bucket]++;
+}
+
 bool CConnman::insertDandelionEmbargo(const uint256& hash, const int64_t& embargo) {
-    auto pair = mDandelionEmbargo.insert(std::make_pair(hash, embargo));
+    LOCK(cs_dandelionEmbargo);
+    auto pair = mDandelionEmbargo.insert(std::make_pair(hash, DandelionEmbargo{embargo, GetTimeMicros()}));
+    if (pair.second) {
+        setDandelionEmbargoByTime.insert(std::make_pair(embargo, hash));
+        nDandelionEmbargoInserted++;
+    }
     return pair.second;
 }
 
 bool CConnman::isTxDandelionEmbargoed(const uint256& hash) const {
-    auto pair = mDandelionEmbargo.find(hash);
-    if (pair != mDandelionEmbargo.end()) {
-        return true;
-    } else {
+    LOCK(cs_dandelionEmbargo);
+    return mDandelionEmbargo.count(hash) > 0;
+}
+
+bool CConnman::removeDandelionEmbargo(const uint256& hash) {
+    LOCK(cs_dandelionEmbargo);
+    auto iter = mDandelionEmbargo.find(hash);
+    if (iter == mDandelionEmbargo.end()) {
         return false;
     }
+    RecordDandelionLatency(vDandelionRemovedLatency, GetTimeMicros() - iter->second.nTimeInserted);
+    setDandelionEmbargoByTime.erase(std::make_pair(iter->second.nExpiry, hash));
+    mDandelionEmbargo.erase(iter);
+    nDandelionEmbargoRemoved++;
+    return true;
 }
 
-bool CConnman::removeDandelionEmbargo(const uint256& hash) {
-    bool removed = false;
-    for (auto iter=mDandelionEmbargo.begin(); iter!=mDandelionEmbargo.end();) {
-        if (iter->first==hash) {
-            iter = mDandelionEmbargo.erase(iter);
-            removed = true;
-        } else {
-            iter++;
+std::vector<uint256> CConnman::popExpiredDandelionEmbargoes(int64_t nTime) {
+    std::vector<uint256> vExpired;
+    LOCK(cs_dandelionEmbargo);
+    const int64_t nNow = GetTimeMicros();
+    auto iter = setDandelionEmbargoByTime.begin();
+    while (iter != setDandelionEmbargoByTime.end() && iter->first < nTime) {
+        auto embargo = mDandelionEmbargo.find(iter->second);
+        RecordDandelionLatency(vDandelionExpiredLatency, nNow - embargo->second.nTimeInserted);
+        mDandelionEmbargo.erase(embargo);
+        vExpired.push_back(iter->second);
+        iter = setDandelionEmbargoByTime.erase(iter);
+    }
+    nDandelionEmbargoExpired += vExpired.size();
+    return vExpired;
+}
+
+void CConnman::recordDandelionEvent(DandelionEvent event) {
+    switch (event) {
+    case DandelionEvent::STEM_RECEIVED: nDandelionStemReceived++; break;
+    case DandelionEvent::STEM_LOCAL: nDandelionStemLocal++; break;
+    case DandelionEvent::STEM_RELAYED: nDandelionStemRelayed++; break;
+    case DandelionEvent::FLUFFED: nDandelionFluffed++; break;
+    }
+}
+
+CDandelionStats CConnman::getDandelionStats() const {
+    CDandelionStats stats;
+    stats.nStemReceived = nDandelionStemReceived;
+    stats.nStemLocal = nDandelionStemLocal;
+    stats.nStemRelayed = nDandelionStemRelayed;
+    stats.nFluffed = nDandelionFluffed;
+    stats.nShuffles = nDandelionShuffles;
+    {
+        LOCK(cs_dandelionEmbargo);
+        stats.nEmbargoed = mDandelionEmbargo.size();
+        stats.nInserted = nDandelionEmbargoInserted;
+        stats.nExpired = nDandelionEmbargoExpired;
+        stats.nRemoved = nDandelionEmbargoRemoved;
+        stats.vExpiredLatency = vDandelionExpiredLatency;
+        stats.vRemovedLatency = vDandelionRemovedLatency;
+    }
+    {
+        LOCK(cs_vNodes);
+        for (const CNode* pnode : vDandelionInbound) {
+            stats.vInbound.push_back(pnode->GetId());
+        }
+        for (const CNode* pnode : vDandelionOutbound) {
+            stats.vOutbound.push_back(pnode->GetId());
+        }
+        for (const CNode* pnode : vDandelionDestination) {
+            stats.vDestinations.push_back(pnode->GetId());
+        }
+        for (const auto& route : mDandelionRoutes) {
+            stats.vRoutes.emplace_back(route.first->GetId(), route.second->GetId());
         }
+        stats.nLocalDestination = localDandelionDestination ? localDandelionDestination->GetId() : -1;
     }
-    return removed;
+    return stats;
 }
 
 CNode* CConnman::SelectFromDandelionDestinations() const
@@ -1656,6 +1740,7 @@ void CConnman::CloseDandelionConnections(const CNode* const pnode)
 }
 
 std::string CConnman::GetDandelionRoutingDataDebugString() const {
+    LOCK(cs_vNodes);
     std::string dandelionRoutingDataDebugString = "";
     dandelionRoutingDataDebugString.append("  vDandelionInbound: ");
     for(auto const& e : vDandelionInbound) {
@@ -1690,6 +1775,7 @@ std::string CConnman::GetDandelionRoutingDataDebugString() const {
 void CConnman::DandelionShuffle() {
     // Dandelion debug message
     LogPrint(BCLog::DANDELION, "Before Dandelion shuffle:\n%s", GetDandelionRoutingDataDebugString());
+    nDandelionShuffles++;
     {
         // Lock node pointers
         LOCK(cs_vNodes);
@@ -2991,6 +3077,12 @@ ServiceFlags CConnman::GetLocalServices() const
     return nLocalServices;
 }
 
+void CConnman::RemoveLocalServices(ServiceFlags services)
+{
+    ServiceFlags flags = nLocalServices;
+    while (!nLocalServices.compare_exchange_weak(flags, ServiceFlags(flags & ~services))) {}
+}
+
 void CConnman::SetBestHeight(int height)
 {
     nBestHeight.store(height, std::memory_order_release);
@@ -24,8 +24,10 @@
 #include <uint256.h>
 #include <threadinterrupt.h>
 
+#include <array>
 #include <atomic>
 #include <deque>
+#include <future>
 #include <stdint.h>
 #include <thread>
 #include <memory>
@@ -39,6 +41,7 @@
 class CScheduler;
 class CNode;
 class BanMan;
+struct PrecheckedTransaction;
 
 /** Default for -whitelistrelay. */
 static const bool DEFAULT_WHITELISTRELAY = true;
@@ -98,6 +101,8 @@ static const int DANDELION_SHUFFLE_INTERVAL = 120;
 static const int DANDELION_EMBARGO_MINIMUM = 10;
 /** The average additional embargo time beyond the minimum amount (seconds) */
 static const int DANDELION_EMBARGO_AVG_ADD = 20;
+/** Default number of recent Dandelion transactions remembered as known to each peer */
+static const unsigned int DEFAULT_DANDELION_INVENTORY_KNOWN = 10000;
 
 typedef int64_t NodeId;
 
@@ -112,6 +117,41 @@ struct AddedNodeInfo
 class CNodeStats;
 class CClientUIInterface;
 
+/** Upper bounds (in seconds) of the Dandelion embargo latency histogram buckets; the last bucket has none */
+static const int64_t DANDELION_LATENCY_BOUNDS[] = {1, 2, 5, 10, 20, 40, 80};
+static const size_t DANDELION_LATENCY_BUCKETS = sizeof(DANDELION_LATENCY_BOUNDS) / sizeof(DANDELION_LATENCY_BOUNDS[0]) + 1;
+
+/** Dandelion relay events counted by CConnman */
+enum class DandelionEvent {
+    STEM_RECEIVED, //!< stem transaction accepted from an inbound peer
+    STEM_LOCAL,    //!< stem transaction originated by this node
+    STEM_RELAYED,  //!< stem transaction passed on to a Dandelion destination
+    FLUFFED,       //!< stem transaction fluffed (broadcast normally) by this node
+};
+
+/** Dandelion relay, embargo and routing statistics */
+struct CDandelionStats
+{
+    uint64_t nStemReceived;
+    uint64_t nStemLocal;
+    uint64_t nStemRelayed;
+    uint64_t nFluffed;
+    uint64_t nShuffles;
+    size_t nEmbargoed;   //!< transactions currently under embargo
+    uint64_t nInserted;  //!< embargoes started
+    uint64_t nExpired;   //!< embargoes that ran out
+    uint64_t nRemoved;   //!< embargoes lifted early because the transaction reached the mempool
+    // Time spent under embargo, bucketed by DANDELION_LATENCY_BOUNDS
+    std::array<uint64_t, DANDELION_LATENCY_BUCKETS> vExpiredLatency;
+    std::array<uint64_t, DANDELION_LATENCY_BUCKETS> vRemovedLatency;
+    // Routing table, by node id
+    std::vector<NodeId> vInbound;
+    std::vector<NodeId> vOutbound;
+    std::vector<NodeId> vDestinations;
+    std::vector<std::pair<NodeId, NodeId>> vRoutes;
+    NodeId nLocalDestination; //!< -1 if not set
+};
+
 struct CSerializedNetMsg
 {
     CSerializedNetMsg() = default;
@@ -297,6 +337,9 @@ public:
     //! that peer during `net_processing.cpp:PushNodeVersion()`.
     ServiceFlags GetLocalServices() const;
 
+    //! Stop offering services to peers connected from now on.
+    void RemoveLocalServices(ServiceFlags services);
+
     //!set the max outbound target in bytes
     void SetMaxOutboundTarget(uint64_t limit);
     uint64_t GetMaxOutboundTarget();
@@ -332,8 +375,6 @@ public:
     void WakeMessageHandler();
 
 
-    // Public Dandelion field
-    std::map<uint256, int64_t> mDandelionEmbargo;
     // Dandelion methods
     bool isDandelionInbound(const CNode* const pnode) const;
     bool isLocalDandelionDestinationSet() const;
@@ -343,6 +384,10 @@ public:
     bool insertDandelionEmbargo(const uint256& hash, const int64_t& embargo);
     bool isTxDandelionEmbargoed(const uint256& hash) const;
     bool removeDandelionEmbargo(const uint256& hash);
+    /** Lift and return the embargoes that expired before nTime (in microseconds), oldest first */
+    std::vector<uint256> popExpiredDandelionEmbargoes(int64_t nTime);
+    void recordDandelionEvent(DandelionEvent event);
+    CDandelionStats getDandelionStats() const;
 
     /** Attempts to obfuscate tx time through exponentially distributed emitting.
         Works assuming that a single interval is used.
@@ -442,12 +487,35 @@ private:
     std::atomic<NodeId> nLastNodeId{0};
     unsigned int nPrevNodeCount{0};
 
-    // Dandelion fields
+    // Dandelion fields, guarded by cs_vNodes. Like ForEachNode() callers
+    // relaying inventory, the Dandelion code takes a peer's cs_inventory or
+    // m_tx_relay->cs_tx_inventory while holding cs_vNodes, so cs_vNodes must
+    // never be taken while holding either of those.
     std::vector<CNode*> vDandelionInbound;
     std::vector<CNode*> vDandelionOutbound;
     std::vector<CNode*> vDandelionDestination;
     CNode* localDandelionDestination = nullptr;
     std::map<CNode*, CNode*> mDandelionRoutes;
+    // Dandelion embargoes, by transaction and ordered by expiry time, so
+    // that checking them only touches the ones that ran out.
+    struct DandelionEmbargo {
+        int64_t nExpiry;
+        int64_t nTimeInserted;
+    };
+    mutable Mutex cs_dandelionEmbargo;
+    std::map<uint256, DandelionEmbargo> mDandelionEmbargo GUARDED_BY(cs_dandelionEmbargo);
+    std::set<std::pair<int64_t, uint256>> setDandelionEmbargoByTime GUARDED_BY(cs_dandelionEmbargo);
+    uint64_t nDandelionEmbargoInserted GUARDED_BY(cs_dandelionEmbargo) = 0;
+    uint64_t nDandelionEmbargoExpired GUARDED_BY(cs_dandelionEmbargo) = 0;
+    uint64_t nDandelionEmbargoRemoved GUARDED_BY(cs_dandelionEmbargo) = 0;
+    std::array<uint64_t, DANDELION_LATENCY_BUCKETS> vDandelionExpiredLatency GUARDED_BY(cs_dandelionEmbargo){};
+    std::array<uint64_t, DANDELION_LATENCY_BUCKETS> vDandelionRemovedLatency GUARDED_BY(cs_dandelionEmbargo){};
+    // Dandelion relay counters
+    std::atomic<uint64_t> nDandelionStemReceived{0};
+    std::atomic<uint64_t> nDandelionStemLocal{0};
+    std::atomic<uint64_t> nDandelionStemRelayed{0};
+    std::atomic<uint64_t> nDandelionFluffed{0};
+    std::atomic<uint64_t> nDandelionShuffles{0};
     // Dandelion helper functions
     CNode* SelectFromDandelionDestinations() const;
     void CloseDandelionConnections(const CNode* const pnode);
@@ -461,12 +529,13 @@ private:
      * connection (in ConnectNode()) under a member also called
      * nLocalServices.
      *
-     * This data is not marked const, but after being set it should not
-     * change. See the note in CNode::nLocalServices documentation.
+     * This data is not marked const, but after being set it should only
+     * change through RemoveLocalServices(), which leaves the peers already
+     * connected alone. See the note in CNode::nLocalServices documentation.
      *
      * \sa CNode::nLocalServices
      */
-    ServiceFlags nLocalServices;
+    std::atomic<ServiceFlags> nLocalServices;
 
     std::unique_ptr<CSemaphore> semOutbound;
     std::unique_ptr<CSemaphore> semAddnode;
@@ -593,6 +662,8 @@ CAddress GetLocalAddress(const CNetAddr *paddrPeer, ServiceFlags nLocalServices)
 extern bool fDiscover;
 extern bool fListen;
 extern bool g_relay_txes;
+/** Size of the per-peer filter of known Dandelion transactions (-dandelioninventoryknown) */
+extern unsigned int g_dandelion_inventory_known;
 
 /** Subversion as sent to the P2P network in `version` messages */
 extern std::string strSubVersion;
@@ -641,6 +712,8 @@ public:
     // Bind address of our side of the connection
     CAddress addrBind;
     uint32_t m_mapped_as;
+    // Memory used by the filter of Dandelion transactions known to the peer
+    size_t m_dandelion_inventory_known_bytes;
 };
 
 
@@ -858,13 +931,13 @@ public:
 
         mutable RecursiveMutex cs_tx_inventory;
         CRollingBloomFilter filterInventoryKnown GUARDED_BY(cs_tx_inventory){50000, 0.000001};
-        // Set of Dandelion transactions that should be known to this peer
-        std::set<uint256> setDandelionInventoryKnown;
+        // Recent Dandelion transactions that should be known to this peer
+        CRollingBloomFilter filterDandelionInventoryKnown GUARDED_BY(cs_tx_inventory){g_dandelion_inventory_known, 0.000001};
         // Set of transaction ids we still have to announce.
         // They are sorted by the mempool before relay, so the order is not important.
         std::set<uint256> setInventoryTxToSend;
         // List of Dandelion transaction ids to announce.
-        std::vector<uint256> vInventoryDandelionTxToSend;
+        std::vector<uint256> vInventoryDandelionTxToSend GUARDED_BY(cs_tx_inventory);
         // Used for BIP35 mempool sending
         bool fSendMempool GUARDED_BY(cs_tx_inventory){false};
         // Last time a "MEMPOOL" request was serviced.
@@ -902,6 +975,9 @@ public:
 
     std::set<uint256> orphan_work_set;
 
+    //! Transactions from this peer that are being prechecked, in the order they were received
+    std::deque<std::pair<std::shared_ptr<PrecheckedTransaction>, std::future<void>>> tx_precheck_queue;
+
     CNode(NodeId id, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn, SOCKET hSocketIn, const CAddress &addrIn, uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn, const CAddress &addrBindIn, const std::string &addrNameIn = "", bool fInboundIn = false, bool block_relay_only = false);
     ~CNode();
     CNode(const CNode&) = delete;
@@ -1019,6 +1095,21 @@ public:
         }
     }
 
+    void AddDandelionInventoryKnown(const uint256& hash)
+    {
+        if (m_tx_relay != nullptr) {
+            LOCK(m_tx_relay->cs_tx_inventory);
+            m_tx_relay->filterDandelionInventoryKnown.insert(hash);
+        }
+    }
+
+    bool IsDandelionInventoryKnown(const uint256& hash) const
+    {
+        if (m_tx_relay == nullptr) return false;
+        LOCK(m_tx_relay->cs_tx_inventory);
+        return m_tx_relay->filterDandelionInventoryKnown.contains(hash);
+    }
+
     void PushInventory(const CInv& inv)
     {
         if (inv.type == MSG_TX && m_tx_relay != nullptr) {
@@ -1026,8 +1117,9 @@ public:
             if (!m_tx_relay->filterInventoryKnown.contains(inv.hash)) {
                 m_tx_relay->setInventoryTxToSend.insert(inv.hash);
             }
-        } else if (inv.type == MSG_DANDELION_TX) {
-            if (m_tx_relay->setDandelionInventoryKnown.count(inv.hash)==0) {
+        } else if (inv.type == MSG_DANDELION_TX && m_tx_relay != nullptr) {
+            LOCK(m_tx_relay->cs_tx_inventory);
+            if (!m_tx_relay->filterDandelionInventoryKnown.contains(inv.hash)) {
                 m_tx_relay->vInventoryDandelionTxToSend.push_back(inv.hash);
             }
         } else if (inv.type == MSG_BLOCK) {
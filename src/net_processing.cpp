@@ -15,6 +15,7 @@
 #include <merkleblock.h>
 #include <netmessagemaker.h>
 #include <netbase.h>
+#include <node/blockcache.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <primitives/block.h>
@@ -68,6 +69,8 @@ static constexpr int HISTORICAL_BLOCK_AGE = 7 * 24 * 60 * 60;
 static constexpr int32_t MAX_PEER_TX_IN_FLIGHT = 100;
 /** Maximum number of announced transactions from a peer */
 static constexpr int32_t MAX_PEER_TX_ANNOUNCEMENTS = 2 * MAX_INV_SZ;
+/** Maximum number of transactions from a peer that are being prechecked at once */
+static constexpr size_t MAX_PEER_TX_PRECHECKS = 100;
 /** How many microseconds to delay requesting transactions from inbound peers */
 static constexpr std::chrono::microseconds INBOUND_PEER_TX_DELAY{std::chrono::seconds{2}};
 /** How long to wait (in microseconds) before downloading a transaction from an additional peer */
@@ -1376,42 +1379,49 @@ static void RelayDandelionTransaction(const CTransaction& tx, CConnman* connman,
     FastRandomContext rng;
     if (rng.randrange(100)<DANDELION_FLUFF) {
         LogPrint(BCLog::DANDELION, "Dandelion fluff: %s\n", tx.GetHash().ToString());
+        connman->recordDandelionEvent(DandelionEvent::FLUFFED);
         TxValidationState state;
         CTransactionRef ptx = stempool.get(tx.GetHash());
         std::list<CTransactionRef> lRemovedTxn;
         AcceptToMemoryPool(mempool, state, ptx, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */);
         LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
                  pfrom->GetId(), tx.GetHash().ToString(), mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+        connman->removeDandelionEmbargo(tx.GetHash());
         RelayTransaction(tx.GetHash(), *connman);
     } else {
         CInv inv(MSG_DANDELION_TX, tx.GetHash());
         CNode* destination = connman->getDandelionDestination(pfrom);
         if (destination!=nullptr) {
             destination->PushInventory(inv);
+            connman->recordDandelionEvent(DandelionEvent::STEM_RELAYED);
         }
     }
 }
 
 static void CheckDandelionEmbargoes(CConnman* connman)
 {
-    int64_t nCurrTime = GetTimeMicros();
-    for (auto iter=connman->mDandelionEmbargo.begin(); iter!=connman->mDandelionEmbargo.end();) {
-        if (mempool.exists(iter->first)) {
-            LogPrint(BCLog::DANDELION, "Embargoed dandeliontx %s found in mempool; removing from embargo map\n", iter->first.ToString());
-            iter = connman->mDandelionEmbargo.erase(iter);
-        } else if (iter->second < nCurrTime) {
-            LogPrint(BCLog::DANDELION, "dandeliontx %s embargo expired\n", iter->first.ToString());
-            TxValidationState state;
-            CTransactionRef ptx = stempool.get(iter->first);
-            std::list<CTransactionRef> lRemovedTxn;
-            AcceptToMemoryPool(mempool, state, ptx, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */);
-            LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: accepted %s (poolsz %u txn, %u kB)\n",
-                     iter->first.ToString(), mempool.size(), mempool.DynamicMemoryUsage() / 1000);
-            RelayTransaction(ptx->GetHash(), *connman);
-            iter = connman->mDandelionEmbargo.erase(iter);
-        } else {
-            iter++;
+    const std::vector<uint256> vExpired = connman->popExpiredDandelionEmbargoes(GetTimeMicros());
+    if (vExpired.empty()) return;
+
+    LOCK(cs_main);
+    for (const uint256& hash : vExpired) {
+        if (mempool.exists(hash)) {
+            LogPrint(BCLog::DANDELION, "Embargoed dandeliontx %s found in mempool; removing from embargo map\n", hash.ToString());
+            continue;
         }
+        CTransactionRef ptx = stempool.get(hash);
+        if (!ptx) {
+            // Mined, conflicted or evicted while under embargo
+            LogPrint(BCLog::DANDELION, "dandeliontx %s embargo expired but it is no longer in the stempool\n", hash.ToString());
+            continue;
+        }
+        LogPrint(BCLog::DANDELION, "dandeliontx %s embargo expired\n", hash.ToString());
+        TxValidationState state;
+        std::list<CTransactionRef> lRemovedTxn;
+        AcceptToMemoryPool(mempool, state, ptx, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */);
+        LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: accepted %s (poolsz %u txn, %u kB)\n",
+                 hash.ToString(), mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+        RelayTransaction(hash, *connman);
     }
 }
 
@@ -1527,18 +1537,17 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
         } else if (inv.type == MSG_WITNESS_BLOCK) {
             // Fast-path: in this case it is possible to serve the block directly from disk,
             // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
+            RawBlockData block_data;
+            if (!g_block_cache.GetRawBlock(block_data, pindex, chainparams.MessageStart())) {
                 assert(!"cannot load block from disk");
             }
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block_data.data));
             // Don't set pblock as we've sent the block
         } else {
-            // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
+            // Send block from the cache or from disk
+            pblock = g_block_cache.GetBlock(pindex, consensusParams);
+            if (!pblock)
                 assert(!"cannot load block from disk");
-            pblock = pblockRead;
         }
         if (pblock) {
             if (inv.type == MSG_BLOCK)
@@ -1649,10 +1658,10 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
                 auto txinfo = stempool.info(inv.hash);
                 uint256 dandelionServiceDiscoveryHash;
                 dandelionServiceDiscoveryHash.SetHex("0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
-                if (txinfo.tx && !connman->isDandelionInbound(pfrom) && pfrom->m_tx_relay->setDandelionInventoryKnown.count(inv.hash)!=0) {
+                if (txinfo.tx && !connman->isDandelionInbound(pfrom) && pfrom->IsDandelionInventoryKnown(inv.hash)) {
                     connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::DANDELIONTX, *txinfo.tx));
                     push = true;
-                } else if (inv.hash==dandelionServiceDiscoveryHash && pfrom->m_tx_relay->setDandelionInventoryKnown.count(inv.hash)!=0) {
+                } else if (inv.hash==dandelionServiceDiscoveryHash && pfrom->IsDandelionInventoryKnown(inv.hash)) {
                     LogPrint(BCLog::DANDELION, "Peer %d supports Dandelion\n", pfrom->GetId());
                     pfrom->fSupportsDandelion = true;
                     push = true;
@@ -1660,7 +1669,7 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
             } else if(inv.type == MSG_TX || inv.type == MSG_WITNESS_TX) {
                 auto mi = mapRelay.find(inv.hash);
                 int nSendFlags = (inv.type == MSG_TX ? SERIALIZE_TRANSACTION_NO_WITNESS : 0);
-                if (!pfrom->fSupportsDandelion && !connman->isDandelionInbound(pfrom) && pfrom->m_tx_relay->setDandelionInventoryKnown.count(inv.hash)!=0) {
+                if (!pfrom->fSupportsDandelion && !connman->isDandelionInbound(pfrom) && pfrom->IsDandelionInventoryKnown(inv.hash)) {
                     auto txinfo = stempool.info(inv.hash);
                     if (txinfo.tx) {
                         connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::TX, *txinfo.tx));
@@ -1947,12 +1956,10 @@ void static ProcessOrphanTx(CConnman* connman, CTxMemPool& mempool, std::set<uin
         // MaybePunishNodeForTx based on the source peer from the orphan map, not based on the peer
         // that relayed the previous transaction).
         TxValidationState orphan_state;
-        TxValidationState stateDummyDandelion;
-
 
         if (setMisbehaving.count(fromPeer)) continue;
-        if (AcceptToMemoryPool(mempool, orphan_state, porphanTx, &removed_txn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
-            AcceptToMemoryPool(stempool, stateDummyDandelion, porphanTx, &removed_txn, false, 0);
+        // Changes to mempool should also be made to Dandelion stempool
+        if (AcceptToMemoryPoolAndStemPool(mempool, stempool, orphan_state, porphanTx, &removed_txn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
             LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
             RelayTransaction(orphanHash, *connman);
             for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
@@ -1992,6 +1999,165 @@ void static ProcessOrphanTx(CConnman* connman, CTxMemPool& mempool, std::set<uin
     }
 }
 
+/**
+ * The part of processing a transaction from a peer that needs cs_main: accept
+ * it to the mempool, relay it, and handle its orphans or its rejection.
+ */
+static void AcceptPrecheckedTransaction(CNode* pfrom, PrecheckedTransaction& prechecked, CTxMemPool& mempool, CConnman* connman)
+{
+    const CTransactionRef& ptx = prechecked.tx;
+    const CTransaction& tx = *ptx;
+    CInv inv(MSG_TX, tx.GetHash());
+
+    LOCK2(cs_main, g_cs_orphans);
+
+    TxValidationState state;
+
+    CNodeState* nodestate = State(pfrom->GetId());
+    nodestate->m_tx_download.m_tx_announced.erase(inv.hash);
+    nodestate->m_tx_download.m_tx_in_flight.erase(inv.hash);
+    EraseTxRequest(inv.hash);
+
+    std::list<CTransactionRef> lRemovedTxn;
+
+    if (!AlreadyHave(inv, mempool) &&
+        // Changes to mempool should also be made to Dandelion stempool
+        AcceptToMemoryPoolAndStemPool(mempool, stempool, state, ptx, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */, &prechecked)) {
+        if (connman->removeDandelionEmbargo(tx.GetHash())) {
+            LogPrint(BCLog::DANDELION, "Embargoed dandeliontx %s found in mempool; removing from embargo map\n", tx.GetHash().ToString());
+        }
+        mempool.check(&::ChainstateActive().CoinsTip());
+        // Changes to mempool should also be made to Dandelion stempool
+        stempool.check(&::ChainstateActive().CoinsTip());
+        RelayTransaction(tx.GetHash(), *connman);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(inv.hash, i));
+            if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
+                for (const auto& elem : it_by_prev->second) {
+                    pfrom->orphan_work_set.insert(elem->first);
+                }
+            }
+        }
+
+        pfrom->nLastTXTime = GetTime();
+
+        LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
+            pfrom->GetId(),
+            tx.GetHash().ToString(),
+            mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+
+        // Recursively process any orphan transactions that depended on this one
+        ProcessOrphanTx(connman, mempool, pfrom->orphan_work_set, lRemovedTxn);
+    }
+    else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS)
+    {
+        bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
+        for (const CTxIn& txin : tx.vin) {
+            if (recentRejects->contains(txin.prevout.hash)) {
+                fRejectedParents = true;
+                break;
+            }
+        }
+        if (!fRejectedParents) {
+            uint32_t nFetchFlags = GetFetchFlags(pfrom);
+            const auto current_time = GetTime<std::chrono::microseconds>();
+
+            for (const CTxIn& txin : tx.vin) {
+                CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
+                pfrom->AddInventoryKnown(_inv);
+                if (!AlreadyHave(_inv, mempool)) RequestTx(State(pfrom->GetId()), _inv.hash, current_time);
+            }
+            AddOrphanTx(ptx, pfrom->GetId());
+
+            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded (see CVE-2012-3789)
+            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+            if (nEvicted > 0) {
+                LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
+            }
+        } else {
+            LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
+            // We will continue to reject this tx since it has rejected
+            // parents so avoid re-requesting it from other peers.
+            recentRejects->insert(tx.GetHash());
+        }
+    } else {
+        if (!tx.HasWitness() && state.GetResult() != TxValidationResult::TX_WITNESS_MUTATED) {
+            // Do not use rejection cache for witness transactions or
+            // witness-stripped transactions, as they can have been malleated.
+            // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
+            assert(recentRejects);
+            recentRejects->insert(tx.GetHash());
+            if (RecursiveDynamicUsage(*ptx) < 100000) {
+                AddToCompactExtraTransactions(ptx);
+            }
+        } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
+            AddToCompactExtraTransactions(ptx);
+        }
+
+        if (pfrom->HasPermission(PF_FORCERELAY)) {
+            // Always relay transactions received from whitelisted peers, even
+            // if they were already in the mempool,
+            // allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            if (!mempool.exists(tx.GetHash())) {
+                LogPrintf("Not relaying non-mempool transaction %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
+            } else {
+                LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
+                RelayTransaction(tx.GetHash(), *connman);
+            }
+        }
+    }
+
+    for (const CTransactionRef& removedTx : lRemovedTxn)
+        AddToCompactExtraTransactions(removedTx);
+
+    // If a tx has been detected by recentRejects, we will have reached
+    // this point and the tx will have been ignored. Because we haven't run
+    // the tx through AcceptToMemoryPool, we won't have computed a DoS
+    // score for it or determined exactly why we consider it invalid.
+    //
+    // This means we won't penalize any peer subsequently relaying a DoSy
+    // tx (even if we penalized the first peer who gave it to us) because
+    // we have to account for recentRejects showing false positives. In
+    // other words, we shouldn't penalize a peer if we aren't *sure* they
+    // submitted a DoSy tx.
+    //
+    // Note that recentRejects doesn't just record DoSy or invalid
+    // transactions, but any tx not accepted by the mempool, which may be
+    // due to node policy (vs. consensus). So we can't blanket penalize a
+    // peer simply for relaying a tx that our recentRejects has caught,
+    // regardless of false positives.
+
+    if (state.IsInvalid())
+    {
+        LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
+            pfrom->GetId(),
+            state.ToString());
+        MaybePunishNodeForTx(pfrom->GetId(), state);
+    }
+}
+
+/**
+ * Accept the transactions in the peer's tx_precheck_queue whose precheck is
+ * done, without waiting for the others. One that spends a transaction still
+ * being prechecked becomes an orphan, and is accepted through the peer's
+ * orphan_work_set once its parent is.
+ */
+static void ProcessPrecheckedTransactions(CNode* pfrom, CTxMemPool& mempool, CConnman* connman)
+{
+    auto it = pfrom->tx_precheck_queue.begin();
+    while (it != pfrom->tx_precheck_queue.end()) {
+        if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+        std::shared_ptr<PrecheckedTransaction> prechecked = std::move(it->first);
+        it = pfrom->tx_precheck_queue.erase(it);
+        AcceptPrecheckedTransaction(pfrom, *prechecked, mempool, connman);
+    }
+}
+
 bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CTxMemPool& mempool, CConnman* connman, BanMan* banman, const std::atomic<bool>& interruptMsgProc)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(msg_type), vRecv.size(), pfrom->GetId());
@@ -2366,8 +2532,8 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
                 }
             }
             else if (inv.type == MSG_DANDELION_TX) {
-                auto result = pfrom->m_tx_relay->setDandelionInventoryKnown.insert(inv.hash);
-                fAlreadyHave = !result.second;
+                fAlreadyHave = pfrom->IsDandelionInventoryKnown(inv.hash);
+                pfrom->AddDandelionInventoryKnown(inv.hash);
                 uint256 dandelionServiceDiscoveryHash;
                 dandelionServiceDiscoveryHash.SetHex("0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
                 if (fBlocksOnly) {
@@ -2527,11 +2693,10 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
             return true;
         }
 
-        CBlock block;
-        bool ret = ReadBlockFromDisk(block, pindex, chainparams.GetConsensus());
-        assert(ret);
+        std::shared_ptr<const CBlock> pblock = g_block_cache.GetBlock(pindex, chainparams.GetConsensus());
+        assert(pblock);
 
-        SendBlockTransactions(block, req, pfrom, connman);
+        SendBlockTransactions(*pblock, req, pfrom, connman);
         return true;
     }
 
@@ -2620,137 +2785,27 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        LOCK2(cs_main, g_cs_orphans);
-
-        TxValidationState state;
-        TxValidationState dummyState; // Dummy state for Dandelion stempool
-
-
-        CNodeState* nodestate = State(pfrom->GetId());
-        nodestate->m_tx_download.m_tx_announced.erase(inv.hash);
-        nodestate->m_tx_download.m_tx_in_flight.erase(inv.hash);
-        EraseTxRequest(inv.hash);
-
-        std::list<CTransactionRef> lRemovedTxn;
-
-        if (!AlreadyHave(inv, mempool) &&
-            AcceptToMemoryPool(mempool, state, ptx, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
-            // Changes to mempool should also be made to Dandelion stempool
-            AcceptToMemoryPool(stempool, dummyState, ptx, &lRemovedTxn, false, 0);
-            if (connman->isTxDandelionEmbargoed(tx.GetHash())) {
-                LogPrint(BCLog::DANDELION, "Embargoed dandeliontx %s found in mempool; removing from embargo map\n", tx.GetHash().ToString());
-                connman->removeDandelionEmbargo(tx.GetHash());
-            }
-            mempool.check(&::ChainstateActive().CoinsTip());
-            // Changes to mempool should also be made to Dandelion stempool
-            stempool.check(&::ChainstateActive().CoinsTip());
-            RelayTransaction(tx.GetHash(), *connman);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(inv.hash, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto& elem : it_by_prev->second) {
-                        pfrom->orphan_work_set.insert(elem->first);
-                    }
-                }
-            }
-
-            pfrom->nLastTXTime = GetTime();
-
-            LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
-                pfrom->GetId(),
-                tx.GetHash().ToString(),
-                mempool.size(), mempool.DynamicMemoryUsage() / 1000);
-
-            // Recursively process any orphan transactions that depended on this one
-            ProcessOrphanTx(connman, mempool, pfrom->orphan_work_set, lRemovedTxn);
-        }
-        else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS)
+        auto prechecked = std::make_shared<PrecheckedTransaction>(ptx);
         {
-            bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
-            for (const CTxIn& txin : tx.vin) {
-                if (recentRejects->contains(txin.prevout.hash)) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                uint32_t nFetchFlags = GetFetchFlags(pfrom);
-                const auto current_time = GetTime<std::chrono::microseconds>();
-
-                for (const CTxIn& txin : tx.vin) {
-                    CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
-                    pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv, mempool)) RequestTx(State(pfrom->GetId()), _inv.hash, current_time);
-                }
-                AddOrphanTx(ptx, pfrom->GetId());
-
-                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded (see CVE-2012-3789)
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-                if (nEvicted > 0) {
-                    LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
-                }
-            } else {
-                LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
-                // We will continue to reject this tx since it has rejected
-                // parents so avoid re-requesting it from other peers.
-                recentRejects->insert(tx.GetHash());
-            }
-        } else {
-            if (!tx.HasWitness() && state.GetResult() != TxValidationResult::TX_WITNESS_MUTATED) {
-                // Do not use rejection cache for witness transactions or
-                // witness-stripped transactions, as they can have been malleated.
-                // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                assert(recentRejects);
-                recentRejects->insert(tx.GetHash());
-                if (RecursiveDynamicUsage(*ptx) < 100000) {
-                    AddToCompactExtraTransactions(ptx);
-                }
-            } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
-                AddToCompactExtraTransactions(ptx);
-            }
-
-            if (pfrom->HasPermission(PF_FORCERELAY)) {
-                // Always relay transactions received from whitelisted peers, even
-                // if they were already in the mempool,
-                // allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                if (!mempool.exists(tx.GetHash())) {
-                    LogPrintf("Not relaying non-mempool transaction %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
-                } else {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
-                    RelayTransaction(tx.GetHash(), *connman);
-                }
+            // Don't precheck a transaction that is known or was recently
+            // rejected (see AlreadyHave); AcceptPrecheckedTransaction() skips
+            // the mempool for it, and cs_main is held until it has.
+            LOCK(cs_main);
+            if (AlreadyHave(inv, mempool)) {
+                AcceptPrecheckedTransaction(pfrom, *prechecked, mempool, connman);
+                return true;
             }
         }
 
-        for (const CTransactionRef& removedTx : lRemovedTxn)
-            AddToCompactExtraTransactions(removedTx);
-
-        // If a tx has been detected by recentRejects, we will have reached
-        // this point and the tx will have been ignored. Because we haven't run
-        // the tx through AcceptToMemoryPool, we won't have computed a DoS
-        // score for it or determined exactly why we consider it invalid.
-        //
-        // This means we won't penalize any peer subsequently relaying a DoSy
-        // tx (even if we penalized the first peer who gave it to us) because
-        // we have to account for recentRejects showing false positives. In
-        // other words, we shouldn't penalize a peer if we aren't *sure* they
-        // submitted a DoSy tx.
-        //
-        // Note that recentRejects doesn't just record DoSy or invalid
-        // transactions, but any tx not accepted by the mempool, which may be
-        // due to node policy (vs. consensus). So we can't blanket penalize a
-        // peer simply for relaying a tx that our recentRejects has caught,
-        // regardless of false positives.
-
-        if (state.IsInvalid())
-        {
-            LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
-                pfrom->GetId(),
-                state.ToString());
-            MaybePunishNodeForTx(pfrom->GetId(), state);
+        if (g_parallel_tx_prechecks) {
+            // The transaction is accepted once its precheck is done, see
+            // ProcessMessages(), which the precheck wakes up for it.
+            pfrom->tx_precheck_queue.emplace_back(prechecked, PrecheckTransactionAsync(prechecked, [connman] { connman->WakeMessageHandler(); }));
+            return true;
         }
+
+        PrecheckTransaction(*prechecked);
+        AcceptPrecheckedTransaction(pfrom, *prechecked, mempool, connman);
         return true;
     }
 
@@ -2769,6 +2824,7 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
                 if (ret) {
                     LogPrint(BCLog::MEMPOOL, "AcceptToStemPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
                              pfrom->GetId(), tx.GetHash().ToString(), stempool.size(), stempool.DynamicMemoryUsage() / 1000);
+                    connman->recordDandelionEvent(DandelionEvent::STEM_RECEIVED);
                     int64_t nCurrTime = GetTimeMicros();
                     int64_t nEmbargo = 1000000*DANDELION_EMBARGO_MINIMUM+PoissonNextSend(nCurrTime, DANDELION_EMBARGO_AVG_ADD);
                     connman->insertDandelionEmbargo(tx.GetHash(),nEmbargo);
@@ -3445,6 +3501,9 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         }
     }
 
+    // Accept the transactions whose precheck is done, without waiting for the others
+    ProcessPrecheckedTransactions(pfrom, m_mempool, connman);
+
     if (pfrom->fDisconnect)
         return false;
 
@@ -3462,6 +3521,15 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty())
             return false;
+        // Further transactions from the peer are prechecked while the ones
+        // before them are, up to MAX_PEER_TX_PRECHECKS at once, but any other
+        // message waits until those are accepted, so that it is processed in
+        // order. Leave it queued: the next precheck to finish wakes us up.
+        if (!pfrom->tx_precheck_queue.empty() &&
+            (pfrom->vProcessMsg.front().m_command != NetMsgType::TX ||
+             pfrom->tx_precheck_queue.size() >= MAX_PEER_TX_PRECHECKS)) {
+            return false;
+        }
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().m_raw_message_size;
@@ -3878,10 +3946,9 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                         }
                     }
                     if (!fGotBlockFromCache) {
-                        CBlock block;
-                        bool ret = ReadBlockFromDisk(block, pBestIndex, consensusParams);
-                        assert(ret);
-                        CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
+                        std::shared_ptr<const CBlock> pblock = g_block_cache.GetBlock(pBestIndex, consensusParams);
+                        assert(pblock);
+                        CBlockHeaderAndShortTxIDs cmpctblock(*pblock, state.fWantsCmpctWitness);
                         connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                     }
                     state.pindexBestHeaderSent = pBestIndex;
@@ -3947,23 +4014,25 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             pto->vInventoryBlockToSend.clear();
 
             // Add Dandelion transactions
-            for (const uint256& hash : pto->m_tx_relay->vInventoryDandelionTxToSend) {
-                pto->m_tx_relay->setDandelionInventoryKnown.insert(hash);
+            if (pto->m_tx_relay != nullptr) {
+                LOCK(pto->m_tx_relay->cs_tx_inventory);
                 uint256 dandelionServiceDiscoveryHash;
                 dandelionServiceDiscoveryHash.SetHex("0xffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
-                if (!pto->fSupportsDandelion && hash!=dandelionServiceDiscoveryHash) {
-                    vInv.push_back(CInv(MSG_TX, hash));
-                } else {
-                    vInv.push_back(CInv(MSG_DANDELION_TX, hash));
-                }
-                if (vInv.size() == MAX_INV_SZ) {
-                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
-                    vInv.clear();
+                for (const uint256& hash : pto->m_tx_relay->vInventoryDandelionTxToSend) {
+                    pto->m_tx_relay->filterDandelionInventoryKnown.insert(hash);
+                    if (!pto->fSupportsDandelion && hash!=dandelionServiceDiscoveryHash) {
+                        vInv.push_back(CInv(MSG_TX, hash));
+                    } else {
+                        vInv.push_back(CInv(MSG_DANDELION_TX, hash));
+                    }
+                    if (vInv.size() == MAX_INV_SZ) {
+                        connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+                        vInv.clear();
+                    }
                 }
+                pto->m_tx_relay->vInventoryDandelionTxToSend.clear();
             }
 
-            pto->m_tx_relay->vInventoryDandelionTxToSend.clear();
-
             if (pto->m_tx_relay != nullptr) {
                 LOCK(pto->m_tx_relay->cs_tx_inventory);
                 // Check whether periodic sends should happen
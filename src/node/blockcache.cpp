@@ -0,0 +1,155 @@
+// Copyright (c) 2020 The NIX Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockcache.h>
+
+#include <chain.h>
+#include <clientversion.h>
+#include <core_memusage.h>
+#include <memusage.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <validation.h>
+
+BlockCache g_block_cache{DEFAULT_BLOCK_CACHE_SIZE << 20};
+
+static size_t EntryUsage(const std::shared_ptr<const CBlock>& block, const std::shared_ptr<const std::vector<uint8_t>>& raw)
+{
+    // The list and map nodes that track the entry.
+    size_t usage = 2 * memusage::MallocUsage(64);
+    if (block) usage += memusage::MallocUsage(sizeof(CBlock)) + RecursiveDynamicUsage(*block);
+    if (raw) usage += memusage::MallocUsage(sizeof(*raw)) + memusage::DynamicUsage(*raw);
+    return usage;
+}
+
+void BlockCache::SetMaxUsage(size_t max_usage)
+{
+    LOCK(m_mutex);
+    m_max_usage = max_usage;
+    Trim();
+}
+
+bool BlockCache::IsRecent(const CBlockIndex* pindex) const
+{
+    return pindex->nHeight + BLOCK_CACHE_MAX_DEPTH >= WITH_LOCK(cs_main, return ::ChainActive().Height());
+}
+
+BlockCache::Entry* BlockCache::Find(const uint256& hash)
+{
+    auto it = m_index.find(hash);
+    if (it == m_index.end()) return nullptr;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return &m_entries.front();
+}
+
+void BlockCache::Insert(const uint256& hash, std::shared_ptr<const CBlock> block, std::shared_ptr<const std::vector<uint8_t>> raw)
+{
+    if (m_max_usage == 0) return;
+
+    Entry* entry = Find(hash);
+    if (!entry) {
+        m_entries.emplace_front();
+        entry = &m_entries.front();
+        entry->hash = hash;
+        m_index.emplace(hash, m_entries.begin());
+    }
+    // Another thread may have read the same block meanwhile.
+    if (block && !entry->block) entry->block = std::move(block);
+    if (raw && !entry->raw) entry->raw = std::move(raw);
+
+    m_usage -= entry->usage;
+    entry->usage = EntryUsage(entry->block, entry->raw);
+    m_usage += entry->usage;
+    Trim();
+}
+
+void BlockCache::Trim()
+{
+    while (m_usage > m_max_usage && !m_entries.empty()) {
+        const Entry& last = m_entries.back();
+        m_usage -= last.usage;
+        m_index.erase(last.hash);
+        m_entries.pop_back();
+    }
+}
+
+std::shared_ptr<const CBlock> BlockCache::GetBlock(const CBlockIndex* pindex, const Consensus::Params& consensus_params)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    std::shared_ptr<const std::vector<uint8_t>> raw;
+    {
+        LOCK(m_mutex);
+        if (Entry* entry = Find(hash)) {
+            if (entry->block) {
+                ++m_hits;
+                return entry->block;
+            }
+            raw = entry->raw;
+        }
+        ++m_misses;
+    }
+
+    // Read the block outside of the lock, from its cached serialization if there is one.
+    auto block = std::make_shared<CBlock>();
+    if (raw) {
+        try {
+            SpanReader(SER_DISK, CLIENT_VERSION, Span<const uint8_t>(raw->data(), raw->size())) >> *block;
+        } catch (const std::exception&) {
+            return nullptr;
+        }
+    } else if (!ReadBlockFromDisk(*block, pindex, consensus_params)) {
+        return nullptr;
+    }
+
+    if (IsRecent(pindex)) {
+        LOCK(m_mutex);
+        Insert(hash, block, nullptr);
+    }
+    return block;
+}
+
+bool BlockCache::GetRawBlock(RawBlockData& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    {
+        LOCK(m_mutex);
+        Entry* entry = Find(hash);
+        if (entry && entry->raw) {
+            ++m_hits;
+            block.owner = entry->raw;
+            block.data = Span<const uint8_t>(entry->raw->data(), entry->raw->size());
+            return true;
+        }
+        ++m_misses;
+    }
+
+    if (!ReadRawBlockFromDisk(block, pindex, message_start)) {
+        return false;
+    }
+
+    if (IsRecent(pindex)) {
+        auto raw = std::make_shared<const std::vector<uint8_t>>(block.data.begin(), block.data.end());
+        block.owner = raw;
+        block.buffer.clear();
+        block.data = Span<const uint8_t>(raw->data(), raw->size());
+
+        LOCK(m_mutex);
+        Insert(hash, nullptr, std::move(raw));
+    }
+    return true;
+}
+
+void BlockCache::Clear()
+{
+    LOCK(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_usage = 0;
+}
+
+BlockCache::Stats BlockCache::GetStats() const
+{
+    LOCK(m_mutex);
+    return Stats{m_hits, m_misses, m_entries.size(), m_usage, m_max_usage};
+}
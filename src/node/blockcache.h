@@ -0,0 +1,97 @@
+// Copyright (c) 2020 The NIX Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKCACHE_H
+#define BITCOIN_NODE_BLOCKCACHE_H
+
+#include <protocol.h> // For CMessageHeader::MessageStartChars
+#include <sync.h>
+#include <uint256.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+struct RawBlockData;
+namespace Consensus {
+struct Params;
+}
+
+/** Default for -blockcachesize, in MiB */
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 32;
+/** Blocks deeper than this below the tip are read from disk without being cached */
+static const int BLOCK_CACHE_MAX_DEPTH = 288;
+
+/**
+ * A size bounded cache of recently read blocks, shared by everything that serves blocks to peers
+ * and clients. For every block it keeps the deserialized block and its serialization as stored in
+ * the block files, as far as they have been asked for, and it evicts the least recently used
+ * blocks first.
+ *
+ * Only blocks near the tip are cached, so that peers syncing old blocks from us do not push out
+ * the ones that many peers ask for at once.
+ */
+class BlockCache
+{
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t blocks;
+        size_t usage;
+        size_t max_usage;
+    };
+
+    explicit BlockCache(size_t max_usage) : m_max_usage(max_usage) {}
+
+    /** Change the maximum memory usage. Zero disables the cache. */
+    void SetMaxUsage(size_t max_usage);
+
+    /** Get a block, reading it from disk if it is not cached. Returns nullptr if it cannot be read. */
+    std::shared_ptr<const CBlock> GetBlock(const CBlockIndex* pindex, const Consensus::Params& consensus_params);
+
+    /** Get the serialization of a block as stored in its block file, reading it if it is not cached. */
+    bool GetRawBlock(RawBlockData& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+
+    void Clear();
+
+    Stats GetStats() const;
+
+private:
+    struct Entry {
+        uint256 hash;
+        std::shared_ptr<const CBlock> block;
+        std::shared_ptr<const std::vector<uint8_t>> raw;
+        size_t usage{0};
+    };
+
+    mutable Mutex m_mutex;
+    //! Most recently used first
+    std::list<Entry> m_entries GUARDED_BY(m_mutex);
+    std::map<uint256, std::list<Entry>::iterator> m_index GUARDED_BY(m_mutex);
+    size_t m_usage GUARDED_BY(m_mutex){0};
+    size_t m_max_usage GUARDED_BY(m_mutex);
+    uint64_t m_hits GUARDED_BY(m_mutex){0};
+    uint64_t m_misses GUARDED_BY(m_mutex){0};
+
+    /** Whether a block is close enough to the tip to be cached. */
+    bool IsRecent(const CBlockIndex* pindex) const;
+
+    /** Find the entry of a block and mark it as used. */
+    Entry* Find(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    /** Add the block and/or its serialization to its entry. */
+    void Insert(const uint256& hash, std::shared_ptr<const CBlock> block, std::shared_ptr<const std::vector<uint8_t>> raw) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    void Trim() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+};
+
+/** The cache of recently read blocks. Its size is set from -blockcachesize at startup. */
+extern BlockCache g_block_cache;
+
+#endif // BITCOIN_NODE_BLOCKCACHE_H
@@ -10,8 +10,18 @@
 #include <uint256.h>
 
 #include <cstdint>
+#include <vector>
 
 class CCoinsView;
+class COutPoint;
+class CScript;
+struct Coin;
+
+enum class CoinStatsHashType {
+    HASH_SERIALIZED,
+    MUHASH,
+    NONE,
+};
 
 struct CCoinsStats
 {
@@ -21,14 +31,28 @@ struct CCoinsStats
     uint64_t nTransactionOutputs{0};
     uint64_t nBogoSize{0};
     uint256 hashSerialized{};
+    //! MuHash3072 of the set, see TxOutSer()
+    uint256 muhash{};
     uint64_t nDiskSize{0};
     CAmount nTotalAmount{0};
 
     //! The number of coins contained.
     uint64_t coins_count{0};
+
+    //! Whether the stats were read from the coinstats index rather than
+    //! computed from the coins view. nTransactions and nDiskSize are not set then.
+    bool index_used{false};
 };
 
-//! Calculate statistics about the unspent transaction output set
-bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats);
+//! Size of a coin as counted in CCoinsStats::nBogoSize
+uint64_t GetBogoSize(const CScript& script_pub_key);
+
+//! Serialization of a coin as it is inserted into the MuHash3072 of the UTXO set
+std::vector<unsigned char> TxOutSer(const COutPoint& outpoint, const Coin& coin);
+
+//! Calculate statistics about the unspent transaction output set. Unless the
+//! legacy serialized hash is asked for, the stats are looked up in the
+//! coinstats index when it is enabled.
+bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats, CoinStatsHashType hash_type = CoinStatsHashType::HASH_SERIALIZED);
 
 #endif // BITCOIN_NODE_COINSTATS_H
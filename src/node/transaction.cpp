@@ -38,7 +38,6 @@ TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef t
     if (!node.mempool->exists(hashTx)) {
         // Transaction is not already in the mempool. Submit it.
         TxValidationState state;
-        TxValidationState dummyState;
         if(gArgs.GetBoolArg("-dandelion", false)){
             if (!AcceptToMemoryPool(stempool, state, std::move(tx),
                     nullptr /* plTxnReplaced */, false /* bypass_limits */, max_tx_fee)) {
@@ -53,8 +52,8 @@ TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef t
                 }
             }
         } else {
-            if (!AcceptToMemoryPool(*node.mempool, state, std::move(tx), nullptr /* plTxnReplaced */, false /* bypass_limits */, max_tx_fee)
-                    || !AcceptToMemoryPool(stempool, dummyState, std::move(tx), nullptr , false , max_tx_fee)) {
+            if (!AcceptToMemoryPoolAndStemPool(*node.mempool, stempool, state, std::move(tx),
+                    nullptr /* plTxnReplaced */, false /* bypass_limits */, max_tx_fee)) {
                 err_string = state.ToString();
                 if (state.IsInvalid()) {
                     if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS) {
@@ -102,6 +101,7 @@ TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef t
             LogPrint(BCLog::DANDELION, "dandeliontx %s embargoed for %d seconds\n", hashTx.ToString(), (nEmbargo-nCurrTime)/1000000);
             CInv inv(MSG_DANDELION_TX, hashTx);
             node.connman->localDandelionDestinationPushInventory(inv);
+            node.connman->recordDandelionEvent(DandelionEvent::STEM_LOCAL);
         } else {
             RelayTransaction(hashTx, *node.connman);
         }
@@ -0,0 +1,320 @@
+// Copyright (c) 2020 The NIX Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_POOLEDMAP_H
+#define BITCOIN_POOLEDMAP_H
+
+#include <crypto/common.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** Hash map for a large number of small entries, such as the coins cache.
+ *
+ * The buckets are open addressed with linear probing. Each one only holds the
+ * low 32 bits of the hash and the index of its entry, so a lookup usually
+ * stays within one cache line and the keys never have to be hashed again
+ * when the buckets are rebuilt.
+ *
+ * The entries live in a pool of chunks that double in size, so there is no
+ * allocation per entry. Entries are only moved by compact(): as with
+ * std::unordered_map, references to them otherwise stay valid until they are
+ * erased, while iterators are invalidated when an insertion rebuilds the
+ * buckets. Erasing an entry does not move any other, so a map can be erased
+ * from while iterating over it. The slots of erased entries are reused before
+ * the pool grows, but only compact() and clear() release them.
+ */
+template <typename K, typename T, typename Hash>
+class pooledmap
+{
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<const K, T> value_type;
+    typedef size_t size_type;
+
+private:
+    struct Bucket {
+        uint32_t tag;
+        uint32_t index;
+    };
+    typedef typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type Slot;
+
+    //! Bucket index values that do not refer to an entry
+    static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t DELETED = EMPTY - 1;
+    static constexpr size_t MIN_BUCKETS = 16;
+    //! Number of slots in the first chunk of the pool
+    static constexpr size_t FIRST_CHUNK = 16;
+
+public:
+    //! Memory used per bucket and per entry, see memusage::DynamicUsage()
+    static constexpr size_t BUCKET_BYTES = sizeof(Bucket);
+    static constexpr size_t ENTRY_BYTES = sizeof(Slot);
+
+    template <bool Const>
+    class Iterator
+    {
+        typedef typename std::conditional<Const, const pooledmap, pooledmap>::type Map;
+        Map* m_map;
+        size_t m_pos;
+
+        template <bool> friend class Iterator;
+        friend class pooledmap;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename pooledmap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<Const, const value_type*, value_type*>::type pointer;
+        typedef typename std::conditional<Const, const value_type&, value_type&>::type reference;
+
+        Iterator() : m_map(nullptr), m_pos(0) {}
+        Iterator(Map* map, size_t pos) : m_map(map), m_pos(pos) {}
+        template <bool C = Const, typename = typename std::enable_if<C>::type>
+        Iterator(const Iterator<false>& other) : m_map(other.m_map), m_pos(other.m_pos) {}
+
+        reference operator*() const { return m_map->Entry(m_map->m_buckets[m_pos].index); }
+        pointer operator->() const { return &**this; }
+        Iterator& operator++()
+        {
+            m_pos = m_map->NextUsed(m_pos + 1);
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            Iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+        friend bool operator==(const Iterator& a, const Iterator& b) { return a.m_pos == b.m_pos; }
+        friend bool operator!=(const Iterator& a, const Iterator& b) { return a.m_pos != b.m_pos; }
+    };
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    pooledmap() {}
+    pooledmap(const pooledmap&) = delete;
+    pooledmap& operator=(const pooledmap&) = delete;
+    ~pooledmap() { DestroyEntries(); }
+
+    iterator begin() { return iterator(this, NextUsed(0)); }
+    const_iterator begin() const { return const_iterator(this, NextUsed(0)); }
+    iterator end() { return iterator(this, m_buckets.size()); }
+    const_iterator end() const { return const_iterator(this, m_buckets.size()); }
+
+    size_type size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    size_type bucket_count() const { return m_buckets.size(); }
+    size_type chunk_count() const { return m_chunks.size(); }
+    //! Number of slots in the pool, in use or not.
+    size_type capacity() const { return FIRST_CHUNK * ((uint64_t{1} << m_chunks.size()) - 1); }
+
+    iterator find(const K& key) { return iterator(this, FindBucket(key, m_hash(key))); }
+    const_iterator find(const K& key) const { return const_iterator(this, FindBucket(key, m_hash(key))); }
+    size_type count(const K& key) const { return find(key) != end(); }
+
+    T& at(const K& key)
+    {
+        iterator it = find(key);
+        if (it == end()) throw std::out_of_range("pooledmap::at");
+        return it->second;
+    }
+    const T& at(const K& key) const
+    {
+        const_iterator it = find(key);
+        if (it == end()) throw std::out_of_range("pooledmap::at");
+        return it->second;
+    }
+    T& operator[](const K& key) { return emplace(key).first->second; }
+
+    /** Insert an entry for key, with its value constructed from args, unless
+     *  key is already present. */
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(const K& key, Args&&... args)
+    {
+        const size_t hash = m_hash(key);
+        size_t pos = FindBucket(key, hash);
+        if (pos != m_buckets.size()) return std::make_pair(iterator(this, pos), false);
+
+        if ((m_size + m_deleted + 1) * 4 > m_buckets.size() * 3) {
+            // Only grow if the buckets are not mostly deleted ones
+            size_t count = m_buckets.size() < MIN_BUCKETS ? MIN_BUCKETS : m_buckets.size();
+            while ((m_size + 1) * 2 > count) count *= 2;
+            Rehash(count);
+        }
+        const size_t mask = m_buckets.size() - 1;
+        for (pos = static_cast<uint32_t>(hash) & mask; m_buckets[pos].index < DELETED; pos = (pos + 1) & mask) {}
+
+        const uint32_t index = NewSlot();
+        try {
+            new (GetSlot(index)) value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        } catch (...) {
+            FreeSlot(index);
+            throw;
+        }
+        if (m_buckets[pos].index == DELETED) --m_deleted;
+        m_buckets[pos].tag = static_cast<uint32_t>(hash);
+        m_buckets[pos].index = index;
+        ++m_size;
+        return std::make_pair(iterator(this, pos), true);
+    }
+
+    //! Erase an entry and return an iterator to the next one.
+    iterator erase(const_iterator it)
+    {
+        const size_t pos = it.m_pos;
+        Bucket& bucket = m_buckets[pos];
+        Entry(bucket.index).~value_type();
+        FreeSlot(bucket.index);
+        // A bucket followed by an empty one is not part of any other probe sequence
+        if (m_buckets[(pos + 1) & (m_buckets.size() - 1)].index == EMPTY) {
+            bucket.index = EMPTY;
+        } else {
+            bucket.index = DELETED;
+            ++m_deleted;
+        }
+        --m_size;
+        return iterator(this, NextUsed(pos + 1));
+    }
+
+    //! Erase all entries and release the pool. The buckets are kept.
+    void clear()
+    {
+        DestroyEntries();
+        for (Bucket& bucket : m_buckets) bucket.index = EMPTY;
+        m_chunks.clear();
+        m_size = 0;
+        m_deleted = 0;
+        m_free = EMPTY;
+        m_slots = 0;
+    }
+
+    /** Move the entries in the highest slots into the free slots below
+     *  size(), then release the chunks left empty and shrink the buckets to
+     *  fit. No slots are allocated, so this never adds to the memory in use.
+     *  It is the one operation that invalidates references to entries, if
+     *  only to the moved ones. */
+    void compact()
+    {
+        size_t count = MIN_BUCKETS;
+        while ((m_size + 1) * 2 > count) count *= 2;
+        if (m_free == EMPTY && m_slots == m_size && count >= m_buckets.size()) return;
+
+        // As many slots below m_size are free as entries live above it
+        std::vector<uint32_t> holes;
+        for (uint32_t index = m_free; index != EMPTY; memcpy(&index, GetSlot(index), sizeof(index))) {
+            if (index < m_size) holes.push_back(index);
+        }
+        for (Bucket& bucket : m_buckets) {
+            if (bucket.index >= DELETED || bucket.index < m_size) continue;
+            value_type& entry = Entry(bucket.index);
+            new (GetSlot(holes.back())) value_type(std::move(entry));
+            entry.~value_type();
+            bucket.index = holes.back();
+            holes.pop_back();
+        }
+        assert(holes.empty());
+        size_t chunks = 0;
+        while (FIRST_CHUNK * ((uint64_t{1} << chunks) - 1) < m_size) ++chunks;
+        m_chunks.resize(chunks);
+        m_free = EMPTY;
+        m_slots = m_size;
+        if (count < m_buckets.size()) Rehash(count);
+    }
+
+private:
+    std::vector<Bucket> m_buckets;
+    std::vector<std::unique_ptr<Slot[]>> m_chunks;
+    size_t m_size{0};
+    //! Number of buckets marked DELETED
+    size_t m_deleted{0};
+    //! Head of the list of free slots, linked through the slots themselves
+    uint32_t m_free{EMPTY};
+    //! Number of slots handed out by the pool, in use or free
+    uint32_t m_slots{0};
+    Hash m_hash;
+
+    Slot* GetSlot(uint32_t index) const
+    {
+        // Chunk c holds FIRST_CHUNK << c slots, starting at FIRST_CHUNK * (2^c - 1).
+        const int chunk = CountBits(index / FIRST_CHUNK + 1) - 1;
+        return &m_chunks[chunk][index - FIRST_CHUNK * ((uint64_t{1} << chunk) - 1)];
+    }
+
+    value_type& Entry(uint32_t index) const { return *reinterpret_cast<value_type*>(GetSlot(index)); }
+
+    uint32_t NewSlot()
+    {
+        if (m_free != EMPTY) {
+            const uint32_t index = m_free;
+            memcpy(&m_free, GetSlot(index), sizeof(m_free));
+            return index;
+        }
+        assert(m_slots < DELETED);
+        if (m_slots == capacity()) {
+            m_chunks.emplace_back(new Slot[FIRST_CHUNK << m_chunks.size()]);
+        }
+        return m_slots++;
+    }
+
+    void FreeSlot(uint32_t index)
+    {
+        memcpy(GetSlot(index), &m_free, sizeof(m_free));
+        m_free = index;
+    }
+
+    //! Bucket holding key, or bucket_count() if there is none.
+    size_t FindBucket(const K& key, size_t hash) const
+    {
+        if (m_buckets.empty()) return 0;
+        const size_t mask = m_buckets.size() - 1;
+        const uint32_t tag = static_cast<uint32_t>(hash);
+        for (size_t pos = tag & mask;; pos = (pos + 1) & mask) {
+            const Bucket& bucket = m_buckets[pos];
+            if (bucket.index == EMPTY) return m_buckets.size();
+            if (bucket.index != DELETED && bucket.tag == tag && Entry(bucket.index).first == key) return pos;
+        }
+    }
+
+    size_t NextUsed(size_t pos) const
+    {
+        while (pos < m_buckets.size() && m_buckets[pos].index >= DELETED) ++pos;
+        return pos;
+    }
+
+    void Rehash(size_t count)
+    {
+        std::vector<Bucket> buckets(count, Bucket{0, EMPTY});
+        const size_t mask = count - 1;
+        for (const Bucket& bucket : m_buckets) {
+            if (bucket.index >= DELETED) continue;
+            size_t pos = bucket.tag & mask;
+            while (buckets[pos].index != EMPTY) pos = (pos + 1) & mask;
+            buckets[pos] = bucket;
+        }
+        m_buckets.swap(buckets);
+        m_deleted = 0;
+    }
+
+    void DestroyEntries()
+    {
+        for (const Bucket& bucket : m_buckets) {
+            if (bucket.index < DELETED) Entry(bucket.index).~value_type();
+        }
+    }
+};
+
+#endif // BITCOIN_POOLEDMAP_H
@@ -7,8 +7,19 @@
 
 #include <arith_uint256.h>
 #include <chain.h>
+#include <checkqueue.h>
 #include <primitives/block.h>
+#include <tinyformat.h>
 #include <uint256.h>
+#include <util/threadnames.h>
+
+#include <algorithm>
+#include <vector>
+
+bool g_parallel_pow_checks{false};
+
+/** Lyra2REv2 hashes are expensive, and each check already covers MAX_POW_CHECK_HEADERS of them, so hand them out to workers in small batches. */
+static CCheckQueue<CPoWCheck> powcheckqueue(4);
 
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
@@ -118,3 +129,44 @@ bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&
 
     return true;
 }
+
+bool CPoWCheck::operator()()
+{
+    assert(m_headers.size() <= MAX_POW_CHECK_HEADERS);
+    uint256 hashes[MAX_POW_CHECK_HEADERS];
+    GetPoWHashes(m_headers, hashes);
+    for (std::ptrdiff_t i = 0; i < m_headers.size(); ++i) {
+        if (!CheckProofOfWork(hashes[i], m_headers[i].nBits, *m_params)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ThreadPoWCheck(int worker_num)
+{
+    util::ThreadRename(strprintf("powcheck.%i", worker_num));
+    powcheckqueue.Thread();
+}
+
+bool VerifyPoWBatch(Span<const CBlockHeader> headers, const Consensus::Params& params)
+{
+    if (!g_parallel_pow_checks || headers.size() <= MAX_POW_CHECK_HEADERS) {
+        for (std::ptrdiff_t pos = 0; pos < headers.size(); pos += MAX_POW_CHECK_HEADERS) {
+            CPoWCheck check(headers.subspan(pos, std::min(MAX_POW_CHECK_HEADERS, headers.size() - pos)), params);
+            if (!check()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    CCheckQueueControl<CPoWCheck> control(&powcheckqueue);
+    std::vector<CPoWCheck> vChecks;
+    vChecks.reserve((headers.size() + MAX_POW_CHECK_HEADERS - 1) / MAX_POW_CHECK_HEADERS);
+    for (std::ptrdiff_t pos = 0; pos < headers.size(); pos += MAX_POW_CHECK_HEADERS) {
+        vChecks.emplace_back(headers.subspan(pos, std::min(MAX_POW_CHECK_HEADERS, headers.size() - pos)), params);
+    }
+    control.Add(vChecks);
+    return control.Wait();
+}
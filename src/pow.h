@@ -7,8 +7,11 @@
 #define BITCOIN_POW_H
 
 #include <consensus/params.h>
+#include <span.h>
 
+#include <stddef.h>
 #include <stdint.h>
+#include <utility>
 
 class CBlockHeader;
 class CBlockIndex;
@@ -21,4 +24,47 @@ unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nF
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
 
+/** Headers per CPoWCheck: enough to fill the widest multi-way Lyra2REv2 implementation. */
+static const std::ptrdiff_t MAX_POW_CHECK_HEADERS = 8;
+
+/**
+ * Closure representing the proof-of-work check of a few consecutive block
+ * headers, which are hashed together (see GetPoWHashes()). The headers must
+ * outlive the check.
+ */
+class CPoWCheck
+{
+private:
+    Span<const CBlockHeader> m_headers;
+    const Consensus::Params* m_params;
+
+public:
+    CPoWCheck() : m_params(nullptr) {}
+    CPoWCheck(Span<const CBlockHeader> headers, const Consensus::Params& params) : m_headers(headers), m_params(&params) {}
+
+    bool operator()();
+
+    void swap(CPoWCheck& check)
+    {
+        std::swap(m_headers, check.m_headers);
+        std::swap(m_params, check.m_params);
+    }
+};
+
+/** -parpow default (number of header proof-of-work checking threads) */
+static const int DEFAULT_POWCHECK_THREADS = 4;
+
+/** Whether VerifyPoWBatch() spreads work over the ThreadPoWCheck() workers. */
+extern bool g_parallel_pow_checks;
+
+/** Run instances of this in background threads to verify header proof of work in parallel. */
+void ThreadPoWCheck(int worker_num);
+
+/**
+ * Check the Lyra2REv2 proof of work of a batch of headers, using the
+ * ThreadPoWCheck() workers when available. Returns false if any header fails;
+ * callers that need to know which one should re-check them individually.
+ */
+bool VerifyPoWBatch(Span<const CBlockHeader> headers, const Consensus::Params& params);
+
 #endif // BITCOIN_POW_H
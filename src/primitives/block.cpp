@@ -24,6 +24,20 @@ uint256 CBlockHeader::GetPoWHash() const
    return thash;
 }
 
+void GetPoWHashes(Span<const CBlockHeader> headers, uint256* hashes)
+{
+    // lyra2re2_hashes() wants the 80-byte headers back to back
+    std::vector<char> input(headers.size() * 80);
+    for (std::ptrdiff_t i = 0; i < headers.size(); ++i) {
+        memcpy(input.data() + i * 80, BEGIN(headers[i].nVersion), 80);
+    }
+    std::vector<char> output(headers.size() * 32);
+    lyra2re2_hashes(input.data(), output.data(), headers.size());
+    for (std::ptrdiff_t i = 0; i < headers.size(); ++i) {
+        memcpy(hashes[i].begin(), output.data() + i * 32, 32);
+    }
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
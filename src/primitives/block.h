@@ -8,6 +8,7 @@
 
 #include <primitives/transaction.h>
 #include <serialize.h>
+#include <span.h>
 #include <uint256.h>
 #include "crypto/Lyra2RE/Lyra2RE.h"
 
@@ -72,6 +73,9 @@ public:
     }
 };
 
+/** Compute GetPoWHash() of each header into hashes[0..headers.size()), hashing several headers at once where the CPU allows. */
+void GetPoWHashes(Span<const CBlockHeader> headers, uint256* hashes);
+
 class CBlock : public CBlockHeader
 {
 public:
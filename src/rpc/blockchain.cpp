@@ -14,6 +14,10 @@
 #include <core_io.h>
 #include <hash.h>
 #include <index/blockfilterindex.h>
+#include <index/coinstatsindex.h>
+#include <index/txindex.h>
+#include <net.h>
+#include <node/blockcache.h>
 #include <node/coinstats.h>
 #include <node/context.h>
 #include <node/utxo_snapshot.h>
@@ -29,6 +33,7 @@
 #include <txdb.h>
 #include <txmempool.h>
 #include <undo.h>
+#include <util/rbf.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 #include <validation.h>
@@ -42,6 +47,7 @@
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <unordered_set>
 
 struct CUpdatedBlock
 {
@@ -403,37 +409,33 @@ static std::vector<RPCResult> MempoolEntryDescription() { return {
     RPCResult{RPCResult::Type::BOOL, "bip125-replaceable", "Whether this transaction could be replaced due to BIP125 (replace-by-fee)"},
 };}
 
-static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPoolEntry& e) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
+static void entryToJSON(UniValue& info, const TxMempoolSnapshotEntry& e, const TxMempoolSnapshotLinks& links, bool rbf)
 {
-    AssertLockHeld(pool.cs);
-
     UniValue fees(UniValue::VOBJ);
-    fees.pushKV("base", ValueFromAmount(e.GetFee()));
-    fees.pushKV("modified", ValueFromAmount(e.GetModifiedFee()));
-    fees.pushKV("ancestor", ValueFromAmount(e.GetModFeesWithAncestors()));
-    fees.pushKV("descendant", ValueFromAmount(e.GetModFeesWithDescendants()));
+    fees.pushKV("base", ValueFromAmount(e.fee));
+    fees.pushKV("modified", ValueFromAmount(e.modified_fee));
+    fees.pushKV("ancestor", ValueFromAmount(e.mod_fees_with_ancestors));
+    fees.pushKV("descendant", ValueFromAmount(e.mod_fees_with_descendants));
     info.pushKV("fees", fees);
 
-    info.pushKV("vsize", (int)e.GetTxSize());
-    if (IsDeprecatedRPCEnabled("size")) info.pushKV("size", (int)e.GetTxSize());
-    info.pushKV("weight", (int)e.GetTxWeight());
-    info.pushKV("fee", ValueFromAmount(e.GetFee()));
-    info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
-    info.pushKV("time", count_seconds(e.GetTime()));
-    info.pushKV("height", (int)e.GetHeight());
-    info.pushKV("descendantcount", e.GetCountWithDescendants());
-    info.pushKV("descendantsize", e.GetSizeWithDescendants());
-    info.pushKV("descendantfees", e.GetModFeesWithDescendants());
-    info.pushKV("ancestorcount", e.GetCountWithAncestors());
-    info.pushKV("ancestorsize", e.GetSizeWithAncestors());
-    info.pushKV("ancestorfees", e.GetModFeesWithAncestors());
-    info.pushKV("wtxid", pool.vTxHashes[e.vTxHashesIdx].first.ToString());
-    const CTransaction& tx = e.GetTx();
+    info.pushKV("vsize", (int)e.vsize);
+    if (IsDeprecatedRPCEnabled("size")) info.pushKV("size", (int)e.vsize);
+    info.pushKV("weight", (int)e.weight);
+    info.pushKV("fee", ValueFromAmount(e.fee));
+    info.pushKV("modifiedfee", ValueFromAmount(e.modified_fee));
+    info.pushKV("time", count_seconds(e.m_time));
+    info.pushKV("height", (int)e.height);
+    info.pushKV("descendantcount", e.count_with_descendants);
+    info.pushKV("descendantsize", e.size_with_descendants);
+    info.pushKV("descendantfees", e.mod_fees_with_descendants);
+    info.pushKV("ancestorcount", e.count_with_ancestors);
+    info.pushKV("ancestorsize", e.size_with_ancestors);
+    info.pushKV("ancestorfees", e.mod_fees_with_ancestors);
+    info.pushKV("wtxid", e.tx->GetWitnessHash().ToString());
     std::set<std::string> setDepends;
-    for (const CTxIn& txin : tx.vin)
+    for (const uint256& parent : links.parents)
     {
-        if (pool.exists(txin.prevout.hash))
-            setDepends.insert(txin.prevout.hash.ToString());
+        setDepends.insert(parent.ToString());
     }
 
     UniValue depends(UniValue::VARR);
@@ -445,53 +447,108 @@ static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPool
     info.pushKV("depends", depends);
 
     UniValue spent(UniValue::VARR);
-    const CTxMemPool::txiter& it = pool.mapTx.find(tx.GetHash());
-    const CTxMemPool::setEntries& setChildren = pool.GetMemPoolChildren(it);
-    for (CTxMemPool::txiter childiter : setChildren) {
-        spent.push_back(childiter->GetTx().GetHash().ToString());
+    for (const uint256& child : links.children) {
+        spent.push_back(child.ToString());
     }
 
     info.pushKV("spentby", spent);
 
+    info.pushKV("bip125-replaceable", rbf);
+}
+
+static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPoolEntry& e) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
+{
+    AssertLockHeld(pool.cs);
+
     // Add opt-in RBF status
     bool rbfStatus = false;
-    RBFTransactionState rbfState = IsRBFOptIn(tx, pool);
+    RBFTransactionState rbfState = IsRBFOptIn(e.GetTx(), pool);
     if (rbfState == RBFTransactionState::UNKNOWN) {
         throw JSONRPCError(RPC_MISC_ERROR, "Transaction is not in mempool");
     } else if (rbfState == RBFTransactionState::REPLACEABLE_BIP125) {
         rbfStatus = true;
     }
 
-    info.pushKV("bip125-replaceable", rbfStatus);
+    const CTxMemPool::txiter it = pool.mapTx.find(e.GetTx().GetHash());
+    TxMempoolSnapshotLinks links;
+    for (CTxMemPool::txiter parent : pool.GetMemPoolParents(it)) {
+        links.parents.push_back(parent->GetTx().GetHash());
+    }
+    for (CTxMemPool::txiter child : pool.GetMemPoolChildren(it)) {
+        links.children.push_back(child->GetTx().GetHash());
+    }
+    entryToJSON(info, pool.GetSnapshotEntry(it), links, rbfStatus);
+}
+
+/**
+ * The opt-in RBF status of every entry of a mempool snapshot, as IsRBFOptIn()
+ * finds it: whether it or one of its in-mempool ancestors signals replaceability.
+ * The snapshot lists every transaction after its ancestors, as they have fewer
+ * ancestors themselves, so one pass over it suffices.
+ */
+static std::vector<bool> SnapshotRBFOptIn(const std::vector<TxMempoolSnapshotEntry>& snapshot, const std::vector<TxMempoolSnapshotLinks>& links)
+{
+    std::vector<bool> ret;
+    ret.reserve(snapshot.size());
+    std::unordered_set<uint256, SaltedTxidHasher> replaceable;
+    for (size_t i = 0; i < snapshot.size(); ++i) {
+        bool rbf = SignalsOptInRBF(*snapshot[i].tx);
+        for (auto it = links[i].parents.begin(); !rbf && it != links[i].parents.end(); ++it) {
+            rbf = replaceable.count(*it);
+        }
+        if (rbf) replaceable.insert(snapshot[i].tx->GetHash());
+        ret.push_back(rbf);
+    }
+    return ret;
 }
 
 UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose)
 {
+    const auto snapshot = pool.GetSnapshot();
     if (verbose) {
-        LOCK(pool.cs);
+        const std::vector<TxMempoolSnapshotLinks> links = GetSnapshotLinks(*snapshot);
+        const std::vector<bool> rbf = SnapshotRBFOptIn(*snapshot, links);
         UniValue o(UniValue::VOBJ);
-        for (const CTxMemPoolEntry& e : pool.mapTx) {
-            const uint256& hash = e.GetTx().GetHash();
+        for (size_t i = 0; i < snapshot->size(); ++i) {
+            const TxMempoolSnapshotEntry& e = (*snapshot)[i];
             UniValue info(UniValue::VOBJ);
-            entryToJSON(pool, info, e);
+            entryToJSON(info, e, links[i], rbf[i]);
             // Mempool has unique entries so there is no advantage in using
             // UniValue::pushKV, which checks if the key already exists in O(N).
             // UniValue::__pushKV is used instead which currently is O(1).
-            o.__pushKV(hash.ToString(), info);
+            o.__pushKV(e.tx->GetHash().ToString(), info);
         }
         return o;
     } else {
-        std::vector<uint256> vtxid;
-        pool.queryHashes(vtxid);
-
         UniValue a(UniValue::VARR);
-        for (const uint256& hash : vtxid)
-            a.push_back(hash.ToString());
+        for (const TxMempoolSnapshotEntry& e : *snapshot)
+            a.push_back(e.tx->GetHash().ToString());
 
         return a;
     }
 }
 
+void MempoolToJSONChunks(const CTxMemPool& pool, size_t chunk_size, const std::function<void(const std::string&)>& write)
+{
+    const auto snapshot = pool.GetSnapshot();
+    const std::vector<TxMempoolSnapshotLinks> links = GetSnapshotLinks(*snapshot);
+    const std::vector<bool> rbf = SnapshotRBFOptIn(*snapshot, links);
+    std::string chunk = "{";
+    for (size_t i = 0; i < snapshot->size(); ++i) {
+        const TxMempoolSnapshotEntry& e = (*snapshot)[i];
+        UniValue info(UniValue::VOBJ);
+        entryToJSON(info, e, links[i], rbf[i]);
+        if (i > 0) chunk += ',';
+        chunk += '"' + e.tx->GetHash().ToString() + "\":" + info.write();
+        if (chunk.size() >= chunk_size) {
+            write(chunk);
+            chunk.clear();
+        }
+    }
+    chunk += '}';
+    write(chunk);
+}
+
 static UniValue getrawmempool(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getrawmempool",
@@ -773,12 +830,12 @@ static UniValue getblockheader(const JSONRPCRequest& request)
 
 static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
 {
-    CBlock block;
     if (IsBlockPruned(pblockindex)) {
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
     }
 
-    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())) {
+    std::shared_ptr<const CBlock> block = g_block_cache.GetBlock(pblockindex, Params().GetConsensus());
+    if (!block) {
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
         // non-whitelisted node sends us an unrequested long chain of valid
@@ -787,7 +844,7 @@ static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
     }
 
-    return block;
+    return *block;
 }
 
 static CBlockUndo GetUndoChecked(const CBlockIndex* pblockindex)
@@ -956,22 +1013,26 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
             RPCHelpMan{"gettxoutsetinfo",
                 "\nReturns statistics about the unspent transaction output set.\n"
-                "Note this call may take some time.\n",
-                {},
+                "Note this call may take some time, unless -coinstatsindex is enabled and hash_type is not hash_serialized_2.\n",
+                {
+                    {"hash_type", RPCArg::Type::STR, /* default */ "hash_serialized_2", "Which UTXO set hash should be calculated. Options: 'hash_serialized_2' (the legacy algorithm), 'muhash', 'none'."},
+                },
                 RPCResult{
                     RPCResult::Type::OBJ, "", "",
                     {
                         {RPCResult::Type::NUM, "height", "The current block height (index)"},
                         {RPCResult::Type::STR_HEX, "bestblock", "The hash of the block at the tip of the chain"},
-                        {RPCResult::Type::NUM, "transactions", "The number of transactions with unspent outputs"},
+                        {RPCResult::Type::NUM, "transactions", "The number of transactions with unspent outputs (not available when coinstatsindex is used)"},
                         {RPCResult::Type::NUM, "txouts", "The number of unspent transaction outputs"},
                         {RPCResult::Type::NUM, "bogosize", "A meaningless metric for UTXO set size"},
-                        {RPCResult::Type::STR_HEX, "hash_serialized_2", "The serialized hash"},
-                        {RPCResult::Type::NUM, "disk_size", "The estimated size of the chainstate on disk"},
+                        {RPCResult::Type::STR_HEX, "hash_serialized_2", "The serialized hash (only present if 'hash_serialized_2' hash_type is chosen)"},
+                        {RPCResult::Type::STR_HEX, "muhash", "The MuHash3072 of the UTXO set (only present if 'muhash' hash_type is chosen)"},
+                        {RPCResult::Type::NUM, "disk_size", "The estimated size of the chainstate on disk (not available when coinstatsindex is used)"},
                         {RPCResult::Type::STR_AMOUNT, "total_amount", "The total amount"},
                     }},
                 RPCExamples{
                     HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
                 },
             }.Check(request);
@@ -979,17 +1040,42 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
+    CoinStatsHashType hash_type = CoinStatsHashType::HASH_SERIALIZED;
+    if (!request.params[0].isNull()) {
+        const std::string& hash_type_input = request.params[0].get_str();
+        if (hash_type_input == "hash_serialized_2") {
+            hash_type = CoinStatsHashType::HASH_SERIALIZED;
+        } else if (hash_type_input == "muhash") {
+            hash_type = CoinStatsHashType::MUHASH;
+        } else if (hash_type_input == "none") {
+            hash_type = CoinStatsHashType::NONE;
+        } else {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hash_type_input));
+        }
+    }
+
     ::ChainstateActive().ForceFlushStateToDisk();
+    if (g_coin_stats_index && hash_type != CoinStatsHashType::HASH_SERIALIZED) {
+        g_coin_stats_index->BlockUntilSyncedToCurrentChain();
+    }
 
     CCoinsView* coins_view = WITH_LOCK(cs_main, return &ChainstateActive().CoinsDB());
-    if (GetUTXOStats(coins_view, stats)) {
+    if (GetUTXOStats(coins_view, stats, hash_type)) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
-        ret.pushKV("transactions", (int64_t)stats.nTransactions);
+        if (!stats.index_used) {
+            ret.pushKV("transactions", (int64_t)stats.nTransactions);
+        }
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
         ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
-        ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
-        ret.pushKV("disk_size", stats.nDiskSize);
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        } else if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.pushKV("muhash", stats.muhash.GetHex());
+        }
+        if (!stats.index_used) {
+            ret.pushKV("disk_size", stats.nDiskSize);
+        }
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
@@ -1421,6 +1507,36 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
     return MempoolInfoToJSON(EnsureMemPool());
 }
 
+static UniValue getblockcacheinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getblockcacheinfo",
+                "\nReturns details on the cache of recently read blocks served to peers, RPC and REST.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "blocks", "The number of cached blocks"},
+                        {RPCResult::Type::NUM, "usage", "Total memory usage for the cache"},
+                        {RPCResult::Type::NUM, "maxusage", "Maximum memory usage for the cache"},
+                        {RPCResult::Type::NUM, "hits", "The number of lookups served from the cache"},
+                        {RPCResult::Type::NUM, "misses", "The number of lookups that read the block from disk"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getblockcacheinfo", "")
+            + HelpExampleRpc("getblockcacheinfo", "")
+                },
+            }.Check(request);
+
+    const BlockCache::Stats stats = g_block_cache.GetStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("blocks", (uint64_t)stats.blocks);
+    ret.pushKV("usage", (uint64_t)stats.usage);
+    ret.pushKV("maxusage", (uint64_t)stats.max_usage);
+    ret.pushKV("hits", stats.hits);
+    ret.pushKV("misses", stats.misses);
+    return ret;
+}
+
 static UniValue preciousblock(const JSONRPCRequest& request)
 {
             RPCHelpMan{"preciousblock",
@@ -2341,6 +2457,91 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
     return result;
 }
 
+UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    RPCHelpMan{
+        "loadtxoutset",
+        "\nFor testing only, on regtest: replace the UTXO set with a snapshot written by dumptxoutset, and\n"
+        "make its base block the tip.\n"
+        "The snapshot must match the UTXO set hash that -assumeutxo pins for the height of its base block,\n"
+        "whose header must already be known. Only a node that has not connected any block yet, and that\n"
+        "runs without -txindex, -coinstatsindex and -blockfilterindex, can load a snapshot.\n"
+        "\nThe blocks below the base are never downloaded, and nothing validates them in the background,\n"
+        "so the UTXO set is never checked against the one the node would have built itself. From then on\n"
+        "the node stops advertising NODE_NETWORK, and it refuses to start with those indexes until it is\n"
+        "rebuilt using -reindex.\n",
+        {
+            {"path",
+                RPCArg::Type::STR,
+                RPCArg::Optional::NO,
+                /* default_val */ "",
+                "path to the snapshot file. If relative, will be prefixed by datadir."},
+        },
+        RPCResult{
+            RPCResult::Type::OBJ, "", "",
+                {
+                    {RPCResult::Type::NUM, "coins_loaded", "the number of coins loaded from the snapshot"},
+                    {RPCResult::Type::STR_HEX, "base_hash", "the hash of the base of the snapshot"},
+                    {RPCResult::Type::NUM, "base_height", "the height of the base of the snapshot"},
+                    {RPCResult::Type::STR, "path", "the absolute path that the snapshot was loaded from"},
+                }
+        },
+        RPCExamples{
+            HelpExampleCli("loadtxoutset", "utxo.dat")
+        }
+    }.Check(request);
+
+    // Without background validation of the blocks below the snapshot base,
+    // a snapshot is only fit for tests.
+    if (Params().NetworkIDString() != CBaseChainParams::REGTEST) {
+        throw JSONRPCError(RPC_METHOD_NOT_FOUND, "loadtxoutset is for testing only, and only available on regtest");
+    }
+
+    // The indexes need the blocks below the snapshot base.
+    bool have_filter_index = false;
+    ForEachBlockFilterIndex([&have_filter_index](BlockFilterIndex&) { have_filter_index = true; });
+    if (g_txindex || g_coin_stats_index || have_filter_index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to load UTXO snapshot: restart without -txindex, -coinstatsindex and -blockfilterindex first");
+    }
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    FILE* file{fsbridge::fopen(path, "rb")};
+    CAutoFile afile{file, SER_DISK, CLIENT_VERSION};
+    if (afile.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Couldn't open file " + path.string() + " for reading.");
+    }
+
+    SnapshotMetadata metadata;
+    try {
+        afile >> metadata;
+    } catch (const std::ios_base::failure& e) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("Unable to parse snapshot metadata: %s", e.what()));
+    }
+
+    std::string error;
+    if (!::ChainstateActive().ActivateSnapshot(afile, metadata, Params(), error)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to load UTXO snapshot: " + error);
+    }
+    // The blocks below the base cannot be served to peers.
+    if (g_rpc_node && g_rpc_node->connman) {
+        g_rpc_node->connman->RemoveLocalServices(NODE_NETWORK);
+    }
+
+    // Connect whatever is already known above the snapshot base.
+    BlockValidationState state;
+    if (!ActivateBestChain(state, Params())) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, state.ToString());
+    }
+
+    CBlockIndex* base = WITH_LOCK(::cs_main, return LookupBlockIndex(metadata.m_base_blockhash));
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("coins_loaded", metadata.m_coins_count);
+    result.pushKV("base_hash", base->GetBlockHash().ToString());
+    result.pushKV("base_height", base->nHeight);
+    result.pushKV("path", path.string());
+    return result;
+}
+
 void RegisterBlockchainRPCCommands(CRPCTable &t)
 {
 // clang-format off
@@ -2355,6 +2556,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
+    { "blockchain",         "getblockcacheinfo",      &getblockcacheinfo,      {} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
@@ -2363,7 +2565,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
@@ -2380,6 +2582,7 @@ static const CRPCCommand commands[] =
     { "hidden",             "waitforblockheight",     &waitforblockheight,     {"height","timeout"} },
     { "hidden",             "syncwithvalidationinterfacequeue", &syncwithvalidationinterfacequeue, {} },
     { "hidden",             "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "hidden",             "loadtxoutset",           &loadtxoutset,           {"path"} },
 };
 // clang-format on
 
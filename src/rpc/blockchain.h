@@ -8,7 +8,9 @@
 #include <amount.h>
 #include <sync.h>
 
+#include <functional>
 #include <stdint.h>
+#include <string>
 #include <vector>
 
 extern RecursiveMutex cs_main;
@@ -41,6 +43,13 @@ UniValue MempoolInfoToJSON(const CTxMemPool& pool);
 /** Mempool to JSON */
 UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose = false);
 
+/**
+ * Verbose mempool JSON, as MempoolToJSON(pool, true).write() returns it, passed
+ * to write in pieces of at least chunk_size bytes (but the last), so that a
+ * reply can be sent while the rest is produced.
+ */
+void MempoolToJSONChunks(const CTxMemPool& pool, size_t chunk_size, const std::function<void(const std::string&)>& write);
+
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex) LOCKS_EXCLUDED(cs_main);
 
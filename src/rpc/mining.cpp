@@ -112,6 +112,7 @@ static UniValue generateBlocks(const CTxMemPool& mempool, const CScript& coinbas
         nHeightEnd = nHeight+nGenerate;
     }
     unsigned int nExtraNonce = 0;
+    const int nThreads = std::max(1, GetNumCores());
     UniValue blockHashes(UniValue::VARR);
     while (nHeight < nHeightEnd && !ShutdownRequested())
     {
@@ -123,14 +124,11 @@ static UniValue generateBlocks(const CTxMemPool& mempool, const CScript& coinbas
             LOCK(cs_main);
             IncrementExtraNonce(pblock, ::ChainActive().Tip(), nExtraNonce);
         }
-        while (nMaxTries > 0 && pblock->nNonce < std::numeric_limits<uint32_t>::max() && !CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus()) && !ShutdownRequested()) {
-            ++pblock->nNonce;
-            --nMaxTries;
-        }
-        if (nMaxTries == 0 || ShutdownRequested()) {
-            break;
-        }
-        if (pblock->nNonce == std::numeric_limits<uint32_t>::max()) {
+        if (!GrindBlockNonce(pblock, Params().GetConsensus(), nThreads, nMaxTries)) {
+            if (nMaxTries == 0 || ShutdownRequested()) {
+                break;
+            }
+            // Nonce space exhausted, try again with a new extranonce
             continue;
         }
         std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
@@ -519,6 +517,15 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
             nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
         }
 
+        // If the client holds the template handed out last, new transactions
+        // only end the wait once they change the fees or weight of the
+        // template it would get now.
+        CAmount nFeesLP;
+        uint64_t nWeightLP;
+        unsigned int nTransactionsUpdatedSelection;
+        const bool fCompareSelection = GetLastBlockSelection(mempool, hashWatchedChain, nFeesLP, nWeightLP, nTransactionsUpdatedSelection) &&
+            nTransactionsUpdatedSelection == nTransactionsUpdatedLastLP;
+
         // Release lock while waiting
         LEAVE_CRITICAL_SECTION(cs_main);
         {
@@ -531,8 +538,33 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
                 {
                     // Timeout: Check transactions for update
                     // without holding the mempool lock to avoid deadlocks
-                    if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP)
-                        break;
+                    if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP) {
+                        if (!fCompareSelection) break;
+                        bool fChanged;
+                        {
+                            REVERSE_LOCK(lock);
+                            LOCK(cs_main);
+                            CAmount nFees;
+                            uint64_t nWeight;
+                            unsigned int nTransactionsUpdated;
+                            if (!GetLastBlockSelection(mempool, hashWatchedChain, nFees, nWeight, nTransactionsUpdated) ||
+                                nTransactionsUpdated != mempool.GetTransactionsUpdated()) {
+                                // The first waiting client to get here picks the
+                                // transactions for all of them, mostly by extending
+                                // the last selection. The template is not needed.
+                                try {
+                                    CScript scriptDummy = CScript() << OP_TRUE;
+                                    BlockAssembler(mempool, Params()).CreateNewBlock(scriptDummy);
+                                } catch (const std::runtime_error&) {
+                                    // No selection is left to compare with, and the
+                                    // template built after the wait reports the error.
+                                }
+                            }
+                            fChanged = !GetLastBlockSelection(mempool, hashWatchedChain, nFees, nWeight, nTransactionsUpdated) ||
+                                nFees != nFeesLP || nWeight != nWeightLP;
+                        }
+                        if (fChanged) break;
+                    }
                     checktxtime += std::chrono::seconds(10);
                 }
             }
@@ -118,6 +118,7 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                             }},
                             {RPCResult::Type::BOOL, "whitelisted", "Whether the peer is whitelisted"},
                             {RPCResult::Type::NUM, "minfeefilter", "The minimum fee rate for transactions this peer accepts"},
+                            {RPCResult::Type::NUM, "dandelion_inventory_known_bytes", "Memory used to remember the Dandelion transactions known to this peer"},
                             {RPCResult::Type::OBJ_DYN, "bytessent_per_msg", "",
                             {
                                 {RPCResult::Type::NUM, "msg", "The total bytes sent aggregated by message type\n"
@@ -203,6 +204,7 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.pushKV("permissions", permissions);
         obj.pushKV("minfeefilter", ValueFromAmount(stats.minFeeFilter));
+        obj.pushKV("dandelion_inventory_known_bytes", (uint64_t)stats.m_dandelion_inventory_known_bytes);
 
         UniValue sendPerMsgCmd(UniValue::VOBJ);
         for (const auto& i : stats.mapSendBytesPerMsgCmd) {
@@ -436,6 +438,136 @@ static UniValue getnettotals(const JSONRPCRequest& request)
     return obj;
 }
 
+static UniValue DandelionLatencyToJSON(const std::array<uint64_t, DANDELION_LATENCY_BUCKETS>& histogram)
+{
+    UniValue buckets(UniValue::VARR);
+    for (size_t i = 0; i < DANDELION_LATENCY_BUCKETS; ++i) {
+        UniValue bucket(UniValue::VOBJ);
+        if (i < DANDELION_LATENCY_BUCKETS - 1) {
+            bucket.pushKV("below", DANDELION_LATENCY_BOUNDS[i]);
+        }
+        bucket.pushKV("count", histogram[i]);
+        buckets.push_back(bucket);
+    }
+    return buckets;
+}
+
+static UniValue NodeIdsToJSON(const std::vector<NodeId>& ids)
+{
+    UniValue arr(UniValue::VARR);
+    for (const NodeId id : ids) {
+        arr.push_back(id);
+    }
+    return arr;
+}
+
+static UniValue getdandelioninfo(const JSONRPCRequest& request)
+{
+    const std::vector<RPCResult> latency_histogram{
+        {RPCResult::Type::OBJ, "", "",
+        {
+            {RPCResult::Type::NUM, "below", /* optional */ true, "Upper bound of the bucket in seconds, absent for the last bucket"},
+            {RPCResult::Type::NUM, "count", "Number of embargoes in the bucket"},
+        }},
+    };
+            RPCHelpMan{"getdandelioninfo",
+                "\nReturns information about Dandelion transaction relay, embargoes and routing.\n",
+                {},
+                RPCResult{
+                   RPCResult::Type::OBJ, "", "",
+                   {
+                       {RPCResult::Type::OBJ, "stem", "",
+                       {
+                           {RPCResult::Type::NUM, "received", "Number of stem transactions accepted from inbound peers"},
+                           {RPCResult::Type::NUM, "local", "Number of stem transactions originated by this node"},
+                           {RPCResult::Type::NUM, "relayed", "Number of stem transactions passed on to a Dandelion destination"},
+                           {RPCResult::Type::NUM, "fluffed", "Number of stem transactions fluffed by this node"},
+                        }},
+                       {RPCResult::Type::OBJ, "embargo", "",
+                       {
+                           {RPCResult::Type::NUM, "embargoed", "Number of transactions currently under embargo"},
+                           {RPCResult::Type::NUM, "inserted", "Number of embargoes started"},
+                           {RPCResult::Type::NUM, "expired", "Number of embargoes that ran out"},
+                           {RPCResult::Type::NUM, "removed", "Number of embargoes lifted early because the transaction reached the mempool"},
+                           {RPCResult::Type::ARR, "expired_latency", "Time spent under embargo by the transactions whose embargo ran out", latency_histogram},
+                           {RPCResult::Type::ARR, "removed_latency", "Time spent under embargo by the transactions that reached the mempool first", latency_histogram},
+                        }},
+                       {RPCResult::Type::OBJ, "stempool", "",
+                       {
+                           {RPCResult::Type::NUM, "size", "Current stempool transaction count"},
+                           {RPCResult::Type::NUM, "usage", "Total memory usage for the stempool"},
+                        }},
+                       {RPCResult::Type::OBJ, "routing", "",
+                       {
+                           {RPCResult::Type::NUM, "shuffles", "Number of route shuffles"},
+                           {RPCResult::Type::ARR, "inbound", "", {{RPCResult::Type::NUM, "id", "Peer index of an inbound Dandelion peer"}}},
+                           {RPCResult::Type::ARR, "outbound", "", {{RPCResult::Type::NUM, "id", "Peer index of an outbound Dandelion peer"}}},
+                           {RPCResult::Type::ARR, "destinations", "", {{RPCResult::Type::NUM, "id", "Peer index of a Dandelion destination"}}},
+                           {RPCResult::Type::ARR, "routes", "",
+                           {
+                               {RPCResult::Type::OBJ, "", "",
+                               {
+                                   {RPCResult::Type::NUM, "from", "Peer index of the inbound peer"},
+                                   {RPCResult::Type::NUM, "to", "Peer index of the destination its stem transactions are relayed to"},
+                               }},
+                           }},
+                           {RPCResult::Type::NUM, "localdestination", /* optional */ true, "Peer index of the destination of our own stem transactions, if set"},
+                        }},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("getdandelioninfo", "")
+            + HelpExampleRpc("getdandelioninfo", "")
+                },
+            }.Check(request);
+    if(!g_rpc_node->connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    const CDandelionStats stats = g_rpc_node->connman->getDandelionStats();
+
+    UniValue stem(UniValue::VOBJ);
+    stem.pushKV("received", stats.nStemReceived);
+    stem.pushKV("local", stats.nStemLocal);
+    stem.pushKV("relayed", stats.nStemRelayed);
+    stem.pushKV("fluffed", stats.nFluffed);
+
+    UniValue embargo(UniValue::VOBJ);
+    embargo.pushKV("embargoed", (uint64_t)stats.nEmbargoed);
+    embargo.pushKV("inserted", stats.nInserted);
+    embargo.pushKV("expired", stats.nExpired);
+    embargo.pushKV("removed", stats.nRemoved);
+    embargo.pushKV("expired_latency", DandelionLatencyToJSON(stats.vExpiredLatency));
+    embargo.pushKV("removed_latency", DandelionLatencyToJSON(stats.vRemovedLatency));
+
+    UniValue stem_pool(UniValue::VOBJ);
+    stem_pool.pushKV("size", (uint64_t)stempool.size());
+    stem_pool.pushKV("usage", (uint64_t)stempool.DynamicMemoryUsage());
+
+    UniValue routing(UniValue::VOBJ);
+    routing.pushKV("shuffles", stats.nShuffles);
+    routing.pushKV("inbound", NodeIdsToJSON(stats.vInbound));
+    routing.pushKV("outbound", NodeIdsToJSON(stats.vOutbound));
+    routing.pushKV("destinations", NodeIdsToJSON(stats.vDestinations));
+    UniValue routes(UniValue::VARR);
+    for (const auto& route : stats.vRoutes) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("from", route.first);
+        obj.pushKV("to", route.second);
+        routes.push_back(obj);
+    }
+    routing.pushKV("routes", routes);
+    if (stats.nLocalDestination >= 0) {
+        routing.pushKV("localdestination", stats.nLocalDestination);
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("stem", stem);
+    obj.pushKV("embargo", embargo);
+    obj.pushKV("stempool", stem_pool);
+    obj.pushKV("routing", routing);
+    return obj;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -773,6 +905,7 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         {"address", "nodeid"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       {"node"} },
     { "network",            "getnettotals",           &getnettotals,           {} },
+    { "network",            "getdandelioninfo",       &getdandelioninfo,       {} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         {} },
     { "network",            "setban",                 &setban,                 {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             &listbanned,             {} },
@@ -18,6 +18,7 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
 class CPubKey;
+class uint256;
 
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
@@ -53,4 +54,12 @@ public:
 
 void InitSignatureCache();
 
+/** Get the nonce of the signature cache and the entries it holds, to save them. */
+void GetSignatureCacheEntries(uint256& nonce, std::vector<uint256>& entries);
+/**
+ * Replace the nonce of the signature cache by a saved one, and add the entries
+ * saved with it. Must be called before any signature is checked.
+ */
+void LoadSignatureCacheEntries(const uint256& nonce, const std::vector<uint256>& entries);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -76,7 +76,9 @@ CBlock BuildChainTestingSetup::CreateBlock(const CBlockIndex* prev,
     unsigned int extraNonce = 0;
     IncrementExtraNonce(&block, prev, extraNonce);
 
-    while (!CheckProofOfWork(block.GetHash(), block.nBits, chainparams.GetConsensus())) ++block.nNonce;
+    uint64_t max_tries = std::numeric_limits<uint64_t>::max();
+    bool found = GrindBlockNonce(&block, chainparams.GetConsensus(), 1, max_tries);
+    assert(found);
 
     return block;
 }
@@ -56,6 +56,22 @@ struct FailingCheck {
     };
 };
 
+struct CountingFailingCheck {
+    static std::atomic<size_t> n_calls;
+    bool fails{false};
+    CountingFailingCheck() {}
+    CountingFailingCheck(bool _fails) : fails(_fails){};
+    bool operator()()
+    {
+        n_calls.fetch_add(1, std::memory_order_relaxed);
+        return !fails;
+    }
+    void swap(CountingFailingCheck& x)
+    {
+        std::swap(fails, x.fails);
+    };
+};
+
 struct UniqueCheck {
     static std::mutex m;
     static std::unordered_multiset<size_t> results;
@@ -130,12 +146,14 @@ std::condition_variable FrozenCleanupCheck::cv{};
 std::mutex UniqueCheck::m;
 std::unordered_multiset<size_t> UniqueCheck::results;
 std::atomic<size_t> FakeCheckCheckCompletion::n_calls{0};
+std::atomic<size_t> CountingFailingCheck::n_calls{0};
 std::atomic<size_t> MemoryCheck::fake_allocated_memory{0};
 
 // Queue Typedefs
 typedef CCheckQueue<FakeCheckCheckCompletion> Correct_Queue;
 typedef CCheckQueue<FakeCheck> Standard_Queue;
 typedef CCheckQueue<FailingCheck> Failing_Queue;
+typedef CCheckQueue<CountingFailingCheck> CountingFailing_Queue;
 typedef CCheckQueue<UniqueCheck> Unique_Queue;
 typedef CCheckQueue<MemoryCheck> Memory_Queue;
 typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
@@ -266,6 +284,24 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Recovers_From_Failure)
     tg.join_all();
 }
 
+// Test that the checks after a failing one are dropped without being run.
+// Without worker threads the master runs the checks in the order they were
+// added, so the outcome is deterministic.
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Stops_After_Failure)
+{
+    auto queue = MakeUnique<CountingFailing_Queue>(QUEUE_BATCH_SIZE);
+    for (const bool first_fails : {true, false}) {
+        CountingFailingCheck::n_calls = 0;
+        CCheckQueueControl<CountingFailingCheck> control(queue.get());
+        std::vector<CountingFailingCheck> vChecks;
+        vChecks.resize(1000, false);
+        vChecks[0] = first_fails;
+        control.Add(vChecks);
+        BOOST_REQUIRE(control.Wait() != first_fails);
+        BOOST_REQUIRE_EQUAL(CountingFailingCheck::n_calls, first_fails ? 1U : 1000U);
+    }
+}
+
 // Test that unique checks are actually all called individually, rather than
 // just one check being called repeatedly. Test that checks are not called
 // more than once as well
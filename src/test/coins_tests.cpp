@@ -8,14 +8,17 @@
 #include <script/standard.h>
 #include <streams.h>
 #include <test/util/setup_common.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <util/strencodings.h>
+#include <validation.h>
 
 #include <map>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
 
 int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out);
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight);
@@ -53,9 +56,9 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase) override
     {
-        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
                 // Same optimization used in CCoinsViewDB is to only write dirty entries.
                 map_[it->first] = it->second.coin;
@@ -64,7 +67,6 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
@@ -208,10 +210,15 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
         }
 
         if (InsecureRandRange(100) == 0) {
-            // Every 100 iterations, flush an intermediate cache
+            // Every 100 iterations, flush or sync an intermediate cache
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
-                BOOST_CHECK(stack[flushIndex]->Flush());
+                if (InsecureRandBool()) {
+                    BOOST_CHECK(stack[flushIndex]->Flush());
+                } else {
+                    BOOST_CHECK(stack[flushIndex]->Sync());
+                    stack[flushIndex]->Evict(stack[flushIndex]->DynamicMemoryUsage() / 2);
+                }
             }
         }
         if (InsecureRandRange(100) == 0) {
@@ -479,6 +486,206 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_sync_evict)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    cache.SetBestBlock(InsecureRand256());
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 4; ++i) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+        Coin coin;
+        coin.out.nValue = InsecureRand32();
+        coin.nHeight = 1;
+        cache.AddCoin(outpoints.back(), std::move(coin), false);
+    }
+    BOOST_CHECK(cache.SpendCoin(outpoints[3]));
+
+    // Sync writes the changes but keeps the unspent coins, no longer modified
+    BOOST_CHECK(cache.Sync());
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 3U);
+    for (int i = 0; i < 3; ++i) {
+        BOOST_CHECK(base.HaveCoin(outpoints[i]));
+        BOOST_CHECK(cache.HaveCoinInCache(outpoints[i]));
+        BOOST_CHECK_EQUAL(cache.map().at(outpoints[i]).flags, 0);
+    }
+    BOOST_CHECK(!base.HaveCoin(outpoints[3]));
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoints[3]));
+
+    // Modified coins are never evicted, and the recently used ones go last
+    BOOST_CHECK(cache.SpendCoin(outpoints[0]));
+    for (auto& entry : cache.map()) {
+        entry.second.recently_used = false;
+    }
+    cache.AccessCoin(outpoints[1]);
+    // Without anything to drop, evicting only compacts the cache
+    cache.Evict(cache.DynamicMemoryUsage());
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 3U);
+    BOOST_CHECK_EQUAL(cache.map().chunk_count(), 1U);
+    // The free slots of the chunk stay allocated, so do not count on them
+    cache.Evict(cache.DynamicMemoryUsage() - CCoinsMap::ENTRY_BYTES * (cache.map().capacity() - cache.map().size()) - 1);
+    cache.SelfTest();
+    BOOST_CHECK(cache.HaveCoinInCache(outpoints[0]) == false);
+    BOOST_CHECK_EQUAL(cache.map().count(outpoints[0]), 1U);
+    BOOST_CHECK(cache.HaveCoinInCache(outpoints[1]));
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoints[2]));
+
+    cache.Evict(0);
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+    BOOST_CHECK_EQUAL(cache.map().count(outpoints[0]), 1U);
+    BOOST_CHECK(base.HaveCoin(outpoints[1]));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_db_flush_thread)
+{
+    CCoinsViewDB db(GetDataDir() / "coins_flush", 1 << 20, true, false, true);
+    CCoinsViewCache cache(&db);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 1000; ++i) {
+        outpoints.emplace_back(InsecureRand256(), i);
+        Coin coin;
+        coin.out.nValue = InsecureRand32();
+        coin.nHeight = i;
+        cache.AddCoin(outpoints.back(), std::move(coin), false);
+    }
+    const uint256 first_block = InsecureRand256();
+    cache.SetBestBlock(first_block);
+    BOOST_CHECK(cache.Sync());
+    // The coins are visible whether or not the flush thread is done with them
+    BOOST_CHECK(db.GetBestBlock() == first_block);
+    for (const COutPoint& outpoint : outpoints) {
+        BOOST_CHECK(db.HaveCoin(outpoint));
+    }
+
+    for (size_t i = 0; i < outpoints.size(); i += 2) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+    }
+    const uint256 second_block = InsecureRand256();
+    cache.SetBestBlock(second_block);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(db.GetBestBlock() == second_block);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        Coin coin;
+        BOOST_CHECK_EQUAL(db.GetCoin(outpoints[i], coin), i % 2 == 1);
+    }
+
+    BOOST_CHECK(db.WaitForFlush());
+    BOOST_CHECK(db.GetBestBlock() == second_block);
+    size_t count = 0;
+    std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint key;
+        BOOST_CHECK(cursor->GetKey(key));
+        BOOST_CHECK_EQUAL(key.n % 2, 1U);
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(count, outpoints.size() / 2);
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_block_coins)
+{
+    CCoinsViewTest base;
+    std::vector<COutPoint> outpoints;
+    {
+        CCoinsViewCacheTest writer(&base);
+        for (int i = 0; i < 100; ++i) {
+            outpoints.emplace_back(InsecureRand256(), 0);
+            Coin coin;
+            coin.out.nValue = InsecureRand32();
+            coin.nHeight = 1;
+            writer.AddCoin(outpoints.back(), std::move(coin), false);
+        }
+        writer.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(writer.Flush());
+    }
+    CCoinsViewCacheTest cache(&base);
+    cache.AccessCoin(outpoints[0]);
+
+    // The block spends all the coins, an output of its own and a missing coin
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    CMutableTransaction spend;
+    for (const COutPoint& outpoint : outpoints) {
+        spend.vin.emplace_back(outpoint);
+    }
+    spend.vout.resize(1);
+    CMutableTransaction child;
+    child.vin.emplace_back(CTransaction(spend).GetHash(), 0);
+    child.vin.emplace_back(InsecureRand256(), 0);
+    CBlock block;
+    block.vtx = {MakeTransactionRef(coinbase), MakeTransactionRef(spend), MakeTransactionRef(child)};
+
+    // Nothing happens without worker threads
+    PrefetchBlockCoins(block, cache, base);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+
+    boost::thread_group threads;
+    for (int i = 0; i < 3; ++i) {
+        threads.create_thread([i]() { ThreadCoinsPrefetch(i); });
+    }
+    g_parallel_coins_prefetch = true;
+    PrefetchBlockCoins(block, cache, base);
+    g_parallel_coins_prefetch = false;
+    threads.interrupt_all();
+    threads.join_all();
+
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), outpoints.size());
+    for (const COutPoint& outpoint : outpoints) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+        BOOST_CHECK_EQUAL(cache.map().at(outpoint).flags, 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_db_flush_usage)
+{
+    CCoinsViewDB db(GetDataDir() / "coins_flush_usage", 1 << 20, true, false, true);
+    CCoinsViewCache cache(&db);
+    BOOST_CHECK_EQUAL(db.DynamicMemoryUsage(), 0U);
+
+    CScript script;
+    script.assign((uint32_t)56, 1);
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 1000; ++i) {
+        outpoints.emplace_back(InsecureRand256(), i);
+        Coin coin;
+        coin.out.nValue = InsecureRand32();
+        coin.out.scriptPubKey = script;
+        coin.nHeight = i;
+        cache.AddCoin(outpoints.back(), std::move(coin), false);
+    }
+    cache.SetBestBlock(InsecureRand256());
+
+    // The snapshot in flight is reported until it is on disk
+    db.SetFlushPaused(true);
+    BOOST_CHECK(cache.Sync());
+    const size_t flushing_usage = db.DynamicMemoryUsage();
+    BOOST_CHECK_GT(flushing_usage, outpoints.size() * memusage::DynamicUsage(script));
+    BOOST_CHECK(db.HaveCoin(outpoints.front()));
+
+    // Spending a coin only changes the cache, not the snapshot
+    BOOST_CHECK(cache.SpendCoin(outpoints.front()));
+    BOOST_CHECK_EQUAL(db.DynamicMemoryUsage(), flushing_usage);
+
+    db.SetFlushPaused(false);
+    BOOST_CHECK(db.WaitForFlush());
+    BOOST_CHECK_EQUAL(db.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK(db.HaveCoin(outpoints.back()));
+
+    // The spent coin goes out with the next snapshot
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(db.WaitForFlush());
+    BOOST_CHECK_EQUAL(db.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK(!db.HaveCoin(outpoints.front()));
+}
+
 BOOST_AUTO_TEST_CASE(ccoins_serialization)
 {
     // Good example
@@ -594,7 +801,7 @@ void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
     CCoinsMap map;
     InsertCoinsMapEntry(map, value, flags);
-    BOOST_CHECK(view.BatchWrite(map, {}));
+    BOOST_CHECK(view.BatchWrite(map, {}, true));
 }
 
 class SingleEntryCacheTest
@@ -2,6 +2,8 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <crypto/Lyra2RE/Lyra2RE.h>
+#include <crypto/Lyra2RE/sph_bmw.h>
 #include <crypto/aes.h>
 #include <crypto/chacha20.h>
 #include <crypto/chacha_poly_aead.h>
@@ -9,14 +11,17 @@
 #include <crypto/hkdf_sha256_32.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
 #include <crypto/sha512.h>
 #include <random.h>
+#include <streams.h>
 #include <util/strencodings.h>
 #include <test/util/setup_common.h>
 
+#include <algorithm>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -292,6 +297,54 @@ BOOST_AUTO_TEST_CASE(sha512_testvectors) {
                "37de8c3ef5459d76a52cedc02dc499a3c9ed9dedbfb3281afd9653b8a112fafc");
 }
 
+static void TestBMW256(const std::string &hexin, const std::string &hexout)
+{
+    const std::vector<unsigned char> in = ParseHex(hexin);
+    std::vector<unsigned char> out(32);
+    sph_bmw256_context ctx;
+    sph_bmw256_init(&ctx);
+    sph_bmw256(&ctx, in.data(), in.size());
+    sph_bmw256_close(&ctx, out.data());
+    BOOST_CHECK_EQUAL(HexStr(out), hexout);
+}
+
+BOOST_AUTO_TEST_CASE(bmw256_testvectors) {
+    // The last hash of Lyra2REv2. The lengths around one 64 byte block leave
+    // room for the bit count in the last block, or push it into another one.
+    TestBMW256("", "82cac4bf6f4c2b41fbcc0e0984e9d8b76d7662f8e1789cdfbd85682acc55577a");
+    TestBMW256("616263", "57d11fc94bdf98e6a0d0bf1d4ddda3f4205e873666a644b5bb585e171ad87d34");
+    TestBMW256("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+               "202122232425262728292a2b2c2d2e2f30313233343536",
+               "8c1d1014c3a3daf448c7180473a6c1ee6b190c0f9ae0140cf54de79ed4bd9472");
+    TestBMW256("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+               "202122232425262728292a2b2c2d2e2f3031323334353637",
+               "693d3adc06137fdc8d48b7bda099fd85302d82053e01f9b48a6367f2fc14fcb5");
+    TestBMW256("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+               "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f",
+               "007a7b7f61cefbe883ffa9ebeb950e37ba2130e282b19fbf045c7779a2fcd4c1");
+}
+
+static void TestLyra2(void (*hash)(const char*, char*), const std::string &hexin, const std::string &hexout)
+{
+    std::vector<unsigned char> in = ParseHex(hexin);
+    std::vector<unsigned char> out(32);
+    BOOST_REQUIRE_EQUAL(in.size(), 80U);
+    hash((const char*)in.data(), (char*)out.data());
+    BOOST_CHECK_EQUAL(HexStr(out), hexout);
+}
+
+BOOST_AUTO_TEST_CASE(lyra2_testvectors) {
+    // Run with whichever sponge implementation Lyra2AutoDetect() selected.
+    const std::string zeros(160, '0');
+    const std::string counting = "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+                                 "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+                                 "404142434445464748494a4b4c4d4e4f";
+    TestLyra2(lyra2re2_hash, zeros, "a297c8d991274c8727f515d4b129e18ddb1c61b31c552c963efce71095baa90c");
+    TestLyra2(lyra2re2_hash, counting, "2246faafca15a01a35c81a3f801fe8338942565bdb75a505517372aa0c7afdd0");
+    TestLyra2(lyra2re_hash, zeros, "c6165cb3a82b8f39ed9feaa5fa5be3d7041b0fd30128a42ed0b78ff2b665f81a");
+    TestLyra2(lyra2re_hash, counting, "dda1487831430df5d5fc1ee3a7bac672a13589dfdcf6a44efdc143a5c0202d10");
+}
+
 BOOST_AUTO_TEST_CASE(hmac_sha256_testvectors) {
     // test cases 1, 2, 3, 4, 6 and 7 of RFC 4231
     TestHMACSHA256("0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b",
@@ -750,4 +803,116 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(lyra2re2_hashes_batch)
+{
+    // Cover the 8-way, 4-way and one-at-a-time paths, alone and combined.
+    for (int i = 0; i <= 19; ++i) {
+        char in[80 * 19];
+        char out1[32 * 19], out2[32 * 19];
+        for (int j = 0; j < 80 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            lyra2re2_hash(in + 80 * j, out1 + 32 * j);
+        }
+        lyra2re2_hashes(in, out2, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
+static MuHash3072 FromInt(unsigned char i) {
+    const unsigned char tmp[32] = {i, 0};
+    return MuHash3072(MakeSpan(tmp));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    uint256 out;
+
+    // Values that do not fit below the prime are reduced.
+    unsigned char max[Num3072::BYTE_SIZE], reduced[Num3072::BYTE_SIZE];
+    memset(max, 0xff, sizeof(max));
+    Num3072(max).ToBytes(reduced);
+    BOOST_CHECK_EQUAL(HexStr(reduced, reduced + 4), "64d71000");
+    BOOST_CHECK(std::all_of(reduced + 4, reduced + sizeof(reduced), [](unsigned char c) { return c == 0; }));
+
+    MuHash3072().Finalize(out);
+    BOOST_CHECK_EQUAL(out.GetHex(), "dd5ad2a105c2d29495f577245c357409002329b9f4d6182c0af3dc2f462555c8");
+
+    MuHash3072 acc = FromInt(0);
+    acc *= FromInt(1);
+    acc.Finalize(out);
+    BOOST_CHECK_EQUAL(out.GetHex(), "9c96c6aa15a783f3e6c3d61634e5b9579118f92e0bf562ca3506ddf6b43ac647");
+    acc *= FromInt(2);
+    acc /= FromInt(1);
+    acc.Finalize(out);
+    BOOST_CHECK_EQUAL(out.GetHex(), "33bdcb54b3b5510927593093d80bf5a3101c7d80d9485dc66e334cd1985b1511");
+
+    for (int iter = 0; iter < 10; ++iter) {
+        uint256 res;
+        int table[4];
+        for (int i = 0; i < 4; ++i) {
+            table[i] = InsecureRandBits(3);
+        }
+        for (int order = 0; order < 4; ++order) {
+            MuHash3072 acc;
+            for (int i = 0; i < 4; ++i) {
+                int t = table[i ^ order];
+                if (t & 4) {
+                    acc /= FromInt(t & 3);
+                } else {
+                    acc *= FromInt(t & 3);
+                }
+            }
+            acc.Finalize(out);
+            if (order == 0) {
+                res = out;
+            } else {
+                BOOST_CHECK(res == out);
+            }
+        }
+
+        MuHash3072 x = FromInt(InsecureRandBits(4)); // x=X
+        MuHash3072 y = FromInt(InsecureRandBits(4)); // x=X, y=Y
+        MuHash3072 z; // x=X, y=Y, z=1
+        z *= x; // x=X, y=Y, z=X
+        z *= y; // x=X, y=Y, z=X*Y
+        y *= x; // x=X, y=Y*X, z=X*Y
+        z /= y; // x=X, y=Y*X, z=1
+        z.Finalize(out);
+
+        uint256 out2;
+        MuHash3072().Finalize(out2);
+        BOOST_CHECK_EQUAL(out, out2);
+    }
+
+    // Inserting and removing elements is the same as combining with the set of
+    // that one element.
+    MuHash3072 acc2 = FromInt(0);
+    const unsigned char tmp[32] = {1, 0};
+    acc2.Insert(MakeSpan(tmp));
+    const unsigned char tmp2[32] = {2, 0};
+    acc2.Insert(MakeSpan(tmp2));
+    acc2.Remove(MakeSpan(tmp));
+    uint256 out3;
+    acc2.Finalize(out3);
+    MuHash3072 acc3 = FromInt(0);
+    acc3 *= FromInt(2);
+    acc3.Finalize(out);
+    BOOST_CHECK_EQUAL(out, out3);
+
+    // The running state survives a round trip through serialization,
+    // including a pending denominator.
+    CDataStream ss(SER_DISK, 0);
+    ss << acc2;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 acc4;
+    ss >> acc4;
+    acc4.Insert(MakeSpan(tmp));
+    acc2.Insert(MakeSpan(tmp));
+    acc4.Finalize(out);
+    acc2.Finalize(out3);
+    BOOST_CHECK_EQUAL(out, out3);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include <random.h>
 #include <thread>
 #include <deque>
+#include <set>
 
 /** Test Suite for CuckooCache
  *
@@ -363,4 +364,39 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/* Test that for_each visits exactly the elements that are not marked for
+ * erasure, so that saving and reloading a cache keeps its live entries.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    // Far below capacity, so nothing is evicted.
+    std::vector<uint256> hashes(1000);
+    for (uint256& hash : hashes) {
+        hash = InsecureRand256();
+        cc.insert(hash);
+    }
+    for (size_t i = 0; i < hashes.size(); i += 2) {
+        BOOST_CHECK(cc.contains(hashes[i], true));
+    }
+
+    std::set<uint256> live;
+    cc.for_each([&live](const uint256& hash) { live.insert(hash); });
+    BOOST_CHECK_EQUAL(live.size(), hashes.size() / 2);
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        BOOST_CHECK_EQUAL(live.count(hashes[i]), i % 2);
+    }
+
+    CuckooCache::cache<uint256, SignatureCacheHasher> reloaded{};
+    reloaded.setup_bytes(1 << 20);
+    for (const uint256& hash : live) {
+        reloaded.insert(hash);
+    }
+    for (size_t i = 1; i < hashes.size(); i += 2) {
+        BOOST_CHECK(reloaded.contains(hashes[i], false));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
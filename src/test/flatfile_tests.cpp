@@ -123,4 +123,60 @@ BOOST_AUTO_TEST_CASE(flatfile_flush)
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1);
 }
 
+BOOST_AUTO_TEST_CASE(flatfile_map)
+{
+    const auto data_dir = GetDataDir();
+    FlatFileSeq seq(data_dir, "m", 100);
+    MappedFlatFileSeq maps(1);
+
+    const std::string line1("A purely peer-to-peer version of electronic cash would allow online "
+                            "payments to be sent directly from one party to another without going "
+                            "through a financial institution.");
+    const std::string line2("Digital signatures provide part of the solution, but the main "
+                            "benefits are lost if a trusted third party is still required to "
+                            "prevent double-spending.");
+    const auto write = [&](const FlatFilePos& pos, const std::string& line) {
+        CAutoFile file(seq.Open(pos), SER_DISK, CLIENT_VERSION);
+        file.write(line.data(), line.size());
+    };
+    const auto text = [](const std::shared_ptr<const MappedFlatFile>& mapping, size_t pos, size_t size) {
+        return std::string(mapping->Data().begin() + pos, mapping->Data().begin() + pos + size);
+    };
+
+    // Files that do not exist, and ranges past the end of a file, are not mapped.
+    BOOST_CHECK(!maps.Map(seq, FlatFilePos(0, 0), 1));
+    write(FlatFilePos(0, 0), line1);
+    BOOST_CHECK(!maps.Map(seq, FlatFilePos(0, 0), line1.size() + 1));
+
+#ifndef WIN32
+    auto mapping = maps.Map(seq, FlatFilePos(0, 0), line1.size());
+    BOOST_REQUIRE(mapping);
+    BOOST_CHECK_EQUAL(text(mapping, 0, line1.size()), line1);
+    BOOST_CHECK(maps.Map(seq, FlatFilePos(0, 10), 10) == mapping);
+
+    // The file is remapped once data past the old mapping is asked for.
+    write(FlatFilePos(0, line1.size()), line2);
+    auto remapped = maps.Map(seq, FlatFilePos(0, line1.size()), line2.size());
+    BOOST_REQUIRE(remapped);
+    BOOST_CHECK(remapped != mapping);
+    BOOST_CHECK_EQUAL(text(remapped, line1.size(), line2.size()), line2);
+
+    // Only one file is kept mapped, but a dropped mapping stays readable
+    // while it is referenced.
+    write(FlatFilePos(1, 0), line2);
+    auto other = maps.Map(seq, FlatFilePos(1, 0), line2.size());
+    BOOST_REQUIRE(other);
+    BOOST_CHECK_EQUAL(text(remapped, 0, line1.size()), line1);
+    BOOST_CHECK(maps.Map(seq, FlatFilePos(0, 0), line1.size()) != remapped);
+
+    maps.Unmap(seq, FlatFilePos(1, 0));
+    BOOST_CHECK(maps.Map(seq, FlatFilePos(1, 0), line2.size()) != other);
+    BOOST_CHECK_EQUAL(text(other, 0, line2.size()), line2);
+
+    // Mapping can be disabled.
+    MappedFlatFileSeq no_maps(0);
+    BOOST_CHECK(!no_maps.Map(seq, FlatFilePos(0, 0), line1.size()));
+#endif
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -51,6 +51,7 @@ void test_one_input(const std::vector<uint8_t>& buffer)
             BlockStatus::BLOCK_FAILED_CHILD,
             BlockStatus::BLOCK_FAILED_MASK,
             BlockStatus::BLOCK_OPT_WITNESS,
+            BlockStatus::BLOCK_POW_VERIFIED,
         });
         if (block_status & ~BLOCK_VALID_MASK) {
             continue;
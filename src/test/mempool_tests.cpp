@@ -3,16 +3,19 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <policy/policy.h>
+#include <rpc/blockchain.h>
 #include <txmempool.h>
 #include <util/system.h>
 #include <util/time.h>
 
 #include <test/util/setup_common.h>
 
+#include <univalue.h>
+
 #include <boost/test/unit_test.hpp>
 #include <vector>
 
-BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
+BOOST_FIXTURE_TEST_SUITE(mempool_tests, RegTestingSetup)
 
 static constexpr auto REMOVAL_REASON_DUMMY = MemPoolRemovalReason::REPLACED;
 
@@ -788,4 +791,124 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    CTransactionRef ta = make_tx(/* output_values */ {10 * COIN});
+    CTransactionRef tb = make_tx(/* output_values */ {5 * COIN});
+    CTransactionRef tc = make_tx(/* output_values */ {COIN}, /* inputs */ {ta});
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(ta));
+    pool.addUnchecked(entry.Fee(20000LL).FromTx(tb));
+    pool.addUnchecked(entry.Fee(50000LL).FromTx(tc));
+
+    // Sorted by ancestor count, and then by fee rate
+    auto snapshot = pool.GetSnapshot();
+    BOOST_REQUIRE_EQUAL(snapshot->size(), 3U);
+    BOOST_CHECK((*snapshot)[0].tx == tb);
+    BOOST_CHECK((*snapshot)[1].tx == ta);
+    BOOST_CHECK((*snapshot)[2].tx == tc);
+    std::vector<uint256> hashes;
+    pool.queryHashes(hashes);
+    BOOST_CHECK(hashes == std::vector<uint256>({tb->GetHash(), ta->GetHash(), tc->GetHash()}));
+
+    const TxMempoolSnapshotEntry& a = (*snapshot)[1];
+    const TxMempoolSnapshotEntry& c = (*snapshot)[2];
+    BOOST_CHECK_EQUAL(a.count_with_descendants, 2U);
+    BOOST_CHECK_EQUAL(a.mod_fees_with_descendants, 60000);
+    BOOST_CHECK_EQUAL(c.count_with_ancestors, 2U);
+
+    // The links follow from the transactions in the snapshot
+    const std::vector<TxMempoolSnapshotLinks> links = GetSnapshotLinks(*snapshot);
+    BOOST_REQUIRE_EQUAL(links.size(), 3U);
+    BOOST_CHECK(links[0].parents.empty() && links[0].children.empty());
+    BOOST_CHECK(links[1].children == std::vector<uint256>({tc->GetHash()}));
+    BOOST_CHECK(links[1].parents.empty());
+    BOOST_CHECK(links[2].parents == std::vector<uint256>({ta->GetHash()}));
+    BOOST_CHECK(links[2].children.empty());
+
+    // The snapshot is shared until the mempool changes
+    BOOST_CHECK(pool.GetSnapshot() == snapshot);
+
+    pool.PrioritiseTransaction(ta->GetHash(), 100000);
+    auto prioritised = pool.GetSnapshot();
+    BOOST_CHECK(prioritised != snapshot);
+    BOOST_CHECK_EQUAL((*prioritised)[1].modified_fee, 110000);
+    BOOST_CHECK_EQUAL((*prioritised)[2].mod_fees_with_ancestors, 160000);
+    BOOST_CHECK_EQUAL(a.modified_fee, 10000);
+
+    pool.removeRecursive(*tc, REMOVAL_REASON_DUMMY);
+    BOOST_CHECK_EQUAL(pool.GetSnapshot()->size(), 2U);
+    BOOST_CHECK_EQUAL(prioritised->size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolToJSONChunksTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    std::vector<std::string> chunks;
+    auto write = [&chunks](const std::string& chunk) { chunks.push_back(chunk); };
+    MempoolToJSONChunks(pool, 100, write);
+    BOOST_REQUIRE_EQUAL(chunks.size(), 1U);
+    BOOST_CHECK_EQUAL(chunks[0], "{}");
+
+    CTransactionRef parent = make_tx(/* output_values */ std::vector<CAmount>(20, COIN));
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(parent));
+    for (uint32_t i = 0; i < 20; ++i) {
+        pool.addUnchecked(entry.Fee(1000LL * i).FromTx(make_tx(/* output_values */ {COIN / 2}, /* inputs */ {parent}, /* input_indices */ {i})));
+    }
+
+    // The same JSON as the whole reply, in pieces
+    chunks.clear();
+    MempoolToJSONChunks(pool, 1000, write);
+    BOOST_CHECK(chunks.size() > 1);
+    std::string json;
+    for (const std::string& chunk : chunks) {
+        json += chunk;
+    }
+    BOOST_CHECK_EQUAL(json, MempoolToJSON(pool, true).write());
+    for (size_t i = 0; i + 1 < chunks.size(); ++i) {
+        BOOST_CHECK(chunks[i].size() >= 1000);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MempoolRemovalSequenceTest)
+{
+    CTxMemPool pool;
+    CTxMemPool other_pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    const uint64_t created = pool.GetRemovalSequence();
+    BOOST_CHECK(created != WITH_LOCK(other_pool.cs, return other_pool.GetRemovalSequence()));
+
+    // Additions leave it alone, whether they spend other entries or not
+    CTransactionRef ta = make_tx(/* output_values */ {10 * COIN});
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(ta));
+    BOOST_CHECK_EQUAL(pool.GetRemovalSequence(), created);
+    CTransactionRef tb = make_tx(/* output_values */ {COIN}, /* inputs */ {ta});
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(tb));
+    BOOST_CHECK_EQUAL(pool.GetRemovalSequence(), created);
+
+    // The entries added since can be told apart until then
+    std::vector<CTxMemPool::txiter> added = pool.GetEntriesAddedSince(1);
+    BOOST_REQUIRE_EQUAL(added.size(), 1U);
+    BOOST_CHECK(added[0]->GetSharedTx() == tb);
+    BOOST_CHECK_EQUAL(pool.GetEntriesAddedSince(0).size(), 2U);
+    BOOST_CHECK(pool.GetEntriesAddedSince(2).empty());
+
+    // Fee changes and removals do not
+    pool.PrioritiseTransaction(ta->GetHash(), 1000);
+    const uint64_t prioritised = pool.GetRemovalSequence();
+    BOOST_CHECK(prioritised != created);
+
+    pool.removeRecursive(*tb, REMOVAL_REASON_DUMMY);
+    BOOST_CHECK(pool.GetRemovalSequence() != prioritised);
+    BOOST_CHECK(pool.GetRemovalSequence() != created);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
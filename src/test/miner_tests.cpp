@@ -526,4 +526,138 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+static void CheckSameTemplate(const CBlockTemplate& extended, const CBlockTemplate& rebuilt)
+{
+    BOOST_REQUIRE_EQUAL(extended.block.vtx.size(), rebuilt.block.vtx.size());
+    for (size_t i = 0; i < extended.block.vtx.size(); ++i) {
+        BOOST_CHECK(extended.block.vtx[i]->GetHash() == rebuilt.block.vtx[i]->GetHash());
+    }
+    BOOST_CHECK(extended.vTxFees == rebuilt.vTxFees);
+    BOOST_CHECK(extended.vTxSigOpsCost == rebuilt.vTxSigOpsCost);
+}
+
+// Test that a template built from the last one matches a template picked from
+// scratch for the same mempool, both when the mempool only gained transactions
+// since and when some were replaced, prioritised or evicted. On regtest, where
+// the templates on top of the genesis block need no mined coins to spend.
+BOOST_FIXTURE_TEST_CASE(CreateNewBlock_extended, RegTestingSetup)
+{
+    LOCK2(cs_main, m_node.mempool->cs);
+    const CChainParams& chainparams = Params();
+    const CScript scriptPubKey = CScript() << OP_TRUE;
+    BlockAssembler::Options options;
+    options.nBlockMaxWeight = MAX_BLOCK_WEIGHT;
+    options.blockMinFeeRate = blockMinFeeRate;
+
+    TestMemPoolEntryHelper entry;
+    auto next_template = [&] {
+        std::unique_ptr<CBlockTemplate> extended = BlockAssembler(*m_node.mempool, chainparams, options).CreateNewBlock(scriptPubKey);
+        ResetLastBlockSelection();
+        std::unique_ptr<CBlockTemplate> rebuilt = BlockAssembler(*m_node.mempool, chainparams, options).CreateNewBlock(scriptPubKey);
+        CheckSameTemplate(*extended, *rebuilt);
+        return extended;
+    };
+    auto spend = [&](const uint256& prev_hash, CAmount prev_value, CAmount fee, unsigned int sigops, uint32_t lock_time = 0) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vin[0].prevout.hash = prev_hash;
+        tx.vin[0].prevout.n = 0;
+        if (lock_time) tx.vin[0].nSequence = 0;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = prev_value - fee;
+        tx.nLockTime = lock_time;
+        m_node.mempool->addUnchecked(entry.Fee(fee).Time(GetTime()).SigOpsCost(sigops).FromTx(tx));
+        return tx.GetHash();
+    };
+
+    // Coins for the transactions to spend
+    std::vector<uint256> funding;
+    for (int i = 0; i < 8; ++i) {
+        funding.push_back(InsecureRand256());
+        ::ChainstateActive().CoinsTip().AddCoin(COutPoint(funding.back(), 0), Coin(CTxOut(50 * COIN, CScript()), 1, false), false);
+    }
+
+    // The first template is picked from scratch.
+    ResetLastBlockSelection();
+    uint256 hashLowFeeTx = spend(funding[0], 50 * COIN, 1000, 4);
+    uint256 hashMediumFeeTx = spend(funding[1], 50 * COIN, 20000, 8);
+    std::unique_ptr<CBlockTemplate> pblocktemplate = next_template();
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashMediumFeeTx);
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashLowFeeTx);
+
+    // Transactions that entered the mempool since go where their fee rate
+    // puts them, not after the ones picked before.
+    uint256 hashHighFeeTx = spend(funding[2], 50 * COIN, 50000, 12);
+    pblocktemplate = next_template();
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 4U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashHighFeeTx);
+
+    uint256 hashFeeTx = spend(funding[3], 50 * COIN, 5000, 16);
+    pblocktemplate = next_template();
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 5U);
+    BOOST_CHECK(pblocktemplate->block.vtx[3]->GetHash() == hashFeeTx);
+
+    // A child of a transaction picked before waits for it, even if it pays
+    // more than the packages in between
+    uint256 hashHighFeeChildTx = spend(hashHighFeeTx, 50 * COIN - 50000, 2000, 4);
+    uint256 hashMediumFeeChildTx = spend(hashMediumFeeTx, 50 * COIN - 20000, 10000, 4);
+    pblocktemplate = next_template();
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 7U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashHighFeeTx);
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashMediumFeeTx);
+    BOOST_CHECK(pblocktemplate->block.vtx[3]->GetHash() == hashMediumFeeChildTx);
+    BOOST_CHECK(pblocktemplate->block.vtx[5]->GetHash() == hashHighFeeChildTx);
+
+    // Transactions paying too little, or not final yet, stay out
+    uint256 hashFreeTx = spend(funding[4], 50 * COIN, 0, 4);
+    uint256 hashLockedTx = spend(funding[5], 50 * COIN, 100000, 4, ::ChainActive().Height() + 10);
+    pblocktemplate = next_template();
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 7U);
+    uint256 hashAfterFreeTx = spend(funding[6], 50 * COIN, 500, 4);
+    pblocktemplate = next_template();
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 8U);
+    BOOST_CHECK(pblocktemplate->block.vtx[7]->GetHash() == hashAfterFreeTx);
+    spend(hashFreeTx, 50 * COIN, 0, 4);
+    spend(hashLockedTx, 50 * COIN - 100000, 200000, 4);
+    pblocktemplate = next_template();
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 8U);
+
+    // Replace the medium fee transaction with a lower fee one
+    m_node.mempool->removeRecursive(*m_node.mempool->get(hashMediumFeeTx), MemPoolRemovalReason::REPLACED);
+    BOOST_CHECK(!m_node.mempool->exists(hashMediumFeeTx));
+    spend(funding[1], 50 * COIN, 2000, 8);
+    pblocktemplate = next_template();
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 7U);
+
+    // A child paying for its low fee parent moves the parent up
+    uint256 hashChildTx = spend(hashLowFeeTx, 50 * COIN - 1000, 200000, 20);
+    pblocktemplate = next_template();
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 8U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashLowFeeTx);
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashChildTx);
+
+    // Prioritising a transaction moves it up as well, and its children only
+    // count the fee it was prioritised to
+    m_node.mempool->PrioritiseTransaction(hashFeeTx, 1000000);
+    pblocktemplate = next_template();
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 8U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashFeeTx);
+    spend(hashFeeTx, 50 * COIN - 5000, 1000, 4);
+    pblocktemplate = next_template();
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 9U);
+
+    // Evict the transaction that pays nothing, and its child, and let a new
+    // one take the coin it spent; its sigops put it just after the high fee one
+    m_node.mempool->removeRecursive(*m_node.mempool->get(hashFreeTx), MemPoolRemovalReason::SIZELIMIT);
+    pblocktemplate = next_template();
+
+    uint256 hashNewTx = spend(funding[4], 50 * COIN, 60000, 24);
+    std::unique_ptr<CBlockTemplate> pblocktemplateNew = next_template();
+    BOOST_REQUIRE_EQUAL(pblocktemplateNew->block.vtx.size(), pblocktemplate->block.vtx.size() + 1);
+    BOOST_CHECK(pblocktemplateNew->block.vtx[4]->GetHash() == hashHighFeeTx);
+    BOOST_CHECK(pblocktemplateNew->block.vtx[5]->GetHash() == hashNewTx);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include <addrdb.h>
 #include <addrman.h>
+#include <arith_uint256.h>
 #include <clientversion.h>
 #include <test/util/setup_common.h>
 #include <string>
@@ -191,6 +192,36 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(cnode_dandelion_inventory_known)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+
+    const unsigned int saved_inventory_known = g_dandelion_inventory_known;
+    g_dandelion_inventory_known = 100;
+    std::unique_ptr<CNode> pnode = MakeUnique<CNode>(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", false);
+    g_dandelion_inventory_known = saved_inventory_known;
+
+    CNodeStats stats;
+    pnode->copyStats(stats, {});
+    const size_t memory = stats.m_dandelion_inventory_known_bytes;
+    BOOST_CHECK(memory > 0);
+
+    BOOST_CHECK(!pnode->IsDandelionInventoryKnown(ArithToUint256(0)));
+    for (int i = 0; i < 1000; ++i) {
+        pnode->AddDandelionInventoryKnown(ArithToUint256(i));
+    }
+    // Recent transactions are remembered, old ones are forgotten and the
+    // memory used does not grow
+    for (int i = 900; i < 1000; ++i) {
+        BOOST_CHECK(pnode->IsDandelionInventoryKnown(ArithToUint256(i)));
+    }
+    BOOST_CHECK(!pnode->IsDandelionInventoryKnown(ArithToUint256(0)));
+    pnode->copyStats(stats, {});
+    BOOST_CHECK_EQUAL(stats.m_dandelion_inventory_known_bytes, memory);
+}
+
 // prior to PR #14728, this test triggers an undefined behavior
 BOOST_AUTO_TEST_CASE(ipv4_peer_with_ipv6_addrMe_test)
 {
@@ -319,4 +350,48 @@ BOOST_AUTO_TEST_CASE(PoissonNextSend)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(dandelion_embargoes)
+{
+    auto connman = MakeUnique<CConnman>(0x1337, 0x1337);
+    const uint256 a = uint256S("0a"), b = uint256S("0b"), c = uint256S("0c");
+
+    BOOST_CHECK(connman->insertDandelionEmbargo(a, 300));
+    BOOST_CHECK(connman->insertDandelionEmbargo(b, 100));
+    BOOST_CHECK(connman->insertDandelionEmbargo(c, 200));
+    BOOST_CHECK(!connman->insertDandelionEmbargo(a, 50));
+    BOOST_CHECK(connman->isTxDandelionEmbargoed(a));
+
+    // Nothing has expired yet
+    BOOST_CHECK(connman->popExpiredDandelionEmbargoes(100).empty());
+
+    // Removed embargoes never expire
+    BOOST_CHECK(connman->removeDandelionEmbargo(c));
+    BOOST_CHECK(!connman->removeDandelionEmbargo(c));
+    BOOST_CHECK(!connman->isTxDandelionEmbargoed(c));
+
+    // Expired embargoes come out oldest first, exactly once
+    std::vector<uint256> expired = connman->popExpiredDandelionEmbargoes(1000);
+    BOOST_CHECK(expired == std::vector<uint256>({b, a}));
+    BOOST_CHECK(connman->popExpiredDandelionEmbargoes(1000).empty());
+    BOOST_CHECK(!connman->isTxDandelionEmbargoed(a));
+
+    CDandelionStats stats = connman->getDandelionStats();
+    BOOST_CHECK_EQUAL(stats.nEmbargoed, 0U);
+    BOOST_CHECK_EQUAL(stats.nInserted, 3U);
+    BOOST_CHECK_EQUAL(stats.nExpired, 2U);
+    BOOST_CHECK_EQUAL(stats.nRemoved, 1U);
+    // Every embargo lasted less than a second
+    BOOST_CHECK_EQUAL(stats.vExpiredLatency[0], 2U);
+    BOOST_CHECK_EQUAL(stats.vRemovedLatency[0], 1U);
+
+    connman->recordDandelionEvent(DandelionEvent::STEM_RECEIVED);
+    connman->recordDandelionEvent(DandelionEvent::FLUFFED);
+    connman->recordDandelionEvent(DandelionEvent::FLUFFED);
+    stats = connman->getDandelionStats();
+    BOOST_CHECK_EQUAL(stats.nStemReceived, 1U);
+    BOOST_CHECK_EQUAL(stats.nStemRelayed, 0U);
+    BOOST_CHECK_EQUAL(stats.nFluffed, 2U);
+    BOOST_CHECK_EQUAL(stats.nLocalDestination, -1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
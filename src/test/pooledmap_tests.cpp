@@ -0,0 +1,191 @@
+// Copyright (c) 2020 The NIX Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <memusage.h>
+#include <pooledmap.h>
+#include <test/util/setup_common.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pooledmap_tests, BasicTestingSetup)
+
+namespace {
+//! Sends every key to one of eight buckets, with the same tag
+struct CollidingHasher {
+    size_t operator()(uint32_t key) const { return key % 8; }
+};
+
+struct SpreadHasher {
+    size_t operator()(uint32_t key) const { return key * 0x9E3779B97F4A7C15ULL; }
+};
+
+template <typename Hash>
+void RandomOperations(int rounds, uint32_t key_range)
+{
+    pooledmap<uint32_t, std::string, Hash> map;
+    std::map<uint32_t, std::string> real;
+    for (int i = 0; i < rounds; ++i) {
+        const uint32_t key = InsecureRandRange(key_range);
+        switch (InsecureRandRange(4)) {
+        case 0:
+        case 1: {
+            const std::string value(InsecureRandRange(64), 'a' + key % 26);
+            auto ret = map.emplace(key, value);
+            BOOST_CHECK_EQUAL(ret.second, real.emplace(key, value).second);
+            BOOST_CHECK_EQUAL(ret.first->first, key);
+            BOOST_CHECK(ret.first->second == real.at(key));
+            break;
+        }
+        case 2: {
+            auto it = map.find(key);
+            BOOST_CHECK_EQUAL(it != map.end(), real.erase(key) == 1);
+            if (it != map.end()) map.erase(it);
+            break;
+        }
+        case 3:
+            BOOST_CHECK_EQUAL(map.count(key), real.count(key));
+            if (real.count(key)) BOOST_CHECK(map.at(key) == real.at(key));
+            break;
+        }
+        BOOST_CHECK_EQUAL(map.size(), real.size());
+    }
+
+    std::map<uint32_t, std::string> contents;
+    for (const auto& entry : map) {
+        BOOST_CHECK(contents.emplace(entry.first, entry.second).second);
+    }
+    BOOST_CHECK(contents == real);
+}
+} // namespace
+
+BOOST_AUTO_TEST_CASE(pooledmap_random)
+{
+    RandomOperations<SpreadHasher>(20000, 1000);
+    RandomOperations<SpreadHasher>(20000, 100000);
+    RandomOperations<CollidingHasher>(5000, 300);
+}
+
+BOOST_AUTO_TEST_CASE(pooledmap_stable_references)
+{
+    pooledmap<uint32_t, std::string, SpreadHasher> map;
+    std::vector<const std::string*> refs;
+    for (uint32_t i = 0; i < 10000; ++i) {
+        refs.push_back(&map.emplace(i, std::to_string(i)).first->second);
+    }
+    // Growing the buckets and the pool moved nothing
+    for (uint32_t i = 0; i < 10000; ++i) {
+        BOOST_CHECK(refs[i] == &map.at(i));
+        BOOST_CHECK_EQUAL(*refs[i], std::to_string(i));
+    }
+
+    // Erased slots are kept, and reused before the pool grows
+    const size_t chunks = map.chunk_count();
+    const size_t capacity = map.capacity();
+    for (uint32_t i = 0; i < 10000; i += 2) {
+        map.erase(map.find(i));
+    }
+    BOOST_CHECK_EQUAL(map.capacity(), capacity);
+    for (uint32_t i = 0; i < 10000; i += 2) {
+        map[i + 10000] = "new";
+    }
+    BOOST_CHECK_EQUAL(map.chunk_count(), chunks);
+    BOOST_CHECK_EQUAL(map.capacity(), capacity);
+    for (uint32_t i = 1; i < 10000; i += 2) {
+        BOOST_CHECK(refs[i] == &map.at(i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pooledmap_usage)
+{
+    pooledmap<uint32_t, std::string, SpreadHasher> map;
+    for (uint32_t i = 0; i < 5000; ++i) {
+        map.emplace(i, std::to_string(i));
+    }
+    BOOST_CHECK_GE(map.capacity(), map.size());
+    BOOST_CHECK_GE(memusage::DynamicUsage(map), decltype(map)::ENTRY_BYTES * map.capacity());
+
+    // Insert-then-erase cycles neither leak nor hide memory. The first cycle
+    // may still grow the buckets to make room for the erased ones.
+    size_t usage = 0;
+    for (int cycle = 0; cycle < 10; ++cycle) {
+        if (cycle == 1) usage = memusage::DynamicUsage(map);
+        for (uint32_t i = 0; i < 5000; ++i) {
+            map.erase(map.find(i + 5000 * cycle));
+        }
+        if (cycle > 0) BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), usage);
+        for (uint32_t i = 0; i < 5000; ++i) {
+            map.emplace(i + 5000 * (cycle + 1), std::to_string(i));
+        }
+        if (cycle > 0) BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), usage);
+    }
+
+    // Compacting releases the chunks the erased entries leave behind and
+    // keeps the contents
+    for (uint32_t i = 0; i < 5000; ++i) {
+        if (i % 10) map.erase(map.find(i + 50000));
+    }
+    map.compact();
+    BOOST_CHECK_EQUAL(map.size(), 500U);
+    // The smallest pool of chunks that holds 500 entries
+    BOOST_CHECK_EQUAL(map.chunk_count(), 6U);
+    BOOST_CHECK_EQUAL(map.capacity(), 1008U);
+    BOOST_CHECK(memusage::DynamicUsage(map) < usage / 5);
+    for (uint32_t i = 0; i < 5000; ++i) {
+        BOOST_CHECK_EQUAL(map.count(i + 50000), i % 10 ? 0U : 1U);
+        if (i % 10 == 0) BOOST_CHECK_EQUAL(map.at(i + 50000), std::to_string(i));
+    }
+    size_t count = 0;
+    for (const auto& entry : map) {
+        BOOST_CHECK_EQUAL(entry.first % 10, 0U);
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(count, 500U);
+
+    // The pool grows past the compacted slots as usual
+    for (uint32_t i = 0; i < 1000; ++i) {
+        map.emplace(i, "new");
+    }
+    BOOST_CHECK_EQUAL(map.size(), 1500U);
+    BOOST_CHECK_GE(map.capacity(), 1500U);
+    BOOST_CHECK_EQUAL(map.at(50000), "0");
+    BOOST_CHECK_EQUAL(map.at(999), "new");
+
+    map.clear();
+    map.compact();
+    BOOST_CHECK_EQUAL(map.capacity(), 0U);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), memusage::MallocUsage(decltype(map)::BUCKET_BYTES * map.bucket_count()));
+}
+
+BOOST_AUTO_TEST_CASE(pooledmap_erase_while_iterating)
+{
+    pooledmap<uint32_t, std::string, CollidingHasher> map;
+    for (uint32_t i = 0; i < 200; ++i) {
+        map.emplace(i, std::to_string(i));
+    }
+    std::vector<int> seen(200, 0);
+    for (auto it = map.begin(); it != map.end();) {
+        ++seen[it->first];
+        it = it->first % 3 ? map.erase(it) : std::next(it);
+    }
+    BOOST_CHECK(seen == std::vector<int>(200, 1));
+    BOOST_CHECK_EQUAL(map.size(), 67U);
+    for (uint32_t i = 0; i < 200; ++i) {
+        BOOST_CHECK_EQUAL(map.count(i), i % 3 ? 0U : 1U);
+    }
+
+    const size_t buckets = map.bucket_count();
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK_EQUAL(map.bucket_count(), buckets);
+    BOOST_CHECK_EQUAL(map.chunk_count(), 0U);
+    BOOST_CHECK(map.emplace(1, "one").second);
+    BOOST_CHECK_EQUAL(map.at(1), "one");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
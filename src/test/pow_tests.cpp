@@ -4,10 +4,12 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <miner.h>
 #include <pow.h>
 #include <test/util/setup_common.h>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(pow_tests, BasicTestingSetup)
 
@@ -135,4 +137,64 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(verify_pow_batch)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& consensus = chainParams->GetConsensus();
+    std::vector<CBlockHeader> headers(32);
+    for (size_t i = 0; i < headers.size(); ++i) {
+        headers[i].nTime = i;
+        headers[i].nBits = UintToArith256(consensus.powLimit).GetCompact();
+        while (!CheckProofOfWork(headers[i].GetPoWHash(), headers[i].nBits, consensus)) ++headers[i].nNonce;
+    }
+    std::vector<CBlockHeader> bad_headers = headers;
+    bad_headers[17].nBits = 0;
+
+    // Serial fallback
+    BOOST_CHECK(VerifyPoWBatch(Span<const CBlockHeader>(), consensus));
+    BOOST_CHECK(VerifyPoWBatch(Span<const CBlockHeader>(headers.data(), headers.size()), consensus));
+    BOOST_CHECK(!VerifyPoWBatch(Span<const CBlockHeader>(bad_headers.data(), bad_headers.size()), consensus));
+
+    // Parallel workers
+    boost::thread_group threads;
+    for (int i = 0; i < 3; ++i) {
+        threads.create_thread([i]() { ThreadPoWCheck(i); });
+    }
+    g_parallel_pow_checks = true;
+    BOOST_CHECK(VerifyPoWBatch(Span<const CBlockHeader>(headers.data(), headers.size()), consensus));
+    BOOST_CHECK(!VerifyPoWBatch(Span<const CBlockHeader>(bad_headers.data(), bad_headers.size()), consensus));
+    BOOST_CHECK(VerifyPoWBatch(Span<const CBlockHeader>(headers.data(), headers.size()), consensus));
+    g_parallel_pow_checks = false;
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(grind_block_nonce)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& consensus = chainParams->GetConsensus();
+    arith_uint256 target = UintToArith256(consensus.powLimit) >> 8;
+    CBlockHeader header;
+    header.nBits = target.GetCompact();
+
+    CBlockHeader scan = header;
+    while (!CheckProofOfWork(scan.GetPoWHash(), scan.nBits, consensus)) ++scan.nNonce;
+    const uint32_t expected = scan.nNonce;
+
+    // The lowest valid nonce is found whatever the number of threads
+    for (int threads : {1, 4}) {
+        CBlockHeader block = header;
+        uint64_t max_tries = 1000000;
+        BOOST_CHECK(GrindBlockNonce(&block, consensus, threads, max_tries));
+        BOOST_CHECK_EQUAL(block.nNonce, expected);
+        BOOST_CHECK_EQUAL(max_tries, 1000000 - expected);
+    }
+
+    // Running out of tries before reaching it
+    CBlockHeader block = header;
+    uint64_t max_tries = expected;
+    BOOST_CHECK(!GrindBlockNonce(&block, consensus, 4, max_tries));
+    BOOST_CHECK_EQUAL(max_tries, 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -26,10 +26,9 @@ CTxIn MineBlock(const NodeContext& node, const CScript& coinbase_scriptPubKey)
 {
     auto block = PrepareBlock(node, coinbase_scriptPubKey);
 
-    while (!CheckProofOfWork(block->GetHash(), block->nBits, Params().GetConsensus())) {
-        ++block->nNonce;
-        assert(block->nNonce);
-    }
+    uint64_t max_tries = std::numeric_limits<uint64_t>::max();
+    bool found{GrindBlockNonce(block.get(), Params().GetConsensus(), GetNumCores(), max_tries)};
+    assert(found);
 
     bool processed{ProcessNewBlock(Params(), block, true, nullptr)};
     assert(processed);
@@ -9,6 +9,7 @@
 #include <consensus/consensus.h>
 #include <consensus/params.h>
 #include <consensus/validation.h>
+#include <crypto/Lyra2RE/Lyra2RE.h>
 #include <crypto/sha256.h>
 #include <init.h>
 #include <miner.h>
@@ -76,6 +77,7 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     InitLogging();
     LogInstance().StartLogging();
     SHA256AutoDetect();
+    Lyra2AutoDetect();
     ECC_Start();
     SetupEnvironment();
     SetupNetworking();
@@ -195,13 +197,18 @@ CBlock TestChain100Setup::CreateAndProcessBlock(const std::vector<CMutableTransa
     for (const CMutableTransaction& tx : txns)
         block.vtx.push_back(MakeTransactionRef(tx));
     // IncrementExtraNonce creates a valid coinbase and merkleRoot
+    unsigned int extraNonce = 0;
     {
         LOCK(cs_main);
-        unsigned int extraNonce = 0;
         IncrementExtraNonce(&block, ::ChainActive().Tip(), extraNonce);
     }
 
-    while (!CheckProofOfWork(block.GetHash(), block.nBits, chainparams.GetConsensus())) ++block.nNonce;
+    uint64_t max_tries = std::numeric_limits<uint64_t>::max();
+    while (!GrindBlockNonce(&block, chainparams.GetConsensus(), GetNumCores(), max_tries)) {
+        LOCK(cs_main);
+        IncrementExtraNonce(&block, ::ChainActive().Tip(), extraNonce);
+        block.nNonce = 0;
+    }
 
     std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(block);
     ProcessNewBlock(chainparams, shared_pblock, true, nullptr);
@@ -5,6 +5,7 @@
 
 #include <txdb.h>
 
+#include <memusage.h>
 #include <pow.h>
 #include <random.h>
 #include <shutdown.h>
@@ -13,9 +14,12 @@
 #include <util/system.h>
 #include <util/translation.h>
 #include <util/vector.h>
+#include <validation.h>
 
 #include <stdint.h>
 
+#include <functional>
+
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
@@ -53,19 +57,56 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe) : db(ldb_path, nCacheSize, fMemory, fWipe, true)
+CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe, bool flush_thread) : db(ldb_path, nCacheSize, fMemory, fWipe, true)
+{
+    if (flush_thread) {
+        m_flush_thread = std::thread(&TraceThread<std::function<void()> >, "coinsflush", std::function<void()>(std::bind(&CCoinsViewDB::ThreadFlush, this)));
+    }
+}
+
+CCoinsViewDB::~CCoinsViewDB()
+{
+    if (m_flush_thread.joinable()) {
+        {
+            LOCK(m_flush_mutex);
+            m_flush_stop = true;
+        }
+        m_flush_cv.notify_all();
+        m_flush_thread.join();
+    }
+}
+
+std::shared_ptr<const CCoinsViewDB::CoinsBatch> CCoinsViewDB::GetFlushingCoins() const
 {
+    LOCK(m_flush_mutex);
+    return m_flushing;
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    if (const auto flushing = GetFlushingCoins()) {
+        auto it = flushing->find(outpoint);
+        if (it != flushing->end()) {
+            if (it->second.IsSpent()) return false;
+            coin = it->second;
+            return true;
+        }
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    if (const auto flushing = GetFlushingCoins()) {
+        auto it = flushing->find(outpoint);
+        if (it != flushing->end()) return !it->second.IsSpent();
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    {
+        LOCK(m_flush_mutex);
+        if (m_flushing) return m_flushing_block;
+    }
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
@@ -73,6 +114,11 @@ uint256 CCoinsViewDB::GetBestBlock() const {
 }
 
 std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
+    {
+        // The view is consistent with the snapshot being written.
+        LOCK(m_flush_mutex);
+        if (m_flushing) return std::vector<uint256>();
+    }
     std::vector<uint256> vhashHeadBlocks;
     if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks)) {
         return std::vector<uint256>();
@@ -80,19 +126,118 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
-    CDBBatch batch(db);
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) {
+    assert(!hashBlock.IsNull());
+    if (m_flush_thread.joinable()) {
+        // Only one snapshot is in flight: wait for the previous one to be
+        // committed before taking the next, so that the two never take
+        // memory at the same time.
+        if (!WaitForFlush()) return false;
+    }
+    // Only the changed coins are written.
+    auto coins = std::make_shared<CoinsBatch>();
     size_t count = 0;
-    size_t changed = 0;
+    size_t usage = 0;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            usage += it->second.coin.DynamicMemoryUsage();
+            coins->emplace(it->first, erase ? std::move(it->second.coin) : it->second.coin);
+        }
+        count++;
+        it = erase ? mapCoins.erase(it) : std::next(it);
+    }
+    usage += memusage::DynamicUsage(*coins);
+    LogPrint(BCLog::COINDB, "Committing %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)coins->size(), (unsigned int)count);
+
+    if (!m_flush_thread.joinable()) {
+        return WriteCoins(*coins, hashBlock);
+    }
+    LOCK(m_flush_mutex);
+    if (m_flush_failed) return false;
+    m_flushing = std::move(coins);
+    m_flushing_block = hashBlock;
+    m_flushing_usage = usage;
+    m_flush_cv.notify_all();
+    return true;
+}
+
+bool CCoinsViewDB::WaitForFlush() const
+{
+    WAIT_LOCK(m_flush_mutex, lock);
+    while (m_flushing && !m_flush_failed) {
+        m_flush_cv.wait(lock);
+    }
+    return !m_flush_failed;
+}
+
+size_t CCoinsViewDB::DynamicMemoryUsage() const
+{
+    LOCK(m_flush_mutex);
+    return m_flushing ? m_flushing_usage : 0;
+}
+
+void CCoinsViewDB::SetFlushPaused(bool paused)
+{
+    {
+        LOCK(m_flush_mutex);
+        m_flush_paused = paused;
+    }
+    m_flush_cv.notify_all();
+}
+
+void CCoinsViewDB::ThreadFlush()
+{
+    while (true) {
+        std::shared_ptr<const CoinsBatch> coins;
+        uint256 hashBlock;
+        {
+            WAIT_LOCK(m_flush_mutex, lock);
+            while ((!m_flushing || m_flush_failed || m_flush_paused) && !m_flush_stop) {
+                m_flush_cv.wait(lock);
+            }
+            // Finish the pending write before stopping.
+            if (!m_flushing || m_flush_failed) return;
+            coins = m_flushing;
+            hashBlock = m_flushing_block;
+        }
+
+        bool ok = false;
+        try {
+            ok = WriteCoins(*coins, hashBlock);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        if (!ok) {
+            // Nobody waits on this thread, so stop the node from here rather
+            // than at the next flush.
+            AbortNode("Failed to write to coin database");
+        }
+
+        LOCK(m_flush_mutex);
+        // Keep the snapshot after a failure, so that lookups stay consistent
+        // until the node shuts down.
+        if (ok) {
+            m_flushing.reset();
+            m_flushing_usage = 0;
+        } else {
+            m_flush_failed = true;
+        }
+        m_flush_cv.notify_all();
+    }
+}
+
+bool CCoinsViewDB::WriteCoins(const CoinsBatch& coins, const uint256& hashBlock) {
+    CDBBatch batch(db);
     size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
     int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
-    assert(!hashBlock.IsNull());
 
-    uint256 old_tip = GetBestBlock();
-    if (old_tip.IsNull()) {
+    // Read the database itself rather than the snapshot being written.
+    uint256 old_tip;
+    if (!db.Read(DB_BEST_BLOCK, old_tip)) {
+        old_tip.SetNull();
         // We may be in the middle of replaying.
-        std::vector<uint256> old_heads = GetHeadBlocks();
-        if (old_heads.size() == 2) {
+        std::vector<uint256> old_heads;
+        if (db.Read(DB_HEAD_BLOCKS, old_heads) && old_heads.size() == 2) {
             assert(old_heads[0] == hashBlock);
             old_tip = old_heads[1];
         }
@@ -105,18 +250,12 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, Vector(hashBlock, old_tip));
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
-        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            CoinEntry entry(&it->first);
-            if (it->second.coin.IsSpent())
-                batch.Erase(entry);
-            else
-                batch.Write(entry, it->second.coin);
-            changed++;
-        }
-        count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+    for (const auto& it : coins) {
+        CoinEntry entry(&it.first);
+        if (it.second.IsSpent())
+            batch.Erase(entry);
+        else
+            batch.Write(entry, it.second);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -137,7 +276,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
     bool ret = db.WriteBatch(batch);
-    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs to coin database\n", (unsigned int)coins.size());
     return ret;
 }
 
@@ -170,6 +309,8 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    // The cursor iterates over the database itself.
+    WaitForFlush();
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
@@ -246,8 +387,60 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+PoWLoadCheck g_pow_load_check{PoWLoadCheck::SAMPLE};
+
+bool PoWLoadCheckFromString(const std::string& name, PoWLoadCheck& mode)
+{
+    if (name == "full") {
+        mode = PoWLoadCheck::FULL;
+    } else if (name == "sample") {
+        mode = PoWLoadCheck::SAMPLE;
+    } else if (name == "none") {
+        mode = PoWLoadCheck::NONE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static const char* PoWLoadCheckToString(PoWLoadCheck mode)
+{
+    switch (mode) {
+    case PoWLoadCheck::FULL: return "full";
+    case PoWLoadCheck::SAMPLE: return "sample";
+    case PoWLoadCheck::NONE: return "none";
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
+    const PoWLoadCheck check_mode = g_pow_load_check;
+    FastRandomContext rng;
+    int64_t nStart = GetTimeMillis();
+    size_t n_loaded = 0;
+    size_t n_checked = 0;
+
+    // Headers are queued up and their proof of work is checked in parallel
+    // batches; when a batch fails, re-check it serially to report the culprit.
+    static constexpr size_t POW_CHECK_BATCH_SIZE = 4096;
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<const CBlockIndex*> vIndexes;
+    vHeaders.reserve(POW_CHECK_BATCH_SIZE);
+    vIndexes.reserve(POW_CHECK_BATCH_SIZE);
+    auto check_pow_batch = [&]() {
+        if (!VerifyPoWBatch(Span<const CBlockHeader>(vHeaders.data(), vHeaders.size()), consensusParams)) {
+            for (size_t i = 0; i < vHeaders.size(); ++i) {
+                if (!CheckProofOfWork(vHeaders[i].GetPoWHash(), vHeaders[i].nBits, consensusParams))
+                    return error("LoadBlockIndexGuts: CheckProofOfWork failed: %s", vIndexes[i]->ToString());
+            }
+        }
+        n_checked += vHeaders.size();
+        vHeaders.clear();
+        vIndexes.clear();
+        return true;
+    };
+
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
@@ -275,8 +468,21 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
 
-                if (!CheckProofOfWork(pindexNew->GetBlockHeader().GetPoWHash(), pindexNew->nBits, consensusParams))
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
+                // Headers accepted by AcceptBlockHeader() already had their
+                // Lyra2REv2 proof of work checked, so only hash the ones we
+                // have no record of (and some or all of the rest on request).
+                bool fCheckPoW = !(pindexNew->nStatus & BLOCK_POW_VERIFIED);
+                if (check_mode == PoWLoadCheck::FULL) {
+                    fCheckPoW = true;
+                } else if (check_mode == PoWLoadCheck::SAMPLE && rng.randrange(POW_ON_LOAD_SAMPLE_RATE) == 0) {
+                    fCheckPoW = true;
+                }
+                if (fCheckPoW) {
+                    vHeaders.push_back(pindexNew->GetBlockHeader());
+                    vIndexes.push_back(pindexNew);
+                    if (vHeaders.size() >= POW_CHECK_BATCH_SIZE && !check_pow_batch()) return false;
+                }
+                n_loaded++;
 
                 pcursor->Next();
             } else {
@@ -286,6 +492,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
             break;
         }
     }
+    if (!check_pow_batch()) return false;
+
+    LogPrintf("%s: checked proof of work of %u of %u block headers (-checkpowonload=%s) in %dms\n", __func__, n_checked, n_loaded, PoWLoadCheckToString(check_mode), GetTimeMillis() - nStart);
 
     return true;
 }
@@ -10,9 +10,13 @@
 #include <dbwrapper.h>
 #include <chain.h>
 #include <primitives/block.h>
+#include <sync.h>
 
+#include <condition_variable>
 #include <memory>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -24,6 +28,8 @@ class uint256;
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -dbflushthread default
+static const bool DEFAULT_DB_FLUSH_THREAD = true;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -38,8 +44,34 @@ static const int64_t nMaxTxIndexCache = 1024;
 static const int64_t max_filter_index_cache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! -checkpowonload default
+static const char* const DEFAULT_CHECKPOWONLOAD = "sample";
+//! With -checkpowonload=sample, re-check one in this many already verified headers
+static const int POW_ON_LOAD_SAMPLE_RATE = 1000;
+
+/** How much proof of work LoadBlockIndexGuts re-checks at startup (-checkpowonload). */
+enum class PoWLoadCheck {
+    FULL,   //!< re-hash every header
+    SAMPLE, //!< re-hash unverified headers and a random sample of verified ones
+    NONE,   //!< re-hash only headers without BLOCK_POW_VERIFIED
+};
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/** Parse a -checkpowonload value. Returns false if the value is unknown. */
+bool PoWLoadCheckFromString(const std::string& name, PoWLoadCheck& mode);
+
+/** The -checkpowonload mode LoadBlockIndexGuts uses, set at startup. */
+extern PoWLoadCheck g_pow_load_check;
+
+/**
+ * CCoinsView backed by the coin database (chainstate/)
+ *
+ * With a flush thread, BatchWrite() only takes a snapshot of the changed
+ * coins and hands it to the thread, which streams it to LevelDB. Until that
+ * write is committed, lookups are answered from the snapshot, so the view
+ * always reflects the last BatchWrite(). At most one snapshot is in flight,
+ * and the memory it takes is reported by DynamicMemoryUsage() so that it can
+ * be counted against the coins cache size.
+ */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
@@ -47,19 +79,48 @@ protected:
 public:
     /**
      * @param[in] ldb_path    Location in the filesystem where leveldb data will be stored.
+     * @param[in] flush_thread Write the changes passed to BatchWrite() from a background thread.
      */
-    explicit CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe);
+    explicit CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe, bool flush_thread = false);
+    ~CCoinsViewDB();
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) override;
     CCoinsViewCursor *Cursor() const override;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    //! Wait until the changes handed to the flush thread are on disk. Returns false if writing them failed.
+    bool WaitForFlush() const;
+    //! Memory taken by the snapshot the flush thread is writing, if any.
+    size_t DynamicMemoryUsage() const;
+    //! Hold back the flush thread, so that a snapshot stays in flight (for testing).
+    void SetFlushPaused(bool paused);
+
+private:
+    typedef std::unordered_map<COutPoint, Coin, SaltedOutpointHasher> CoinsBatch;
+
+    //! Write changed coins, moving the database from its best block to hashBlock.
+    bool WriteCoins(const CoinsBatch& coins, const uint256& hashBlock);
+    //! The snapshot being written by the flush thread, if any.
+    std::shared_ptr<const CoinsBatch> GetFlushingCoins() const;
+    void ThreadFlush();
+
+    mutable Mutex m_flush_mutex;
+    mutable std::condition_variable m_flush_cv;
+    std::shared_ptr<const CoinsBatch> m_flushing GUARDED_BY(m_flush_mutex);
+    uint256 m_flushing_block GUARDED_BY(m_flush_mutex);
+    size_t m_flushing_usage GUARDED_BY(m_flush_mutex){0};
+    //! A write failed; its snapshot is kept and no further writes are accepted.
+    bool m_flush_failed GUARDED_BY(m_flush_mutex){false};
+    bool m_flush_stop GUARDED_BY(m_flush_mutex){false};
+    bool m_flush_paused GUARDED_BY(m_flush_mutex){false};
+    std::thread m_flush_thread;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
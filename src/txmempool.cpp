@@ -19,6 +19,8 @@
 #include <util/time.h>
 #include <validationinterface.h>
 
+#include <unordered_map>
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp)
@@ -147,6 +149,8 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
         } // release epoch guard for UpdateForDescendants
         UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
     }
+    EntriesChanged();
+    EntriesRemovedOrUpdated();
 }
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
@@ -353,6 +357,13 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+void CTxMemPool::EntriesRemovedOrUpdated()
+{
+    // Shared by all mempools, so that none hands out a number another one had.
+    static std::atomic<uint64_t> last_removal_sequence{0};
+    m_removal_sequence = ++last_removal_sequence;
+}
+
 void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate)
 {
     // Add to memory pool without checking anything.
@@ -396,6 +407,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     UpdateEntryForAncestors(newit, setAncestors);
 
     nTransactionsUpdated++;
+    EntriesChanged();
     totalTxSize += entry.GetTxSize();
     if (minerPolicyEstimator) {minerPolicyEstimator->processTransaction(entry, validFeeEstimate);}
 
@@ -432,6 +444,8 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
+    EntriesChanged();
+    EntriesRemovedOrUpdated();
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
 }
 
@@ -585,12 +599,15 @@ void CTxMemPool::_clear()
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    vTxHashes.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    EntriesChanged();
+    EntriesRemovedOrUpdated();
 }
 
 void CTxMemPool::clear()
@@ -740,45 +757,111 @@ bool CTxMemPool::CompareDepthAndScore(const uint256& hasha, const uint256& hashb
 }
 
 namespace {
-class DepthAndScoreComparator
+/** Sort snapshot entries by ancestor count, and then as CompareTxMemPoolEntryByScore sorts entries. */
+class SnapshotDepthAndScoreComparator
 {
 public:
-    bool operator()(const CTxMemPool::indexed_transaction_set::const_iterator& a, const CTxMemPool::indexed_transaction_set::const_iterator& b)
+    bool operator()(const TxMempoolSnapshotEntry& a, const TxMempoolSnapshotEntry& b) const
     {
-        uint64_t counta = a->GetCountWithAncestors();
-        uint64_t countb = b->GetCountWithAncestors();
-        if (counta == countb) {
-            return CompareTxMemPoolEntryByScore()(*a, *b);
+        if (a.count_with_ancestors == b.count_with_ancestors) {
+            double f1 = (double)a.fee * b.vsize;
+            double f2 = (double)b.fee * a.vsize;
+            if (f1 == f2) {
+                return b.tx->GetHash() < a.tx->GetHash();
+            }
+            return f1 > f2;
         }
-        return counta < countb;
+        return a.count_with_ancestors < b.count_with_ancestors;
     }
 };
 } // namespace
 
-std::vector<CTxMemPool::indexed_transaction_set::const_iterator> CTxMemPool::GetSortedDepthAndScore() const
+TxMempoolSnapshotEntry CTxMemPool::GetSnapshotEntry(txiter it) const
 {
-    std::vector<indexed_transaction_set::const_iterator> iters;
     AssertLockHeld(cs);
+    TxMempoolSnapshotEntry entry;
+    entry.tx = it->GetSharedTx();
+    entry.m_time = it->GetTime();
+    entry.height = it->GetHeight();
+    entry.fee = it->GetFee();
+    entry.modified_fee = it->GetModifiedFee();
+    entry.vsize = it->GetTxSize();
+    entry.weight = it->GetTxWeight();
+    entry.count_with_descendants = it->GetCountWithDescendants();
+    entry.size_with_descendants = it->GetSizeWithDescendants();
+    entry.mod_fees_with_descendants = it->GetModFeesWithDescendants();
+    entry.count_with_ancestors = it->GetCountWithAncestors();
+    entry.size_with_ancestors = it->GetSizeWithAncestors();
+    entry.mod_fees_with_ancestors = it->GetModFeesWithAncestors();
+    return entry;
+}
+
+std::shared_ptr<const std::vector<TxMempoolSnapshotEntry>> CTxMemPool::GetSnapshot() const
+{
+    auto snapshot = std::make_shared<std::vector<TxMempoolSnapshotEntry>>();
+    uint64_t version;
+    {
+        LOCK(cs);
+        if (m_snapshot) return m_snapshot;
+        version = m_snapshot_version;
+        snapshot->reserve(mapTx.size());
+        for (txiter it = mapTx.begin(); it != mapTx.end(); ++it) {
+            snapshot->push_back(GetSnapshotEntry(it));
+        }
+    }
 
-    iters.reserve(mapTx.size());
+    std::sort(snapshot->begin(), snapshot->end(), SnapshotDepthAndScoreComparator());
 
-    for (indexed_transaction_set::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi) {
-        iters.push_back(mi);
+    LOCK(cs);
+    if (m_snapshot_version == version) m_snapshot = snapshot;
+    return snapshot;
+}
+
+std::vector<TxMempoolSnapshotLinks> GetSnapshotLinks(const std::vector<TxMempoolSnapshotEntry>& snapshot)
+{
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> index;
+    index.reserve(snapshot.size());
+    for (size_t i = 0; i < snapshot.size(); ++i) {
+        index.emplace(snapshot[i].tx->GetHash(), i);
     }
-    std::sort(iters.begin(), iters.end(), DepthAndScoreComparator());
-    return iters;
+    std::vector<TxMempoolSnapshotLinks> links(snapshot.size());
+    for (size_t i = 0; i < snapshot.size(); ++i) {
+        std::vector<uint256>& parents = links[i].parents;
+        for (const CTxIn& txin : snapshot[i].tx->vin) {
+            if (index.count(txin.prevout.hash)) parents.push_back(txin.prevout.hash);
+        }
+        std::sort(parents.begin(), parents.end());
+        parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+        for (const uint256& parent : parents) {
+            links[index.at(parent)].children.push_back(snapshot[i].tx->GetHash());
+        }
+    }
+    for (TxMempoolSnapshotLinks& entry : links) {
+        std::sort(entry.children.begin(), entry.children.end());
+    }
+    return links;
+}
+
+std::vector<CTxMemPool::txiter> CTxMemPool::GetEntriesAddedSince(size_t nSize) const
+{
+    AssertLockHeld(cs);
+    // Entries are appended to vTxHashes, and only leave it out of order.
+    std::vector<txiter> added;
+    for (size_t i = std::min(nSize, vTxHashes.size()); i < vTxHashes.size(); ++i) {
+        added.push_back(vTxHashes[i].second);
+    }
+    return added;
 }
 
 void CTxMemPool::queryHashes(std::vector<uint256>& vtxid) const
 {
-    LOCK(cs);
-    auto iters = GetSortedDepthAndScore();
+    const auto snapshot = GetSnapshot();
 
     vtxid.clear();
-    vtxid.reserve(mapTx.size());
+    vtxid.reserve(snapshot->size());
 
-    for (auto it : iters) {
-        vtxid.push_back(it->GetTx().GetHash());
+    for (const TxMempoolSnapshotEntry& entry : *snapshot) {
+        vtxid.push_back(entry.tx->GetHash());
     }
 }
 
@@ -788,13 +871,12 @@ static TxMempoolInfo GetInfo(CTxMemPool::indexed_transaction_set::const_iterator
 
 std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
 {
-    LOCK(cs);
-    auto iters = GetSortedDepthAndScore();
+    const auto snapshot = GetSnapshot();
 
     std::vector<TxMempoolInfo> ret;
-    ret.reserve(mapTx.size());
-    for (auto it : iters) {
-        ret.push_back(GetInfo(it));
+    ret.reserve(snapshot->size());
+    for (const TxMempoolSnapshotEntry& entry : *snapshot) {
+        ret.push_back(TxMempoolInfo{entry.tx, entry.m_time, entry.fee, entry.vsize, entry.modified_fee - entry.fee});
     }
 
     return ret;
@@ -843,6 +925,8 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
             ++nTransactionsUpdated;
+            EntriesChanged();
+            EntriesRemovedOrUpdated();
         }
     }
     LogPrintf("PrioritiseTransaction: %s feerate += %s\n", hash.ToString(), FormatMoney(nFeeDelta));
@@ -8,6 +8,7 @@
 
 #include <atomic>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <utility>
@@ -342,6 +343,42 @@ struct TxMempoolInfo
     int64_t nFeeDelta;
 };
 
+/**
+ * A copy of the statistics of a mempool entry, see CTxMemPool::GetSnapshot().
+ */
+struct TxMempoolSnapshotEntry
+{
+    CTransactionRef tx;
+    std::chrono::seconds m_time;
+    unsigned int height;
+    CAmount fee;
+    CAmount modified_fee;
+    size_t vsize;
+    size_t weight;
+    uint64_t count_with_descendants;
+    uint64_t size_with_descendants;
+    CAmount mod_fees_with_descendants;
+    uint64_t count_with_ancestors;
+    uint64_t size_with_ancestors;
+    CAmount mod_fees_with_ancestors;
+};
+
+/** The links of a snapshot entry to the other entries, see GetSnapshotLinks(). */
+struct TxMempoolSnapshotLinks
+{
+    /** The in-mempool transactions this one spends, in txid order */
+    std::vector<uint256> parents;
+    /** The in-mempool transactions spending this one, in txid order */
+    std::vector<uint256> children;
+};
+
+/**
+ * The links of every entry of a snapshot, in the same order. They follow from
+ * the transactions in it, so they are only worked out, without holding the
+ * mempool lock, by those that need them.
+ */
+std::vector<TxMempoolSnapshotLinks> GetSnapshotLinks(const std::vector<TxMempoolSnapshotEntry>& snapshot);
+
 /** Reason why a transaction was removed from the mempool,
  * this is passed to the notification signal.
  */
@@ -460,6 +497,22 @@ private:
 
     bool m_is_loaded GUARDED_BY(cs){false};
 
+    //! Incremented whenever entries are added or removed or their fees or package statistics change
+    uint64_t m_snapshot_version GUARDED_BY(cs){0};
+    //! The last snapshot taken, until the entries change
+    mutable std::shared_ptr<const std::vector<TxMempoolSnapshotEntry>> m_snapshot GUARDED_BY(cs);
+
+    void EntriesChanged() EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        ++m_snapshot_version;
+        m_snapshot.reset();
+    }
+
+    //! See GetRemovalSequence()
+    uint64_t m_removal_sequence GUARDED_BY(cs){0};
+
+    void EntriesRemovedOrUpdated() EXCLUSIVE_LOCKS_REQUIRED(cs);
+
 public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
@@ -547,8 +600,6 @@ private:
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
-    std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const EXCLUSIVE_LOCKS_REQUIRED(cs);
-
 public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx GUARDED_BY(cs);
     std::map<uint256, CAmount> mapDeltas;
@@ -588,6 +639,17 @@ public:
     bool isSpent(const COutPoint& outpoint) const;
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
+    /**
+     * A number that changes whenever an entry leaves the mempool or the fees
+     * or ancestors of one change, but not when entries are added. No two
+     * mempools ever share a number, so it tells them apart as well.
+     */
+    uint64_t GetRemovalSequence() const EXCLUSIVE_LOCKS_REQUIRED(cs) { return m_removal_sequence; }
+    /**
+     * The entries added since the mempool held nSize of them, oldest first.
+     * Only meaningful if GetRemovalSequence() did not change since.
+     */
+    std::vector<txiter> GetEntriesAddedSince(size_t nSize) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
      * the tx is not dependent on other mempool transactions to be included in a block.
@@ -696,6 +758,18 @@ public:
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
 
+    /** Copy the statistics of an entry. */
+    TxMempoolSnapshotEntry GetSnapshotEntry(txiter it) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /**
+     * Get a copy of all entries, sorted by ancestor count and then by score
+     * (as queryHashes() returns them), to be looked at without holding cs.
+     * cs is only held to copy the transaction references and statistics, and
+     * not even for that if nothing changed since the last snapshot: that one
+     * is shared until then.
+     */
+    std::shared_ptr<const std::vector<TxMempoolSnapshotEntry>> GetSnapshot() const;
+
     size_t DynamicMemoryUsage() const;
 
 private:
@@ -20,6 +20,8 @@
 #include <index/txindex.h>
 #include <logging.h>
 #include <logging/timer.h>
+#include <node/coinstats.h>
+#include <node/utxo_snapshot.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/settings.h>
@@ -31,6 +33,7 @@
 #include <script/script.h>
 #include <script/sigcache.h>
 #include <shutdown.h>
+#include <streams.h>
 #include <timedata.h>
 #include <tinyformat.h>
 #include <txdb.h>
@@ -46,7 +49,10 @@
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <atomic>
+#include <future>
 #include <string>
+#include <unordered_set>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -109,6 +115,9 @@ Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 bool g_parallel_script_checks{false};
+bool g_parallel_coins_prefetch{false};
+bool g_parallel_block_read_ahead{false};
+bool g_parallel_tx_prechecks{false};
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
@@ -181,10 +190,14 @@ std::unique_ptr<CBlockTreeDB> pblocktree;
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
 static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
 bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
+static bool CheckMempoolInputScripts(const CTransaction& tx, TxValidationState& state, const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 static FILE* OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
 
+/** Block files mapped for reading. Mapping is left to 64-bit systems, where address space is not scarce. */
+static MappedFlatFileSeq g_block_file_maps{sizeof(void*) >= 8 ? MAX_MAPPED_BLOCK_FILES : 0};
+
 bool CheckFinalTx(const CTransaction &tx, int flags)
 {
     AssertLockHeld(cs_main);
@@ -364,10 +377,9 @@ static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool,
         // ignore validation errors in resurrected transactions
         TxValidationState stateDummy;
 
-        bool ret = !AcceptToMemoryPool(mempool, stateDummy, *it, nullptr, nullptr, true, 0);
-        TxValidationState dandelionStateDummy;
-        AcceptToMemoryPool(stempool, dandelionStateDummy, *it, nullptr, nullptr, true, 0);
-        if (!fAddToMempool || (*it)->IsCoinBase() || ret) {
+        if (!fAddToMempool || (*it)->IsCoinBase() ||
+            !AcceptToMemoryPoolAndStemPool(mempool, stempool, stateDummy, *it, nullptr /* plTxnReplaced */,
+                                           true /* bypass_limits */, 0 /* nAbsurdFee */)) {
             // If the transaction doesn't make it in to the mempool, remove any
             // transactions that depend on it (which would now be orphans).
             mempool.removeRecursive(**it, MemPoolRemovalReason::REORG);
@@ -432,7 +444,7 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, TxValidationS
     }
 
     // Call CheckInputScripts() to cache signature and script validity against current tip consensus rules.
-    return CheckInputScripts(tx, state, view, flags, /* cacheSigStore = */ true, /* cacheFullSciptStore = */ true, txdata);
+    return CheckMempoolInputScripts(tx, state, view, flags, /* cacheSigStore = */ true, /* cacheFullSciptStore = */ true, txdata);
 }
 
 namespace {
@@ -464,6 +476,19 @@ public:
          */
         std::vector<COutPoint>& m_coins_to_uncache;
         const bool m_test_accept;
+        /*
+         * The scripts of this transaction already passed PolicyScriptChecks()
+         * and ConsensusScriptChecks() against the same coins when it was
+         * accepted to another pool (the mempool, when mirroring into the
+         * Dandelion stempool), so they need not be run again.
+         */
+        const bool m_scripts_verified;
+        /*
+         * The result of PrecheckTransaction() for this transaction, if it was
+         * prechecked, or nullptr. Its context-free checks are not run again,
+         * and its precomputed transaction data is used for the script checks.
+         */
+        PrecheckedTransaction* const m_prechecked;
     };
 
     // Single transaction acceptance
@@ -538,6 +563,34 @@ private:
     size_t m_limit_descendant_size;
 };
 
+/**
+ * The checks of a transaction entering the mempool that depend on nothing but
+ * the transaction itself, so that they can be done without holding any lock.
+ */
+static bool ContextFreeChecks(const CTransaction& tx, TxValidationState& state)
+{
+    if (!CheckTransaction(tx, state))
+        return false; // state filled in by CheckTransaction
+
+    // Coinbase is only valid in a block, not as a loose transaction
+    if (tx.IsCoinBase())
+        return state.Invalid(TxValidationResult::TX_CONSENSUS, "coinbase");
+
+    // Rather not work on nonstandard transactions (unless -testnet/-regtest)
+    std::string reason;
+    if (fRequireStandard && !IsStandardTx(tx, reason))
+        return state.Invalid(TxValidationResult::TX_NOT_STANDARD, reason);
+
+    // Do not work on transactions that are too small.
+    // A transaction with 1 segwit input and 1 P2WPHK output has non-witness size of 82 bytes.
+    // Transactions smaller than this are not relayed to mitigate CVE-2017-12842 by not relaying
+    // 64-byte transactions.
+    if (::GetSerializeSize(tx, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) < MIN_STANDARD_TX_NONWITNESS_SIZE)
+        return state.Invalid(TxValidationResult::TX_NOT_STANDARD, "tx-size-small");
+
+    return true;
+}
+
 bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
 {
     const CTransactionRef& ptx = ws.m_ptx;
@@ -561,24 +614,15 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     CAmount& nConflictingFees = ws.m_conflicting_fees;
     size_t& nConflictingSize = ws.m_conflicting_size;
 
-    if (!CheckTransaction(tx, state))
-        return false; // state filled in by CheckTransaction
-
-    // Coinbase is only valid in a block, not as a loose transaction
-    if (tx.IsCoinBase())
-        return state.Invalid(TxValidationResult::TX_CONSENSUS, "coinbase");
-
-    // Rather not work on nonstandard transactions (unless -testnet/-regtest)
-    std::string reason;
-    if (fRequireStandard && !IsStandardTx(tx, reason))
-        return state.Invalid(TxValidationResult::TX_NOT_STANDARD, reason);
-
-    // Do not work on transactions that are too small.
-    // A transaction with 1 segwit input and 1 P2WPHK output has non-witness size of 82 bytes.
-    // Transactions smaller than this are not relayed to mitigate CVE-2017-12842 by not relaying
-    // 64-byte transactions.
-    if (::GetSerializeSize(tx, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) < MIN_STANDARD_TX_NONWITNESS_SIZE)
-        return state.Invalid(TxValidationResult::TX_NOT_STANDARD, "tx-size-small");
+    if (args.m_prechecked) {
+        // The context-free checks were done by PrecheckTransaction().
+        if (!args.m_prechecked->state.IsValid()) {
+            state = args.m_prechecked->state;
+            return false;
+        }
+    } else if (!ContextFreeChecks(tx, state)) {
+        return false; // state filled in by ContextFreeChecks
+    }
 
     // Only accept nLockTime-using transactions that can be mined in the next
     // block; we don't want our mempool filled up with transactions that can't
@@ -918,7 +962,7 @@ bool MemPoolAccept::PolicyScriptChecks(ATMPArgs& args, Workspace& ws, Precompute
 
     // Check input scripts and signatures.
     // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-    if (!CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
+    if (!CheckMempoolInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
         // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
         // need to turn both off, and compare against just turning off CLEANSTACK
         // to see if the failure is specifically due to witness validation.
@@ -1023,15 +1067,21 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
 
     if (!PreChecks(args, workspace)) return false;
 
-    // Only compute the precomputed transaction data if we need to verify
-    // scripts (ie, other policy checks pass). We perform the inexpensive
-    // checks first and avoid hashing and signature verification unless those
-    // checks pass, to mitigate CPU exhaustion denial-of-service attacks.
-    PrecomputedTransactionData txdata(*ptx);
+    if (!args.m_scripts_verified) {
+        // Only compute the precomputed transaction data if we need to verify
+        // scripts (ie, other policy checks pass). We perform the inexpensive
+        // checks first and avoid hashing and signature verification unless those
+        // checks pass, to mitigate CPU exhaustion denial-of-service attacks.
+        // A prechecked transaction had it computed off the message handler
+        // thread, which is no worse than deserializing it there.
+        std::unique_ptr<PrecomputedTransactionData> own_txdata;
+        if (!args.m_prechecked) own_txdata = MakeUnique<PrecomputedTransactionData>(*ptx);
+        PrecomputedTransactionData& txdata = args.m_prechecked ? *args.m_prechecked->txdata : *own_txdata;
 
-    if (!PolicyScriptChecks(args, workspace, txdata)) return false;
+        if (!PolicyScriptChecks(args, workspace, txdata)) return false;
 
-    if (!ConsensusScriptChecks(args, workspace, txdata)) return false;
+        if (!ConsensusScriptChecks(args, workspace, txdata)) return false;
+    }
 
     // Tx was accepted, but not added
     if (args.m_test_accept) return true;
@@ -1045,14 +1095,28 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
 
 } // anon namespace
 
-/** (try to) add transaction to memory pool with a specified acceptance time **/
+/** (try to) add transaction to memory pool with a specified acceptance time.
+ * If stem_pool is given, a transaction accepted to pool is also added to it
+ * without running its script checks again. If prechecked is given, it is the
+ * result of PrecheckTransaction() for tx. **/
 static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
                         int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                        bool bypass_limits, const CAmount nAbsurdFee, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+                        bool bypass_limits, const CAmount nAbsurdFee, bool test_accept, CTxMemPool* stem_pool = nullptr,
+                        PrecheckedTransaction* prechecked = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
+    assert(!prechecked || prechecked->tx == tx);
     std::vector<COutPoint> coins_to_uncache;
-    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept };
+    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept, false /* scripts_verified */, prechecked };
     bool res = MemPoolAccept(pool).AcceptSingleTransaction(tx, args);
+    if (res && !test_accept && stem_pool) {
+        // The inputs were just looked up and the scripts verified for pool;
+        // only the stempool's own policy and package checks are left. Its
+        // verdict is not reported: the transaction is in the mempool either way.
+        TxValidationState stem_state;
+        std::vector<COutPoint> stem_coins_to_uncache;
+        MemPoolAccept::ATMPArgs stem_args { chainparams, stem_state, nAcceptTime, nullptr /* plTxnReplaced */, bypass_limits, nAbsurdFee, stem_coins_to_uncache, false /* test_accept */, true /* scripts_verified */, prechecked };
+        MemPoolAccept(*stem_pool).AcceptSingleTransaction(tx, stem_args);
+    }
     if (!res) {
         // Remove coins that were not present in the coins cache before calling ATMPW;
         // this is to prevent memory DoS in case we receive a large number of
@@ -1076,6 +1140,76 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee, test_accept);
 }
 
+bool AcceptToMemoryPoolAndStemPool(CTxMemPool& pool, CTxMemPool& stem_pool, TxValidationState &state, const CTransactionRef &tx,
+                        std::list<CTransactionRef>* plTxnReplaced,
+                        bool bypass_limits, const CAmount nAbsurdFee, PrecheckedTransaction* prechecked)
+{
+    const CChainParams& chainparams = Params();
+    return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee, false /* test_accept */, &stem_pool, prechecked);
+}
+
+void PrecheckTransaction(PrecheckedTransaction& prechecked)
+{
+    if (ContextFreeChecks(*prechecked.tx, prechecked.state)) {
+        prechecked.txdata = MakeUnique<PrecomputedTransactionData>(*prechecked.tx);
+    }
+}
+
+/** Closure running PrecheckTransaction() for a transaction, see PrecheckTransactionAsync(). */
+class CTxPrecheck
+{
+private:
+    std::shared_ptr<PrecheckedTransaction> m_prechecked;
+    std::shared_ptr<std::promise<void>> m_done;
+    std::function<void()> m_on_done;
+
+public:
+    CTxPrecheck() {}
+    CTxPrecheck(std::shared_ptr<PrecheckedTransaction> prechecked, std::shared_ptr<std::promise<void>> done, std::function<void()> on_done)
+        : m_prechecked(std::move(prechecked)), m_done(std::move(done)), m_on_done(std::move(on_done)) {}
+
+    bool operator()()
+    {
+        // The verdict is in m_prechecked; the check itself never fails.
+        PrecheckTransaction(*m_prechecked);
+        m_done->set_value();
+        if (m_on_done) m_on_done();
+        return true;
+    }
+
+    void swap(CTxPrecheck& check)
+    {
+        std::swap(m_prechecked, check.m_prechecked);
+        std::swap(m_done, check.m_done);
+        std::swap(m_on_done, check.m_on_done);
+    }
+};
+
+// Prechecks are added without a CCheckQueueControl: each one hands its result
+// back through its own promise, and nobody waits for the queue as a whole.
+static CCheckQueue<CTxPrecheck> txprecheckqueue(1);
+
+void ThreadTxPrecheck(int worker_num) {
+    util::ThreadRename(strprintf("txprech.%i", worker_num));
+    txprecheckqueue.Thread();
+}
+
+std::future<void> PrecheckTransactionAsync(std::shared_ptr<PrecheckedTransaction> prechecked, std::function<void()> on_done)
+{
+    auto done = std::make_shared<std::promise<void>>();
+    std::future<void> result = done->get_future();
+    if (!g_parallel_tx_prechecks) {
+        PrecheckTransaction(*prechecked);
+        done->set_value();
+        if (on_done) on_done();
+        return result;
+    }
+    std::vector<CTxPrecheck> checks;
+    checks.emplace_back(std::move(prechecked), std::move(done), std::move(on_done));
+    txprecheckqueue.Add(checks);
+    return result;
+}
+
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock.
  * If blockIndex is provided, the transaction is fetched from the corresponding block.
@@ -1141,18 +1275,49 @@ static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessa
     return true;
 }
 
+/**
+ * Find the serialization of the block at pos in its mapped block file, using the size stored in
+ * front of it. Returns nullptr when the block file cannot be mapped or the header does not make
+ * sense, in which case the block should be read from the file as usual.
+ *
+ * The block file being written is never mapped: it is truncated to its final size when the next
+ * one is started, and touching a mapped page past the end of a file raises SIGBUS. Pruned files
+ * are unlinked, which leaves mappings that readers still hold intact.
+ */
+static std::shared_ptr<const MappedFlatFile> MapBlockFromDisk(const FlatFilePos& pos, Span<const uint8_t>& block)
+{
+    if (pos.nPos < 8) return nullptr;
+    if (WITH_LOCK(cs_LastBlockFile, return pos.nFile >= nLastBlockFile)) return nullptr;
+    FlatFilePos hpos = pos;
+    hpos.nPos -= 8; // Seek back 8 bytes for meta header
+
+    std::shared_ptr<const MappedFlatFile> mapping = g_block_file_maps.Map(BlockFileSeq(), hpos, 8);
+    if (!mapping) return nullptr;
+    const unsigned int blk_size = ReadLE32(mapping->Data().data() + pos.nPos - 4);
+    if (blk_size > MAX_SIZE) return nullptr;
+    if (size_t{pos.nPos} + blk_size > size_t(mapping->Data().size())) {
+        mapping = g_block_file_maps.Map(BlockFileSeq(), hpos, 8 + blk_size);
+        if (!mapping) return nullptr;
+    }
+    block = mapping->Data().subspan(pos.nPos, blk_size);
+    return mapping;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-
-    // Read block
+    // Read block, straight from the mapped block file if possible
     try {
-        filein >> block;
+        Span<const uint8_t> block_data;
+        if (const auto mapping = MapBlockFromDisk(pos, block_data)) {
+            SpanReader(SER_DISK, CLIENT_VERSION, block_data) >> block;
+        } else {
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+            filein >> block;
+        }
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
@@ -1227,6 +1392,32 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
     return ReadRawBlockFromDisk(block, block_pos, message_start);
 }
 
+bool ReadRawBlockFromDisk(RawBlockData& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    FlatFilePos block_pos;
+    {
+        LOCK(cs_main);
+        block_pos = pindex->GetBlockPos();
+    }
+
+    block.owner = MapBlockFromDisk(block_pos, block.data);
+    if (block.owner) {
+        const uint8_t* blk_start = block.data.data() - 8;
+        if (memcmp(blk_start, message_start, CMessageHeader::MESSAGE_START_SIZE)) {
+            return error("%s: Block magic mismatch for %s: %s versus expected %s", __func__, block_pos.ToString(),
+                    HexStr(blk_start, blk_start + CMessageHeader::MESSAGE_START_SIZE),
+                    HexStr(message_start, message_start + CMessageHeader::MESSAGE_START_SIZE));
+        }
+        return true;
+    }
+
+    if (!ReadRawBlockFromDisk(block.buffer, block_pos, message_start)) {
+        return false;
+    }
+    block.data = Span<const uint8_t>(block.buffer.data(), block.buffer.size());
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1245,7 +1436,8 @@ CoinsViews::CoinsViews(
     size_t cache_size_bytes,
     bool in_memory,
     bool should_wipe) : m_dbview(
-                            GetDataDir() / ldb_name, cache_size_bytes, in_memory, should_wipe),
+                            GetDataDir() / ldb_name, cache_size_bytes, in_memory, should_wipe,
+                            gArgs.GetBoolArg("-dbflushthread", DEFAULT_DB_FLUSH_THREAD)),
                         m_catcherview(&m_dbview) {}
 
 void CoinsViews::InitCache()
@@ -1481,6 +1673,17 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+/** The entry of a transaction's script executions with the given flags in scriptExecutionCache. */
+static uint256 ScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    // We only use the first 19 bytes of nonce to avoid a second SHA
+    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
 /**
  * Check whether all of this transaction's input scripts succeed.
  *
@@ -1513,11 +1716,7 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const C
     // correct (ie that the transaction hash which is in tx's prevouts
     // properly commits to the scriptPubKey in the inputs view of that
     // transaction).
-    uint256 hashCacheEntry;
-    // We only use the first 19 bytes of nonce to avoid a second SHA
-    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
-    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
-    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    const uint256 hashCacheEntry = ScriptExecutionCacheEntry(tx, flags);
     AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
     if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
         return true;
@@ -1635,7 +1834,7 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
 }
 
 /** Abort with a message */
-static bool AbortNode(const std::string& strMessage, const std::string& userMessage = "", unsigned int prefix = 0)
+bool AbortNode(const std::string& strMessage, const std::string& userMessage, unsigned int prefix)
 {
     SetMiscWarning(strMessage);
     LogPrintf("*** %s\n", strMessage);
@@ -1784,12 +1983,179 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, BlockValidationSt
 }
 
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+//! Number of script checks ConnectBlock() collects before handing them to scriptcheckqueue
+static const size_t SCRIPT_CHECK_CHUNK_SIZE = 16;
+//! Transactions with at least this many inputs have their scripts checked on scriptcheckqueue when they enter the mempool
+static const size_t MIN_PARALLEL_MEMPOOL_SCRIPT_CHECK_INPUTS = 16;
 
 void ThreadScriptCheck(int worker_num) {
     util::ThreadRename(strprintf("scriptch.%i", worker_num));
     scriptcheckqueue.Thread();
 }
 
+/**
+ * CheckInputScripts() for a transaction entering the mempool. The scripts of
+ * a transaction with many inputs are checked on the script check threads, so
+ * that it does not hold up the message handler thread for as long. If any of
+ * them fails, they are checked again one by one, to report the failure the
+ * same way CheckInputScripts() does.
+ *
+ * All callers hold cs_main, as ConnectBlock() does, so scriptcheckqueue is
+ * never used by two of them at once.
+ */
+static bool CheckMempoolInputScripts(const CTransaction& tx, TxValidationState& state, const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata)
+{
+    AssertLockHeld(cs_main);
+
+    if (!g_parallel_script_checks || tx.vin.size() < MIN_PARALLEL_MEMPOOL_SCRIPT_CHECK_INPUTS) {
+        return CheckInputScripts(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata);
+    }
+
+    std::vector<CScriptCheck> vChecks;
+    if (!CheckInputScripts(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata, &vChecks)) {
+        return false;
+    }
+    // Nothing to check when the script executions were cached.
+    if (vChecks.empty()) return true;
+
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    if (!control.Wait()) {
+        return CheckInputScripts(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata);
+    }
+    if (cacheFullScriptStore) {
+        scriptExecutionCache.insert(ScriptExecutionCacheEntry(tx, flags));
+    }
+    return true;
+}
+
+/** Closure looking up one coin in a view, see PrefetchBlockCoins(). */
+class CCoinsPrefetchCheck
+{
+private:
+    const CCoinsView* m_view{nullptr};
+    const COutPoint* m_outpoint{nullptr};
+    Coin* m_coin{nullptr};
+
+public:
+    CCoinsPrefetchCheck() {}
+    CCoinsPrefetchCheck(const CCoinsView& view, const COutPoint& outpoint, Coin& coin) : m_view(&view), m_outpoint(&outpoint), m_coin(&coin) {}
+
+    bool operator()()
+    {
+        // A missing coin is left spent; ConnectBlock() will reject the block.
+        m_view->GetCoin(*m_outpoint, *m_coin);
+        return true;
+    }
+
+    void swap(CCoinsPrefetchCheck& check)
+    {
+        std::swap(m_view, check.m_view);
+        std::swap(m_outpoint, check.m_outpoint);
+        std::swap(m_coin, check.m_coin);
+    }
+};
+
+static CCheckQueue<CCoinsPrefetchCheck> coinsprefetchqueue(16);
+
+void ThreadCoinsPrefetch(int worker_num) {
+    util::ThreadRename(strprintf("prefetch.%i", worker_num));
+    coinsprefetchqueue.Thread();
+}
+
+void PrefetchBlockCoins(const CBlock& block, CCoinsViewCache& view, const CCoinsView& base)
+{
+    if (!g_parallel_coins_prefetch) return;
+
+    // Outputs created by the block itself are in no view yet.
+    std::unordered_set<uint256, SaltedTxidHasher> block_txids;
+    block_txids.reserve(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        block_txids.insert(tx->GetHash());
+    }
+    std::vector<COutPoint> outpoints;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase()) continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (!block_txids.count(txin.prevout.hash) && !view.HaveCoinInCache(txin.prevout)) {
+                outpoints.push_back(txin.prevout);
+            }
+        }
+    }
+    if (outpoints.empty()) return;
+
+    std::vector<Coin> coins(outpoints.size());
+    {
+        CCheckQueueControl<CCoinsPrefetchCheck> control(&coinsprefetchqueue);
+        std::vector<CCoinsPrefetchCheck> checks;
+        checks.reserve(outpoints.size());
+        for (size_t i = 0; i < outpoints.size(); ++i) {
+            checks.emplace_back(base, outpoints[i], coins[i]);
+        }
+        control.Add(checks);
+        control.Wait();
+    }
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (!coins[i].IsSpent()) view.CachePrefetchedCoin(outpoints[i], std::move(coins[i]));
+    }
+}
+
+/** A block being read ahead, see BlockReadAhead. */
+struct ReadAheadBlock {
+    //! Set by whoever gets to the block first: a worker, or BlockReadAhead when it no longer waits for one
+    std::atomic<bool> claimed{false};
+    std::promise<std::shared_ptr<const CBlock>> result;
+};
+
+/** Closure reading one block from disk and running the context-free checks on it, see BlockReadAhead. */
+class CBlockReadAheadCheck
+{
+private:
+    FlatFilePos m_pos;
+    uint256 m_hash;
+    const Consensus::Params* m_params{nullptr};
+    std::shared_ptr<ReadAheadBlock> m_block;
+
+public:
+    CBlockReadAheadCheck() {}
+    CBlockReadAheadCheck(const FlatFilePos& pos, const uint256& hash, const Consensus::Params& params, std::shared_ptr<ReadAheadBlock> block)
+        : m_pos(pos), m_hash(hash), m_params(&params), m_block(std::move(block)) {}
+
+    bool operator()()
+    {
+        if (m_block->claimed.exchange(true)) return true;
+        auto block = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*block, m_pos, *m_params) || block->GetHash() != m_hash) {
+            // ConnectTip() reads the block again and reports the error.
+            m_block->result.set_value(nullptr);
+            return true;
+        }
+        // A block that passes is marked with CBlock::fChecked, so that
+        // ConnectBlock() does not check it again. One that fails is checked
+        // again by ConnectBlock(), which reports why.
+        BlockValidationState state;
+        CheckBlock(*block, state, *m_params);
+        m_block->result.set_value(std::move(block));
+        return true;
+    }
+
+    void swap(CBlockReadAheadCheck& check)
+    {
+        std::swap(m_pos, check.m_pos);
+        std::swap(m_hash, check.m_hash);
+        std::swap(m_params, check.m_params);
+        std::swap(m_block, check.m_block);
+    }
+};
+
+// Every check is a whole block, so workers take them one at a time.
+static CCheckQueue<CBlockReadAheadCheck> blockreadaheadqueue(1);
+
+void ThreadBlockReadAhead(int worker_num) {
+    util::ThreadRename(strprintf("readahead.%i", worker_num));
+    blockreadaheadqueue.Thread();
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -2087,6 +2453,8 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     CBlockUndo blockundo;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && g_parallel_script_checks ? &scriptcheckqueue : nullptr);
+    // Script checks are handed to the queue in chunks rather than per transaction
+    std::vector<CScriptCheck> vChecks;
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
@@ -2144,7 +2512,6 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
         txdata.emplace_back(tx);
         if (!tx.IsCoinBase())
         {
-            std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
             TxValidationState tx_state;
             if (fScriptChecks && !CheckInputScripts(tx, tx_state, view, flags, fCacheResults, fCacheResults, txdata[i], g_parallel_script_checks ? &vChecks : nullptr)) {
@@ -2154,7 +2521,10 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
                 return error("ConnectBlock(): CheckInputScripts on %s failed with %s",
                     tx.GetHash().ToString(), state.ToString());
             }
-            control.Add(vChecks);
+            if (vChecks.size() >= SCRIPT_CHECK_CHUNK_SIZE) {
+                control.Add(vChecks);
+                vChecks.clear();
+            }
         }
 
         CTxUndo undoDummy;
@@ -2163,6 +2533,7 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
         }
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
     }
+    control.Add(vChecks);
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * MICRO, nTimeConnect * MILLI / nBlocksTotal);
 
@@ -2217,7 +2588,8 @@ CoinsCacheSizeState CChainState::GetCoinsCacheSizeState(
     size_t max_mempool_size_bytes)
 {
     int64_t nMempoolUsage = tx_pool.DynamicMemoryUsage();
-    int64_t cacheSize = CoinsTip().DynamicMemoryUsage();
+    // The snapshot the coins database is still writing counts as well.
+    int64_t cacheSize = CoinsTip().DynamicMemoryUsage() + CoinsDB().DynamicMemoryUsage();
     int64_t nTotalSpace =
         max_coins_cache_size_bytes + std::max<int64_t>(max_mempool_size_bytes - nMempoolUsage, 0);
 
@@ -2331,6 +2703,10 @@ bool CChainState::FlushStateToDisk(
             if (fFlushForPrune) {
                 LOG_TIME_MILLIS("unlink pruned files", BCLog::BENCH);
 
+                // The coins still being written may refer to the pruned blocks.
+                if (!CoinsDB().WaitForFlush()) {
+                    return AbortNode(state, "Failed to write to coin database");
+                }
                 UnlinkPrunedFiles(setFilesToPrune);
             }
             nLastWrite = nNow;
@@ -2349,8 +2725,26 @@ bool CChainState::FlushStateToDisk(
                 return AbortNode(state, "Disk space is too low!", _("Error: Disk space is too low!").translated, CClientUIInterface::MSG_NOPREFIX);
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!CoinsTip().Flush())
+            // The cache is kept warm for the next blocks, and only trimmed
+            // when it is running out of space.
+            if (fCacheLarge || fCacheCritical) {
+                LOG_TIME_MILLIS("evict coins from cache", BCLog::BENCH);
+                CoinsTip().Evict(coins_mem_usage / 2);
+            }
+            // Keeping the cache means the coins database gets a copy of the
+            // changed coins. If that copy might not fit next to the cache
+            // within -dbcache, hand the coins over and start afresh instead.
+            const bool fKeepCache = 2 * CoinsTip().DynamicMemoryUsage() <= nCoinCacheUsage;
+            if (!(fKeepCache ? CoinsTip().Sync() : CoinsTip().Flush()))
+                return AbortNode(state, "Failed to write to coin database");
+            // The coins database may write them in the background; a forced
+            // flush has to be on disk when it returns.
+            if (mode == FlushStateMode::ALWAYS && !CoinsDB().WaitForFlush())
                 return AbortNode(state, "Failed to write to coin database");
+            if (fKeepCache && (fCacheLarge || fCacheCritical)) {
+                LOG_TIME_MILLIS("evict coins from cache", BCLog::BENCH);
+                CoinsTip().Evict(coins_mem_usage / 2);
+            }
             nLastFlush = nNow;
             full_flush_completed = true;
         }
@@ -2511,6 +2905,7 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetchCoins = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2556,6 +2951,84 @@ public:
     }
 };
 
+/**
+ * Reads the blocks that ActivateBestChain() is about to connect from disk, and
+ * runs CheckBlock() on them (proof of work, merkle root and the transaction
+ * checks), on the ThreadBlockReadAhead() workers. This overlaps with the
+ * connection of the blocks before them, which holds cs_main, and keeps going
+ * while cs_main is released between ActivateBestChainStep() calls.
+ *
+ * A block no worker has started on is never waited for: Take() and Schedule()
+ * claim it, so that it is skipped, and ConnectTip() reads it itself. This keeps
+ * cs_main from being held while the workers are busy with later blocks, or
+ * after they were interrupted at shutdown. Does nothing without workers.
+ */
+class BlockReadAhead
+{
+private:
+    struct Pending {
+        std::shared_ptr<ReadAheadBlock> block;
+        std::future<std::shared_ptr<const CBlock>> result;
+    };
+    std::map<const CBlockIndex*, Pending> m_blocks;
+    //! Waits for the outstanding reads when destroyed
+    std::unique_ptr<CCheckQueueControl<CBlockReadAheadCheck>> m_control;
+
+public:
+    ~BlockReadAhead()
+    {
+        // Only let m_control wait for the reads that are under way.
+        for (auto& entry : m_blocks) entry.second.block->claimed = true;
+    }
+
+    /**
+     * Start reading the next blocks to connect in vpindexToConnect (which
+     * lists them highest first) that are not read yet, keeping at most
+     * MAX_BLOCKS_READ_AHEAD in flight. skip is a block the caller already has.
+     */
+    void Schedule(const std::vector<CBlockIndex*>& vpindexToConnect, const CBlockIndex* skip, const Consensus::Params& params) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        if (!g_parallel_block_read_ahead) return;
+
+        for (auto it = m_blocks.begin(); it != m_blocks.end();) {
+            if (std::find(vpindexToConnect.begin(), vpindexToConnect.end(), it->first) == vpindexToConnect.end()) {
+                it->second.block->claimed = true;
+                it = m_blocks.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        std::vector<CBlockReadAheadCheck> checks;
+        for (CBlockIndex* pindex : reverse_iterate(vpindexToConnect)) {
+            if (m_blocks.size() >= MAX_BLOCKS_READ_AHEAD) break;
+            if (pindex == skip || m_blocks.count(pindex) || !(pindex->nStatus & BLOCK_HAVE_DATA)) continue;
+            auto block = std::make_shared<ReadAheadBlock>();
+            m_blocks.emplace(pindex, Pending{block, block->result.get_future()});
+            checks.emplace_back(pindex->GetBlockPos(), pindex->GetBlockHash(), params, std::move(block));
+        }
+        if (checks.empty()) return;
+
+        if (!m_control) m_control = MakeUnique<CCheckQueueControl<CBlockReadAheadCheck>>(&blockreadaheadqueue);
+        m_control->Add(checks);
+    }
+
+    /**
+     * Get a block that was scheduled. Only waits if a worker is reading it
+     * right now; returns nullptr if no worker has started on it, as well as if
+     * it was not scheduled or could not be read.
+     */
+    std::shared_ptr<const CBlock> Take(const CBlockIndex* pindex)
+    {
+        auto it = m_blocks.find(pindex);
+        if (it == m_blocks.end()) return nullptr;
+        std::shared_ptr<const CBlock> block;
+        if (it->second.block->claimed.exchange(true)) block = it->second.result.get();
+        m_blocks.erase(it);
+        return block;
+    }
+};
+
 /**
  * Connect a new block to m_chain. pblock is either nullptr or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
@@ -2581,6 +3054,10 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    PrefetchBlockCoins(blockConnecting, CoinsTip(), m_coins_views->m_catcherview);
+    int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetchCoins += nTimePrefetched - nTime2;
+    LogPrint(BCLog::BENCH, "  - Prefetch coins: %.2fms [%.2fs]\n", (nTimePrefetched - nTime2) * MILLI, nTimePrefetchCoins * MICRO);
+    nTime2 = nTimePrefetched;
     {
         CCoinsViewCache view(&CoinsTip());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -2697,7 +3174,7 @@ void CChainState::PruneBlockIndexCandidates() {
  *
  * @returns true unless a system error occurred
  */
-bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace)
+bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace, BlockReadAhead& read_ahead)
 {
     AssertLockHeld(cs_main);
 
@@ -2738,10 +3215,13 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
             pindexIter = pindexIter->pprev;
         }
         nHeight = nTargetHeight;
+        read_ahead.Schedule(vpindexToConnect, pblock ? pindexMostWork : nullptr, chainparams.GetConsensus());
 
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
+            // Without a block, ConnectTip() reads it from disk itself.
+            std::shared_ptr<const CBlock> block_connect = pindexConnect == pindexMostWork ? pblock : read_ahead.Take(pindexConnect);
+            if (!ConnectTip(state, chainparams, pindexConnect, block_connect, connectTrace, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (state.GetResult() != BlockValidationResult::BLOCK_MUTATED) {
@@ -2831,6 +3311,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
 
     CBlockIndex *pindexMostWork = nullptr;
     CBlockIndex *pindexNewTip = nullptr;
+    BlockReadAhead read_ahead;
     int nStopAtHeight = gArgs.GetArg("-stopatheight", DEFAULT_STOPATHEIGHT);
     do {
         boost::this_thread::interruption_point();
@@ -2863,7 +3344,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
 
                 bool fInvalidFound = false;
                 std::shared_ptr<const CBlock> nullBlockPtr;
-                if (!ActivateBestChainStep(state, chainparams, pindexMostWork, pblock && pblock->GetHash() == pindexMostWork->GetBlockHash() ? pblock : nullBlockPtr, fInvalidFound, connectTrace)) {
+                if (!ActivateBestChainStep(state, chainparams, pindexMostWork, pblock && pblock->GetHash() == pindexMostWork->GetBlockHash() ? pblock : nullBlockPtr, fInvalidFound, connectTrace, read_ahead)) {
                     // A system error occurred
                     return false;
                 }
@@ -3576,7 +4057,7 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
     return true;
 }
 
-bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3596,7 +4077,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), state.ToString());
 
         // Get prev block index
@@ -3653,8 +4134,12 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
             }
         }
     }
-    if (pindex == nullptr)
+    if (pindex == nullptr) {
         pindex = AddToBlockIndex(block);
+        // The proof of work was verified above or by the caller (the genesis
+        // block is pinned by hash), so LoadBlockIndexGuts() can skip it.
+        pindex->nStatus |= BLOCK_POW_VERIFIED;
+    }
 
     if (ppindex)
         *ppindex = pindex;
@@ -3665,11 +4150,25 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, BlockValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
+    // Verify the proof of work of all headers we don't know yet in parallel and
+    // without holding cs_main. If any of them fails, fall back to checking them
+    // one by one in AcceptBlockHeader, which reports the offending header.
+    std::vector<CBlockHeader> new_headers;
+    {
+        LOCK(cs_main);
+        for (const CBlockHeader& header : headers) {
+            if (!LookupBlockIndex(header.GetHash())) {
+                new_headers.push_back(header);
+            }
+        }
+    }
+    const bool pow_verified = VerifyPoWBatch(Span<const CBlockHeader>(new_headers.data(), new_headers.size()), chainparams.GetConsensus());
+
     {
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            bool accepted = g_blockman.AcceptBlockHeader(header, state, chainparams, &pindex);
+            bool accepted = g_blockman.AcceptBlockHeader(header, state, chainparams, &pindex, !pow_verified);
             ::ChainstateActive().CheckBlockIndex(chainparams.GetConsensus());
 
             if (!accepted) {
@@ -3799,14 +4298,14 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
         if (fNewBlock) *fNewBlock = false;
         BlockValidationState state;
 
-        // CheckBlock() does not support multi-threaded block validation because CBlock::fChecked can cause data race.
-        // Therefore, the following critical section must include the CheckBlock() call as well.
-        LOCK(cs_main);
-
         // Ensure that CheckBlock() passes before calling AcceptBlock, as
-        // belt-and-suspenders.
+        // belt-and-suspenders. It only looks at the block itself, so it runs
+        // before cs_main is taken. CBlock::fChecked makes it unsafe to check
+        // the same CBlock from several threads at once, but every caller hands
+        // a block it has just received or built to ProcessNewBlock() once.
         bool ret = CheckBlock(*pblock, state, chainparams.GetConsensus());
         if (ret) {
+            LOCK(cs_main);
             // Store to disk
             ret = ::ChainstateActive().AcceptBlock(pblock, state, chainparams, &pindex, fForceProcessing, nullptr, fNewBlock);
         }
@@ -3905,6 +4404,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         FlatFilePos pos(*it, 0);
+        g_block_file_maps.Unmap(BlockFileSeq(), pos);
         fs::remove(BlockFileSeq().FileName(pos));
         fs::remove(UndoFileSeq().FileName(pos));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -4095,11 +4595,25 @@ bool BlockManager::LoadBlockIndex(
             } else {
                 pindex->nChainTx = pindex->nTx;
             }
+            // The count of a snapshot base includes the blocks below it, which
+            // were never downloaded.
+            if (pindex->nStatus & BLOCK_ASSUMED_VALID) {
+                const auto au_data = Params().Assumeutxo().find(pindex->nHeight);
+                if (au_data != Params().Assumeutxo().end() && pindex->HaveTxsDownloaded()) {
+                    pindex->nChainTx = au_data->second.nChainTx;
+                }
+            }
         }
         if (!(pindex->nStatus & BLOCK_FAILED_MASK) && pindex->pprev && (pindex->pprev->nStatus & BLOCK_FAILED_MASK)) {
             pindex->nStatus |= BLOCK_FAILED_CHILD;
             setDirtyBlockIndex.insert(pindex);
         }
+        // LoadBlockIndexGuts() checked the proof of work of every header that
+        // was not yet marked, so record that and skip it on the next startup.
+        if (!(pindex->nStatus & BLOCK_POW_VERIFIED)) {
+            pindex->nStatus |= BLOCK_POW_VERIFIED;
+            setDirtyBlockIndex.insert(pindex);
+        }
         if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->HaveTxsDownloaded() || pindex->pprev == nullptr)) {
             block_index_candidates.insert(pindex);
         }
@@ -4207,6 +4721,190 @@ bool CChainState::LoadChainTip(const CChainParams& chainparams)
     return true;
 }
 
+/** Spend every coin in the coins database through cache, which is flushed as it fills up. */
+static bool WipeCoins(CCoinsViewCache& cache, CCoinsViewDB& db)
+{
+    if (!cache.Flush() || !db.WaitForFlush()) return false;
+    std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+    COutPoint outpoint;
+    for (; cursor->Valid(); cursor->Next()) {
+        if (!cursor->GetKey(outpoint)) return false;
+        cache.SpendCoin(outpoint);
+        if (cache.DynamicMemoryUsage() > nCoinCacheUsage && !cache.Flush()) return false;
+    }
+    return cache.Flush() && db.WaitForFlush();
+}
+
+/** Read the coins of a snapshot into cache, which is flushed as it fills up. */
+static bool LoadSnapshotCoins(CAutoFile& coins_file, const SnapshotMetadata& metadata, int base_height, CCoinsViewCache& cache, std::string& error)
+{
+    COutPoint outpoint;
+    Coin coin;
+    try {
+        for (uint64_t i = 0; i < metadata.m_coins_count; ++i) {
+            coins_file >> outpoint;
+            coins_file >> coin;
+            if (coin.nHeight > (uint32_t)base_height) {
+                error = strprintf("Bad snapshot: coin %s is newer than the base block", outpoint.ToString());
+                return false;
+            }
+            // A duplicate replaces the earlier coin and is caught by the hash check.
+            cache.AddCoin(outpoint, std::move(coin), true);
+            if (i % 1000000 == 0) {
+                LogPrintf("Loaded %u of %u snapshot coins\n", i, metadata.m_coins_count);
+                if (ShutdownRequested()) {
+                    error = "Shutting down";
+                    return false;
+                }
+            }
+            if (cache.DynamicMemoryUsage() > nCoinCacheUsage && !cache.Flush()) {
+                error = "Failed to write to coin database";
+                return false;
+            }
+        }
+    } catch (const std::ios_base::failure& e) {
+        error = strprintf("Bad snapshot: %s", e.what());
+        return false;
+    }
+    try {
+        coins_file >> outpoint;
+    } catch (const std::ios_base::failure&) {
+        return true;
+    }
+    error = "Bad snapshot: it has more coins than its metadata states";
+    return false;
+}
+
+bool CChainState::ActivateSnapshot(CAutoFile& coins_file, const SnapshotMetadata& metadata, const CChainParams& chainparams, std::string& error)
+{
+    LOCK(cs_main);
+    if (chainparams.NetworkIDString() != CBaseChainParams::REGTEST) {
+        error = "Snapshots can only be loaded on regtest";
+        return false;
+    }
+    // Loading over a chain would throw away blocks this node validated, and
+    // the indexes built from them.
+    if (m_chain.Height() != 0) {
+        error = "Blocks have been connected already, a snapshot can only be loaded into an empty chain";
+        return false;
+    }
+    CBlockIndex* base = LookupBlockIndex(metadata.m_base_blockhash);
+    if (!base) {
+        error = strprintf("The header of the snapshot base block %s has not been received yet", metadata.m_base_blockhash.ToString());
+        return false;
+    }
+    if (base->nStatus & BLOCK_FAILED_MASK) {
+        error = "The snapshot base block is invalid";
+        return false;
+    }
+    const auto au_data = chainparams.Assumeutxo().find(base->nHeight);
+    if (au_data == chainparams.Assumeutxo().end()) {
+        error = strprintf("No UTXO set hash is pinned for height %d", base->nHeight);
+        return false;
+    }
+    if (metadata.m_nchaintx != au_data->second.nChainTx) {
+        error = strprintf("Bad snapshot: nChainTx is %u, expected %u", metadata.m_nchaintx, au_data->second.nChainTx);
+        return false;
+    }
+    if (base->nHeight == 0) {
+        error = "The snapshot base is the genesis block";
+        return false;
+    }
+
+    // The coins database matches no block until the snapshot is verified,
+    // which AppInitMain() checks for on the next startup.
+    pblocktree->WriteFlag("loadingsnapshot", true);
+    CCoinsViewCache& coins_cache = CoinsTip();
+    if (!WipeCoins(coins_cache, CoinsDB())) {
+        error = "Failed to clear the coin database";
+        return false;
+    }
+
+    LogPrintf("Loading UTXO snapshot of %u coins at %s\n", metadata.m_coins_count, base->GetBlockHash().ToString());
+    coins_cache.SetBestBlock(base->GetBlockHash());
+    bool valid = LoadSnapshotCoins(coins_file, metadata, base->nHeight, coins_cache, error);
+    if (valid) {
+        CCoinsStats stats;
+        if (!coins_cache.Flush() || !CoinsDB().WaitForFlush() || !GetUTXOStats(&CoinsDB(), stats)) {
+            error = "Failed to write to coin database";
+            valid = false;
+        } else if (stats.hashSerialized != au_data->second.hash_serialized || stats.coins_count != metadata.m_coins_count) {
+            error = strprintf("Bad snapshot: UTXO set hash is %s, expected %s", stats.hashSerialized.ToString(), au_data->second.hash_serialized.ToString());
+            valid = false;
+        }
+    }
+    if (!valid) {
+        coins_cache.SetBestBlock(m_chain.Tip()->GetBlockHash());
+        if (WipeCoins(coins_cache, CoinsDB())) {
+            pblocktree->WriteFlag("loadingsnapshot", false);
+        }
+        return false;
+    }
+
+    // The snapshot stands in for the validation of the blocks below its base.
+    // Blocks that were never downloaded are counted as one transaction.
+    std::vector<CBlockIndex*> assumed;
+    for (CBlockIndex* pindex = base; pindex->pprev; pindex = pindex->pprev) {
+        assumed.push_back(pindex);
+    }
+    for (auto it = assumed.rbegin(); it != assumed.rend(); ++it) {
+        CBlockIndex* pindex = *it;
+        if (!pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+            if (pindex->nTx == 0) pindex->nTx = 1;
+            pindex->nStatus |= BLOCK_ASSUMED_VALID;
+            if (IsWitnessEnabled(pindex->pprev, chainparams.GetConsensus())) {
+                pindex->nStatus |= BLOCK_OPT_WITNESS;
+            }
+            pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+            setDirtyBlockIndex.insert(pindex);
+        }
+        pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+    }
+    base->nChainTx = au_data->second.nChainTx;
+    m_chain.SetTip(base);
+    setBlockIndexCandidates.insert(base);
+
+    // Blocks that were waiting for any of those can now be connected.
+    std::deque<CBlockIndex*> queue(assumed.begin(), assumed.end());
+    while (!queue.empty()) {
+        CBlockIndex* pindex = queue.front();
+        queue.pop_front();
+        auto range = m_blockman.m_blocks_unlinked.equal_range(pindex);
+        while (range.first != range.second) {
+            CBlockIndex* child = range.first->second;
+            range.first = m_blockman.m_blocks_unlinked.erase(range.first);
+            if (base->GetAncestor(child->nHeight) == child) continue;
+            child->nChainTx = pindex->nChainTx + child->nTx;
+            {
+                LOCK(cs_nBlockSequenceId);
+                child->nSequenceId = nBlockSequenceId++;
+            }
+            setBlockIndexCandidates.insert(child);
+            queue.push_back(child);
+        }
+    }
+    PruneBlockIndexCandidates();
+
+    BlockValidationState state;
+    if (!FlushStateToDisk(chainparams, state, FlushStateMode::ALWAYS)) {
+        error = strprintf("Failed to flush state: %s", state.ToString());
+        return false;
+    }
+    pblocktree->WriteFlag("loadingsnapshot", false);
+    LogPrintf("Loaded UTXO snapshot: new best=%s height=%d\n", base->GetBlockHash().ToString(), base->nHeight);
+    uiInterface.NotifyBlockTip(IsInitialBlockDownload(), base);
+    CheckBlockIndex(chainparams.GetConsensus());
+    return true;
+}
+
+bool CChainState::HasAssumedValidBlocks() const
+{
+    // A snapshot is only loaded into an empty chain, so all blocks up to its
+    // base are assumed valid.
+    const CBlockIndex* first = m_chain[1];
+    return first && (first->nStatus & BLOCK_ASSUMED_VALID);
+}
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks...").translated, 0, false);
@@ -4251,6 +4949,11 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
+        if (pindex->nStatus & BLOCK_ASSUMED_VALID) {
+            // Blocks below a UTXO snapshot were never connected.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (snapshot base)\n", pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
@@ -4802,7 +5505,7 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
     while (pindex != nullptr) {
         nNodes++;
         if (pindexFirstInvalid == nullptr && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
-        if (pindexFirstMissing == nullptr && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstMissing == nullptr && !(pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_ASSUMED_VALID))) pindexFirstMissing = pindex;
         if (pindexFirstNeverProcessed == nullptr && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != nullptr && pindexFirstNotTreeValid == nullptr && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != nullptr && pindexFirstNotTransactionsValid == nullptr && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TRANSACTIONS) pindexFirstNotTransactionsValid = pindex;
@@ -4818,7 +5521,7 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
         if (!pindex->HaveTxsDownloaded()) assert(pindex->nSequenceId <= 0); // nSequenceId can't be set positive for blocks that aren't linked (negative is used for preciousblock)
         // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
         // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
-        if (!fHavePruned) {
+        if (!fHavePruned && !(pindex->nStatus & BLOCK_ASSUMED_VALID)) {
             // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
             assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
             assert(pindexFirstMissing == pindexFirstNeverProcessed);
@@ -5015,15 +5718,10 @@ bool LoadMempool(CTxMemPool& pool)
             TxValidationState state;
             if (nTime + nExpiryTimeout > nNow) {
                 LOCK(cs_main);
-                int64_t nTimeCopy = nTime; // time isn't const, need copy for Dandelion
-                AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                                           false /* test_accept */);
                 // Changes to mempool should also be made to Dandelion stempool
-                TxValidationState dummyState;
-                AcceptToMemoryPoolWithTime(chainparams, stempool, dummyState, tx, nullptr /* pfMissingInputs */, nTimeCopy,
+                AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nTime,
                                            nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                                           false /* test_accept */);
+                                           false /* test_accept */, &stempool);
                 if (state.IsValid()) {
                     ++count;
                 } else {
@@ -5112,6 +5810,100 @@ bool DumpMempool(const CTxMemPool& pool)
     return true;
 }
 
+static const uint64_t SIGCACHE_DUMP_VERSION = 2;
+
+//! When the nonce of the loaded signature cache was first generated
+static int64_t nSigCacheNonceTime = 0;
+//! Whether LoadSignatureCache() has run, so that the cache can be dumped
+static std::atomic<bool> fSigCacheLoaded{false};
+
+// Only the signature cache is saved. Its entries stand for signatures that
+// verified, which no rule change undoes. The script execution cache stands
+// for whole scripts under the interpreter of the running client, so it starts
+// out empty. The file is tied to the client version as well, and it lives in
+// the data directory, which is trusted like the block and coin databases.
+bool LoadSignatureCache()
+{
+    nSigCacheNonceTime = GetTime();
+    fSigCacheLoaded = true;
+
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t nNonceTime;
+    uint256 nonce;
+    std::vector<uint256> entries;
+    try {
+        uint64_t version;
+        int client_version;
+        file >> version;
+        if (version != SIGCACHE_DUMP_VERSION) {
+            return false;
+        }
+        file >> client_version;
+        if (client_version != CLIENT_VERSION) {
+            LogPrintf("Signature cache file on disk was written by another client version, starting with an empty cache\n");
+            return false;
+        }
+        file >> nNonceTime >> nonce >> entries;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    // The nonce keeps others from choosing entries that collide in the cache.
+    // Start over with a fresh one now and then, rather than keeping it forever.
+    if (nNonceTime > nSigCacheNonceTime || nNonceTime + MAX_SIGCACHE_NONCE_AGE < nSigCacheNonceTime) {
+        LogPrintf("Signature cache file on disk is too old, starting with an empty cache\n");
+        return false;
+    }
+
+    nSigCacheNonceTime = nNonceTime;
+    LoadSignatureCacheEntries(nonce, entries);
+    LogPrintf("Imported signature cache from disk: %u signatures\n", entries.size());
+    return true;
+}
+
+bool DumpSignatureCache()
+{
+    if (!fSigCacheLoaded) return false;
+
+    int64_t start = GetTimeMicros();
+
+    uint256 nonce;
+    std::vector<uint256> entries;
+    GetSignatureCacheEntries(nonce, entries);
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = SIGCACHE_DUMP_VERSION;
+        file << version << CLIENT_VERSION;
+        file << nSigCacheNonceTime << nonce << entries;
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped signature cache: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature cache: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 //! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
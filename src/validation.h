@@ -12,10 +12,12 @@
 
 #include <amount.h>
 #include <coins.h>
+#include <consensus/validation.h>
 #include <crypto/common.h> // for ReadLE64
 #include <fs.h>
 #include <policy/feerate.h>
 #include <protocol.h> // For CMessageHeader::MessageStartChars
+#include <script/interpreter.h> // For PrecomputedTransactionData
 #include <script/script_error.h>
 #include <sync.h>
 #include <txmempool.h> // For CTxMemPool::cs
@@ -24,6 +26,8 @@
 #include <serialize.h>
 
 #include <atomic>
+#include <functional>
+#include <future>
 #include <map>
 #include <memory>
 #include <set>
@@ -31,6 +35,7 @@
 #include <utility>
 #include <vector>
 
+class CAutoFile;
 class CChainState;
 class BlockValidationState;
 class CBlockIndex;
@@ -42,12 +47,12 @@ class CConnman;
 class CScriptCheck;
 class CBlockPolicyEstimator;
 class CTxMemPool;
-class TxValidationState;
+class SnapshotMetadata;
 struct ChainTxData;
 
 struct DisconnectedBlockTransactions;
-struct PrecomputedTransactionData;
 struct LockPoints;
+struct PrecheckedTransaction;
 
 /** Default for -minrelaytxfee, minimum relay fee for transactions */
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 1000;
@@ -75,11 +80,21 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** The number of blk?????.dat files kept mapped in memory for reading blocks (64-bit systems only) */
+static const unsigned int MAX_MAPPED_BLOCK_FILES = 32;
+/** Maximum number of blocks read from disk and checked ahead of being connected */
+static const unsigned int MAX_BLOCKS_READ_AHEAD = 16;
 
 /** Maximum number of dedicated script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 15;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -parprefetch default (number of threads prefetching the coins a block spends) */
+static const int DEFAULT_COINS_PREFETCH_THREADS = 4;
+/** -parreadahead default (number of threads reading blocks ahead of connecting them) */
+static const int DEFAULT_BLOCK_READ_AHEAD_THREADS = 2;
+/** -partxprecheck default (number of threads prechecking transactions from peers) */
+static const int DEFAULT_TX_PRECHECK_THREADS = 2;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -112,10 +127,15 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_COINSTATSINDEX = false;
 static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistsigcache, whether to save the signature cache on shutdown and load it on restart */
+static const bool DEFAULT_PERSIST_SIGCACHE = true;
+/** A saved signature cache whose nonce is older than this (in seconds) is not loaded */
+static const int64_t MAX_SIGCACHE_NONCE_AGE = 14 * 24 * 60 * 60;
 /** Default for using fee filter */
 static const bool DEFAULT_FEEFILTER = true;
 
@@ -150,6 +170,12 @@ extern std::atomic_bool fReindex;
  * False indicates all script checking is done on the main threadMessageHandler thread.
  */
 extern bool g_parallel_script_checks;
+/** Whether there are dedicated threads to look up the coins spent by a block, see PrefetchBlockCoins(). */
+extern bool g_parallel_coins_prefetch;
+/** Whether there are dedicated threads to read and check the blocks about to be connected, see ThreadBlockReadAhead(). */
+extern bool g_parallel_block_read_ahead;
+/** Whether there are dedicated threads to precheck transactions received from peers, see PrecheckTransactionAsync(). */
+extern bool g_parallel_tx_prechecks;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -243,6 +269,19 @@ bool LoadBlockIndex(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
+/** Run an instance of the coin prefetching thread */
+void ThreadCoinsPrefetch(int worker_num);
+/**
+ * Load the coins spent by a block that are missing from view, looking them up
+ * in base (the parent of view) in parallel on the ThreadCoinsPrefetch()
+ * workers rather than one at a time as ConnectBlock() reaches them. Does
+ * nothing without workers.
+ */
+void PrefetchBlockCoins(const CBlock& block, CCoinsViewCache& view, const CCoinsView& base);
+/** Run an instance of the thread reading and checking blocks ahead of ActivateBestChain() */
+void ThreadBlockReadAhead(int worker_num);
+/** Run an instance of the thread prechecking transactions received from peers */
+void ThreadTxPrecheck(int worker_num);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, const Consensus::Params& params, uint256& hashBlock, const CBlockIndex* const blockIndex = nullptr);
 /**
@@ -273,12 +312,48 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 /** Prune block files up to a given height */
 void PruneBlockFilesManual(int nManualPruneHeight);
 
+/** Log a fatal error, show it to the user and start shutting down. Always returns false. */
+bool AbortNode(const std::string& strMessage, const std::string& userMessage = "", unsigned int prefix = 0);
+
 /** (try to) add transaction to memory pool
  * plTxnReplaced will be appended to with all transactions replaced from mempool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
                         std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept=false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/** (try to) add transaction to memory pool and, if it is accepted, to the
+ * Dandelion stem_pool as well. The transaction is validated once: the stempool
+ * entry reuses the mempool pass's input lookups and script checks. The result
+ * and state are those of the mempool.
+ * plTxnReplaced will be appended to with all transactions replaced from mempool **/
+bool AcceptToMemoryPoolAndStemPool(CTxMemPool& pool, CTxMemPool& stem_pool, TxValidationState &state, const CTransactionRef &tx,
+                        std::list<CTransactionRef>* plTxnReplaced,
+                        bool bypass_limits, const CAmount nAbsurdFee, PrecheckedTransaction* prechecked = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/**
+ * A transaction with the outcome of the checks of AcceptToMemoryPool() that
+ * depend on nothing but the transaction itself, and, if they passed, the data
+ * its signature hashes share. Passed to AcceptToMemoryPoolAndStemPool(), they
+ * are not done again under cs_main.
+ */
+struct PrecheckedTransaction {
+    explicit PrecheckedTransaction(CTransactionRef tx_in) : tx(std::move(tx_in)) {}
+
+    const CTransactionRef tx;
+    TxValidationState state;
+    std::unique_ptr<PrecomputedTransactionData> txdata;
+};
+
+/** Run the context-free checks of a transaction. Needs no locks. */
+void PrecheckTransaction(PrecheckedTransaction& prechecked);
+
+/**
+ * Run PrecheckTransaction() on the ThreadTxPrecheck() workers, or right away
+ * if there are none. The future is ready once prechecked is filled in, and
+ * on_done, if given, is called right after that on the worker thread.
+ */
+std::future<void> PrecheckTransactionAsync(std::shared_ptr<PrecheckedTransaction> prechecked, std::function<void()> on_done = {});
+
 /** Get the BIP9 state for a given deployment at the current tip. */
 ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::DeploymentPos pos);
 
@@ -366,6 +441,18 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 
+/** The serialization of a block as stored in its block file. */
+struct RawBlockData
+{
+    //! Keeps data valid when it points into a mapped block file or a cached copy
+    std::shared_ptr<const void> owner;
+    //! Holds the serialization when the block file could not be mapped
+    std::vector<uint8_t> buffer;
+    Span<const uint8_t> data;
+};
+/** Read the serialization of a block without copying it out of the block file when possible. */
+bool ReadRawBlockFromDisk(RawBlockData& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
 /** Functions for validating blocks and updating the block tree */
@@ -412,6 +499,7 @@ enum DisconnectResult
     DISCONNECT_FAILED   // Something else went wrong.
 };
 
+class BlockReadAhead;
 class ConnectTrace;
 
 /** @see CChainState::FlushStateToDisk */
@@ -488,12 +576,14 @@ public:
     /**
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to m_block_index.
+     * Pass fCheckPOW=false only if the header's proof of work was already verified.
      */
     bool AcceptBlockHeader(
         const CBlockHeader& block,
         BlockValidationState& state,
         const CChainParams& chainparams,
-        CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+        CBlockIndex** ppindex,
+        bool fCheckPOW = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
 /**
@@ -731,6 +821,26 @@ public:
     /** Update the chain tip based on database information, i.e. CoinsTip()'s best block. */
     bool LoadChainTip(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Replace the UTXO set with the snapshot in coins_file, as written by
+     * dumptxoutset, and make its base block the tip. No block may have been
+     * connected yet, and the snapshot must match the UTXO set hash that
+     * chainparams pins for the height of the base block. The blocks below the
+     * base are marked BLOCK_ASSUMED_VALID and are never downloaded.
+     *
+     * Nothing validates those blocks in the background, so the node can never
+     * serve them: it must not advertise NODE_NETWORK or build indexes that
+     * need every block, see HasAssumedValidBlocks(). Nor is the snapshot ever
+     * compared with a UTXO set the node built itself, which is why this is
+     * only for tests, and refuses to run outside regtest.
+     *
+     * @returns true if the snapshot was loaded, otherwise false with error set
+     */
+    bool ActivateSnapshot(CAutoFile& coins_file, const SnapshotMetadata& metadata, const CChainParams& chainparams, std::string& error) LOCKS_EXCLUDED(cs_main);
+
+    //! Whether the active chain starts with blocks assumed valid by ActivateSnapshot().
+    bool HasAssumedValidBlocks() const EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     //! Dictates whether we need to flush the cache to disk or not.
     //!
     //! @return the state of the size of the coins cache.
@@ -743,7 +853,7 @@ public:
         size_t max_mempool_size_bytes) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
 private:
-    bool ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
+    bool ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace, BlockReadAhead& read_ahead) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
     bool ConnectTip(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
 
     void InvalidBlockFound(CBlockIndex *pindex, const BlockValidationState &state) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -809,6 +919,16 @@ bool DumpMempool(const CTxMemPool& pool);
 /** Load the mempool from disk. */
 bool LoadMempool(CTxMemPool& pool);
 
+/** Dump the signature cache to disk. */
+bool DumpSignatureCache();
+
+/**
+ * Load the signature cache from disk, with the nonce it was saved with. Must be
+ * called after the cache is set up and before any signature is checked. A
+ * cache saved by another client version is not loaded.
+ */
+bool LoadSignatureCache();
+
 //! Check whether the block associated with this index entry is pruned or not.
 inline bool IsBlockPruned(const CBlockIndex* pblockindex)
 {
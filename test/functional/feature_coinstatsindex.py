@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The NIX Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the UTXO set statistics kept by -coinstatsindex.
+
+The stats gettxoutsetinfo looks up in the index must match the ones computed
+by scanning the UTXO set, also after a reorg.
+"""
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_raises_rpc_error, wait_until
+
+STATS_KEYS = ['height', 'bestblock', 'txouts', 'bogosize', 'muhash', 'total_amount']
+
+
+class CoinStatsIndexTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [[], ['-coinstatsindex']]
+
+    def skip_test_if_missing_module(self):
+        self.skip_if_no_wallet()
+
+    def assert_stats_match(self):
+        scanned = self.nodes[0].gettxoutsetinfo('muhash')
+        # Until the index has caught up, the stats are computed by a scan,
+        # which also reports the transaction count and the disk size.
+        wait_until(lambda: 'transactions' not in self.nodes[1].gettxoutsetinfo('muhash'))
+        indexed = self.nodes[1].gettxoutsetinfo('muhash')
+        for key in STATS_KEYS:
+            assert_equal(indexed[key], scanned[key])
+        assert 'disk_size' not in indexed
+        return indexed
+
+    def run_test(self):
+        node0, node1 = self.nodes
+        node0.generate(101)
+        self.sync_blocks()
+
+        self.log.info("Compare the indexed stats with a scan of the UTXO set")
+        self.assert_stats_match()
+
+        self.log.info("Spend some coins and compare again")
+        for _ in range(3):
+            node0.sendtoaddress(node1.getnewaddress(), 1)
+        node0.generate(1)
+        self.sync_blocks()
+        stats = self.assert_stats_match()
+
+        self.log.info("The legacy hash is still computed by a scan")
+        res = node1.gettxoutsetinfo()
+        assert_equal(res['hash_serialized_2'], node0.gettxoutsetinfo()['hash_serialized_2'])
+        assert 'muhash' not in res
+        res = node1.gettxoutsetinfo('none')
+        assert 'muhash' not in res and 'hash_serialized_2' not in res
+        assert_raises_rpc_error(-8, 'foo is not a valid hash_type', node1.gettxoutsetinfo, 'foo')
+
+        self.log.info("Rewind the index on a reorg")
+        tip = node0.getbestblockhash()
+        for node in self.nodes:
+            node.invalidateblock(tip)
+        self.assert_stats_match()
+        for node in self.nodes:
+            node.reconsiderblock(tip)
+        assert_equal(self.assert_stats_match(), stats)
+
+        self.log.info("Resume the index after a restart")
+        self.restart_node(1, extra_args=['-coinstatsindex'])
+        node0.generate(2)
+        self.sync_blocks()
+        self.assert_stats_match()
+
+
+if __name__ == '__main__':
+    CoinStatsIndexTest().main()
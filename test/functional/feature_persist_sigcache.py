@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The NIX Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test that the signature cache is saved on shutdown and loaded on restart,
+unless -persistsigcache=0 or it was saved by another client version."""
+import os
+import struct
+
+from test_framework.test_framework import BitcoinTestFramework
+
+
+class PersistSigCacheTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(101)
+        cache_file = os.path.join(node.datadir, self.chain, 'sigcache.dat')
+
+        self.log.info("The cache is dumped on shutdown")
+        self.stop_node(0)
+        assert os.path.isfile(cache_file)
+
+        self.log.info("and loaded on restart")
+        with node.assert_debug_log(["Imported signature cache from disk"]):
+            self.start_node(0)
+
+        self.log.info("but not if another client version saved it")
+        self.stop_node(0)
+        with open(cache_file, 'r+b') as f:
+            # The dump version is followed by the client version
+            f.seek(8)
+            client_version = struct.unpack('<i', f.read(4))[0]
+            f.seek(8)
+            f.write(struct.pack('<i', client_version + 1))
+        with node.assert_debug_log(["written by another client version"], unexpected_msgs=["Imported signature cache from disk"]):
+            self.start_node(0)
+
+        self.log.info("-persistsigcache=0 does not load it")
+        with node.assert_debug_log([], unexpected_msgs=["Imported signature cache from disk"]):
+            self.restart_node(0, extra_args=["-persistsigcache=0"])
+
+        self.log.info("nor does it overwrite the saved one")
+        os.remove(cache_file)
+        self.stop_node(0)
+        assert not os.path.exists(cache_file)
+
+
+if __name__ == '__main__':
+    PersistSigCacheTest().main()
@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The NIX Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the cache of recently read blocks and getblockcacheinfo."""
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+
+class BlockCacheTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(300)
+
+        self.log.info("Recent blocks are cached after the first read")
+        info = node.getblockcacheinfo()
+        recent = node.getbestblockhash()
+        node.getblock(recent)
+        after_first = node.getblockcacheinfo()
+        assert_equal(after_first['misses'], info['misses'] + 1)
+        assert_equal(after_first['blocks'], info['blocks'] + 1)
+        assert after_first['usage'] > info['usage']
+        assert_equal(node.getblock(recent), node.getblock(recent))
+        after_second = node.getblockcacheinfo()
+        assert_equal(after_second['hits'], after_first['hits'] + 2)
+        assert_equal(after_second['misses'], after_first['misses'])
+
+        self.log.info("Old blocks are read from disk without being cached")
+        old = node.getblockhash(1)
+        node.getblock(old)
+        node.getblock(old)
+        after_old = node.getblockcacheinfo()
+        assert_equal(after_old['misses'], after_second['misses'] + 2)
+        assert_equal(after_old['blocks'], after_second['blocks'])
+
+        self.log.info("The cache can be disabled")
+        self.restart_node(0, extra_args=['-blockcachesize=0'])
+        node.getblock(recent)
+        node.getblock(recent)
+        info = node.getblockcacheinfo()
+        assert_equal(info['maxusage'], 0)
+        assert_equal(info['blocks'], 0)
+        assert_equal(info['hits'], 0)
+
+
+if __name__ == '__main__':
+    BlockCacheTest().main()
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The NIX Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the getdandelioninfo RPC.
+
+Tests correspond to code in rpc/net.cpp.
+"""
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than_or_equal,
+    connect_nodes,
+    disconnect_nodes,
+    wait_until,
+)
+
+LATENCY_BOUNDS = [1, 2, 5, 10, 20, 40, 80]
+
+
+class DandelionInfoTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+
+    def setup_network(self):
+        self.setup_nodes()
+        connect_nodes(self.nodes[0], 1)
+
+    def check_latency_histogram(self, histogram):
+        assert_equal(len(histogram), len(LATENCY_BOUNDS) + 1)
+        assert_equal([bucket['below'] for bucket in histogram[:-1]], LATENCY_BOUNDS)
+        assert 'below' not in histogram[-1]
+        for bucket in histogram:
+            assert_equal(bucket['count'], 0)
+
+    def run_test(self):
+        node0, node1 = self.nodes
+
+        self.log.info("Check the counters of nodes that relayed nothing yet")
+        for node in self.nodes:
+            info = node.getdandelioninfo()
+            assert_equal(info['stem'], {'received': 0, 'local': 0, 'relayed': 0, 'fluffed': 0})
+            embargo = info['embargo']
+            for key in ['embargoed', 'inserted', 'expired', 'removed']:
+                assert_equal(embargo[key], 0)
+            self.check_latency_histogram(embargo['expired_latency'])
+            self.check_latency_histogram(embargo['removed_latency'])
+            assert_equal(info['stempool']['size'], 0)
+            assert_greater_than_or_equal(info['stempool']['usage'], 0)
+            assert_greater_than_or_equal(info['routing']['shuffles'], 0)
+
+        self.log.info("Check the routing table of an outbound connection")
+        peer_of_node0 = node0.getpeerinfo()[0]['id']
+        peer_of_node1 = node1.getpeerinfo()[0]['id']
+
+        routing = node0.getdandelioninfo()['routing']
+        assert_equal(routing['inbound'], [])
+        assert_equal(routing['outbound'], [peer_of_node0])
+        assert_equal(routing['destinations'], [peer_of_node0])
+        assert_equal(routing['routes'], [])
+
+        # node1 has no outbound peers to route the stem transactions of its
+        # inbound peer to
+        routing = node1.getdandelioninfo()['routing']
+        assert_equal(routing['inbound'], [peer_of_node1])
+        assert_equal(routing['outbound'], [])
+        assert_equal(routing['destinations'], [])
+        assert_equal(routing['routes'], [])
+        assert 'localdestination' not in routing
+
+        self.log.info("Check that a disconnected peer leaves the routing table")
+        disconnect_nodes(node0, 1)
+        wait_until(lambda: node0.getdandelioninfo()['routing']['outbound'] == [], timeout=10)
+        wait_until(lambda: node1.getdandelioninfo()['routing']['inbound'] == [], timeout=10)
+        assert_equal(node0.getdandelioninfo()['routing']['destinations'], [])
+
+
+if __name__ == '__main__':
+    DandelionInfoTest().main()
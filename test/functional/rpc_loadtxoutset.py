@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The NIX Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test bootstrapping a node from a UTXO snapshot using `loadtxoutset`.
+"""
+from test_framework.messages import NODE_NETWORK
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.test_node import ErrorMatch
+from test_framework.util import assert_equal, assert_raises_rpc_error, connect_nodes
+
+from pathlib import Path
+
+SNAPSHOT_HEIGHT = 100
+
+
+class LoadtxoutsetTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+
+    def setup_network(self):
+        # The nodes are connected once the snapshot is loaded.
+        self.setup_nodes()
+
+    def run_test(self):
+        node0, node1 = self.nodes
+        node0.generate(SNAPSHOT_HEIGHT)
+        dump = node0.dumptxoutset('txoutset.dat')
+        assert_equal(dump['base_height'], SNAPSHOT_HEIGHT)
+        snapshot_path = str(Path(node0.datadir) / self.chain / 'txoutset.dat')
+        txoutset = node0.gettxoutsetinfo()
+        nchaintx = node0.getchaintxstats()['txcount']
+        assumeutxo = '-assumeutxo={}:{}:{}'.format(SNAPSHOT_HEIGHT, txoutset['hash_serialized_2'], nchaintx)
+
+        self.log.info("Refuse to load a snapshot over a chain that has blocks")
+        self.restart_node(0, extra_args=[assumeutxo])
+        assert_raises_rpc_error(-1, 'a snapshot can only be loaded into an empty chain', node0.loadtxoutset, snapshot_path)
+        assert_equal(node0.getblockcount(), SNAPSHOT_HEIGHT)
+
+        self.log.info("Refuse a snapshot whose height has no pinned hash")
+        for height in range(1, SNAPSHOT_HEIGHT + 1):
+            node1.submitheader(node0.getblockheader(node0.getblockhash(height), False))
+        assert_raises_rpc_error(-1, 'No UTXO set hash is pinned for height 100', node1.loadtxoutset, snapshot_path)
+
+        self.log.info("Refuse a snapshot that does not match the pinned hash")
+        self.restart_node(1, extra_args=['-assumeutxo={}:{}:{}'.format(SNAPSHOT_HEIGHT, '00' * 32, nchaintx)])
+        assert_raises_rpc_error(-1, 'Bad snapshot: UTXO set hash', node1.loadtxoutset, snapshot_path)
+        assert_equal(node1.getblockcount(), 0)
+        assert_equal(node1.gettxoutsetinfo()['txouts'], 0)
+
+        self.log.info("Refuse a snapshot while an index is enabled")
+        for index_arg in ['-txindex', '-coinstatsindex', '-blockfilterindex']:
+            self.restart_node(1, extra_args=[assumeutxo, index_arg])
+            assert_raises_rpc_error(-1, 'restart without -txindex, -coinstatsindex and -blockfilterindex', node1.loadtxoutset, snapshot_path)
+            assert_equal(node1.getblockcount(), 0)
+
+        self.log.info("Load a snapshot that matches the pinned hash")
+        self.restart_node(1, extra_args=[assumeutxo])
+        assert int(node1.getnetworkinfo()['localservices'], 16) & NODE_NETWORK
+        out = node1.loadtxoutset(snapshot_path)
+        assert_equal(out['coins_loaded'], dump['coins_written'])
+        assert_equal(out['base_hash'], dump['base_hash'])
+        assert_equal(node1.getbestblockhash(), dump['base_hash'])
+        assert_equal(node1.gettxoutsetinfo()['hash_serialized_2'], txoutset['hash_serialized_2'])
+        assert_equal(node1.getchaintxstats()['txcount'], nchaintx)
+        assert_raises_rpc_error(-1, 'a snapshot can only be loaded into an empty chain', node1.loadtxoutset, snapshot_path)
+
+        self.log.info("Stop advertising NODE_NETWORK, as the blocks below the base are missing")
+        assert not int(node1.getnetworkinfo()['localservices'], 16) & NODE_NETWORK
+
+        self.log.info("Refuse to start with an index on a chain loaded from a snapshot")
+        self.stop_node(1)
+        node1.assert_start_raises_init_error(
+            extra_args=[assumeutxo, '-txindex'],
+            expected_msg='Error: A chain loaded from a UTXO snapshot is incompatible with -txindex',
+            match=ErrorMatch.PARTIAL_REGEX,
+        )
+
+        self.log.info("Sync the blocks above the snapshot base, also after a restart")
+        self.start_node(1, extra_args=[assumeutxo])
+        assert_equal(node1.getbestblockhash(), dump['base_hash'])
+        assert not int(node1.getnetworkinfo()['localservices'], 16) & NODE_NETWORK
+        node0.generate(10)
+        connect_nodes(node1, 0)
+        self.sync_blocks()
+        assert_equal(node1.gettxoutsetinfo()['hash_serialized_2'], node0.gettxoutsetinfo()['hash_serialized_2'])
+
+
+if __name__ == '__main__':
+    LoadtxoutsetTest().main()
@@ -124,6 +124,7 @@ BASE_SCRIPTS = [
     'wallet_avoidreuse.py',
     'mempool_reorg.py',
     'mempool_persist.py',
+    'feature_persist_sigcache.py',
     'wallet_multiwallet.py',
     'wallet_multiwallet.py --usecli',
     'wallet_createwallet.py',
@@ -142,11 +143,13 @@ BASE_SCRIPTS = [
     'p2p_disconnect_ban.py',
     'rpc_decodescript.py',
     'rpc_blockchain.py',
+    'rpc_blockcache.py',
     'rpc_deprecated.py',
     'wallet_disable.py',
     'p2p_addr_relay.py',
     'p2p_getdata.py',
     'rpc_net.py',
+    'rpc_dandelion.py',
     'wallet_keypool.py',
     'p2p_mempool.py',
     'p2p_filter.py',
@@ -196,6 +199,8 @@ BASE_SCRIPTS = [
     'wallet_resendwallettransactions.py',
     'wallet_fallbackfee.py',
     'rpc_dumptxoutset.py',
+    'rpc_loadtxoutset.py',
+    'feature_coinstatsindex.py',
     'feature_minchainwork.py',
     'rpc_estimatefee.py',
     'rpc_getblockstats.py',